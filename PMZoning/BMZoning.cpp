@@ -2,7 +2,28 @@
 #include "GraphUtil.h"
 #include "Util.h"
 
-BMZoning::BMZoning(int city_size, int grid_size, vector<float>& zone_distribution, RoadGraph& roads) : Zoning(city_size, grid_size, zone_distribution, roads) {
+namespace {
+
+// preferenceベクトル (質、地価、アクセシビリティ)
+const float W_Q[9] = { 0.1f, 0.1f, -1.0f, 0.01f, 0.2f, 0.0f, 0.0f, -0.3f, 0.0f };
+const float W_L[6] = { 0.1f, 0.1f, -0.1f, 0.01f, 0.2f, 0.0f };
+const float W_M[6] = { -1.0f, 0.1f, 0.1f, -0.01f, 0.2f, -0.1f };
+
+}
+
+/**
+ * ゾーンをランダムに決定し、道路の長さに応じて人口・仕事を配分して、propertyを計算する。
+ *
+ * @param city_size				cityの一辺の距離 [m]
+ * @param grid_size				グリッドの一辺のサイズ
+ * @param zone_distribution		ゾーンタイプの配分率
+ * @param roads					道路網
+ * @param rng					乱数生成器
+ * @param exact_accessibility	trueなら、accessibilityを頂点ごとの距離で厳密に計算する (falseなら、ヒストグラムの畳み込みで近似する)
+ */
+BMZoning::BMZoning(int city_size, int grid_size, vector<float>& zone_distribution, const RoadSnapshotPtr& roads, Rng& rng, bool exact_accessibility) : Zoning(city_size, grid_size, zone_distribution, roads) {
+	this->exact_accessibility = exact_accessibility;
+
 	// ゾーンをランダムに決定する
 	vector<float> expectedNums(NUM_TYPES);
 	for (int i = 0; i < NUM_TYPES; ++i) {
@@ -11,7 +32,7 @@ BMZoning::BMZoning(int city_size, int grid_size, vector<float>& zone_distributio
 
 	for (int r = 0; r < grid_size; ++r) {
 		for (int c = 0; c < grid_size; ++c) {
-			unsigned char type = Util::sampleFromPdf(expectedNums);
+			unsigned char type = Util::sampleFromPdf(rng, expectedNums);
 			zones(r, c) = type;
 			expectedNums[type]--;
 		}
@@ -19,12 +40,13 @@ BMZoning::BMZoning(int city_size, int grid_size, vector<float>& zone_distributio
 
 	// 各セルの道路の長さを計算する
 	Mat_<float> r = Mat_<float>::zeros(grid_size, grid_size);
-	RoadEdgeIter ei, eend;
-	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
-		Polyline2D polyline = GraphUtil::finerEdge(roads, *ei, 10.0f);
+	for (int e = 0; e < roads->numEdges(); ++e) {
+		Polyline2D polyline = roads->finerPolyline(e, 10.0f);
 
 		for (int i = 0; i < polyline.size() - 1; ++i) {
 			QVector2D pt = cityToGrid(polyline[i]);
+			if (pt.x() < 0 || pt.x() >= grid_size || pt.y() < 0 || pt.y() >= grid_size) continue;
+
 			r(pt.y(), pt.x()) += (polyline[i + 1] - polyline[i]).length();
 		}
 	}
@@ -44,17 +66,19 @@ BMZoning::BMZoning(int city_size, int grid_size, vector<float>& zone_distributio
 			}
 		}
 	}
+	for (int i = 0; i < 3; ++i) {
+		rebuildPopulation(i);
+	}
+
+	// 人口・仕事の追加先を決めるためのproperty (ゾーンと道路網だけで決まるので、ここで1回だけ計算する)
+	computeProperties();
 }
 
-void BMZoning::update() {
+void BMZoning::update(Rng& rng) {
 	// 余剰分の人口を計算
-	Mat_<int> sum_people[3];
 	int total_people[3];
 	for (int i = 0; i < 3; ++i) {
-		Mat_<int> sum_people;
-		reduce(people[i], sum_people, 1, CV_REDUCE_SUM);
-		reduce(sum_people, sum_people, 0, CV_REDUCE_SUM);
-		total_people[i] = sum_people(0, 0);
+		total_people[i] = totalPeople(i);
 	}
 
 	// 余剰分の人口をセルから削除
@@ -64,78 +88,162 @@ void BMZoning::update() {
 	d_people[2] = -(float)total_people[0] / (total_people[1] + total_people[2]) * d_people[0];
 	for (int i = 0; i < 3; ++i) {
 		if (d_people[i] < 0) {
-			removePeople(i, -d_people[i]);
-			total_people[i] += d_people[i];
+			removePeople(i, -d_people[i], rng);
+			total_people[i] = totalPeople(i);
 		}
 	}
 
 	// 人口の10%をセルから削除
 	for (int i = 0; i < 3; ++i) {
-		removePeople(i, total_people[i] * 0.1);
+		removePeople(i, total_people[i] * 0.1, rng);
 	}
 
 	// 人口の10%をセルに追加
 	for (int i = 0; i < 3; ++i) {
 		if (d_people[i] > 0) {
-			addPeople(i, total_people[i] * 0.1 + d_people[i]);
+			addPeople(i, total_people[i] * 0.1 + d_people[i], rng);
 		} else {
-			addPeople(i, total_people[i] * 0.1);
+			addPeople(i, total_people[i] * 0.1, rng);
 		}
 	}
 }
 
 /**
  * 各セルのpropertyベクトルを計算する。
+ * 近接度 (0～3) とアクセシビリティ (4) を畳み込みで求めた後、
+ * 地価 (7)、アクセシビリティ (8)、質 (6) を、行ごとに並列に1回の走査で計算する。
+ * 5は常に0。
  */
 void BMZoning::computeProperties() {
-	// preferenceベクトル
-	vector<float> w_q(9); w_q[0] = 0.1; w_q[1] = 0.1; w_q[2] = -1; w_q[3] = 0.01; w_q[4] = 0.2; w_q[5] = 0; w_q[6] = 0; w_q[7] = -0.3; w_q[8] = 0;
-	vector<float> w_l(6); w_l[0] = 0.1; w_l[1] = 0.1; w_l[2] = -0.1; w_l[3] = 0.01; w_l[4] = 0.2; w_l[5] = 0;;
-	vector<float> w_m(6); w_m[0] = -1; w_m[1] = 0.1; w_m[2] = 0.1; w_m[3] = -0.01; w_m[4] = 0.2; w_m[5] = -0.1;
-
-	for (int i = 0; i < 9; ++i) {
-		properties[i] = Mat_<float>::zeros(grid_size, grid_size);
+	if (property_buffer.rows != grid_size * 9 || property_buffer.cols != grid_size) {
+		property_buffer.create(grid_size * 9, grid_size);
+		for (int k = 0; k < 9; ++k) {
+			properties[k] = property_buffer.rowRange(grid_size * k, grid_size * (k + 1));
+		}
 	}
+
+	computeProximityFields(2, properties);
+	computeAccessibilityField(2, properties[4]);
+
+#pragma omp parallel for
 	for (int r = 0; r < grid_size; ++r) {
+		const float* proximity[4];
+		for (int k = 0; k < 4; ++k) {
+			proximity[k] = properties[k][r];
+		}
+		const float* accessibility = properties[4][r];
+		float* unused = properties[5][r];
+		float* quality = properties[6][r];
+		float* land_value = properties[7][r];
+		float* job_accessibility = properties[8][r];
+
 		for (int c = 0; c < grid_size; ++c) {
-			vector<float> prop(9);
-			prop[0] = computeProximity(0, c, r, 2);
-			prop[1] = computeProximity(1, c, r, 2);
-			prop[2] = computeProximity(2, c, r, 2);
-			prop[3] = computeProximity(3, c, r, 2);
-			prop[4] = computeAccessibility(c, r, 2);
-			prop[5] = 0.0;
-			prop[6] = 0.0;
-			prop[7] = Util::dot(w_l, prop);	// 地価
-			prop[8] = Util::dot(w_m, prop);	// アクセシビリティ
-			prop[6] = Util::dot(w_q, prop);	// 質
-
-			for (int k = 0; k < 9; ++k) {
-				properties[k](r, c) = prop[k];
+			float base_l = accessibility[c] * W_L[4];
+			float base_m = accessibility[c] * W_M[4];
+			float base_q = accessibility[c] * W_Q[4];
+			for (int k = 0; k < 4; ++k) {
+				base_l += proximity[k][c] * W_L[k];
+				base_m += proximity[k][c] * W_M[k];
+				base_q += proximity[k][c] * W_Q[k];
 			}
+
+			unused[c] = 0.0f;
+			land_value[c] = base_l;
+			job_accessibility[c] = base_m;
+			quality[c] = base_q + base_l * W_Q[7] + base_m * W_Q[8];
 		}
 	}
 }
 
 /**
- * 指定されたセルを中心とする一定範囲の中で、指定されたゾーンタイプ÷そこまでの距離
- * の和を返却する。
+ * 各セルについて、そのセルを中心とする一定範囲の中で、指定されたゾーンタイプ÷そこまでの距離
+ * の和を、ゾーンタイプ0～3の分だけ計算する。
+ * 各ゾーンタイプの0/1のマスクを4チャンネルの画像にまとめ、1/(1+距離)のカーネルで一度に畳み込む。
+ * 範囲外のセルは0とみなす。カーネルが大きい場合、filter2DはDFTで計算するので、
+ * window_sizeを大きくしても、計算時間はあまり増えない。
+ *
+ * @param window_size		範囲 (中心から各方向のセル数)
+ * @param fields [OUT]		ゾーンタイプごとの結果
  */
-float BMZoning::computeProximity(int type, int x, int y, int window_size) {
-	float total = 0.0f;
+void BMZoning::computeProximityFields(int window_size, Mat_<float> fields[4]) {
+	Mat_<Vec4f> masks(grid_size, grid_size, Vec4f(0, 0, 0, 0));
+#pragma omp parallel for
+	for (int r = 0; r < grid_size; ++r) {
+		for (int c = 0; c < grid_size; ++c) {
+			int type = zones(r, c);
+			if (type < 4) masks(r, c)[type] = 1.0f;
+		}
+	}
+
+	Mat_<float> kernel(window_size * 2 + 1, window_size * 2 + 1);
+	for (int dy = -window_size; dy <= window_size; ++dy) {
+		for (int dx = -window_size; dx <= window_size; ++dx) {
+			kernel(dy + window_size, dx + window_size) = 1.0f / (1.0f + sqrtf(dx * dx + dy * dy));
+		}
+	}
+
+	Mat filtered;
+	filter2D(masks, filtered, CV_32F, kernel, Point(-1, -1), 0, BORDER_CONSTANT);
+
+	// fieldsが確保済みなら、そのメモリに直接書き込む
+	Mat channels[4];
+	for (int k = 0; k < 4; ++k) {
+		fields[k].create(grid_size, grid_size);
+		channels[k] = fields[k];
+	}
+	split(filtered, channels);
+}
+
+/**
+ * 各セルについて、computeAccessibilityの値を計算する。
+ * 厳密なモードでは、セルごとに、頂点のグリッドから範囲内の頂点を探す。
+ * そうでない場合は、頂点をセルごとに数えたヒストグラムを、1/(1+距離)のカーネルで畳み込む。
+ * 頂点の位置をセルの中心に丸めるので近似になるが、頂点数によらず、filter2Dの1回で済む。
+ * 丸めにより、ちょうどwindow_sizeの距離のセルには範囲内の頂点も範囲外の頂点も入るので、カーネルはこのセルまで含める。
+ * グリッドの外の頂点も数えるよう、ヒストグラムは各辺をwindow_sizeだけ広げておく。
+ *
+ * @param window_size		範囲 (中心から各方向のセル数)
+ * @param field [OUT]		結果
+ */
+void BMZoning::computeAccessibilityField(int window_size, Mat_<float>& field) {
+	field.create(grid_size, grid_size);
+
+	if (exact_accessibility) {
+#pragma omp parallel for schedule(dynamic, 4)
+		for (int r = 0; r < grid_size; ++r) {
+			for (int c = 0; c < grid_size; ++c) {
+				field(r, c) = computeAccessibility(c, r, window_size);
+			}
+		}
+		return;
+	}
+
 	float cell_length = (float)city_size / grid_size;
+	int size = grid_size + window_size * 2;
+	Mat_<float> histogram = Mat_<float>::zeros(size, size);
+	for (int v = 0; v < roads->numVertices(); ++v) {
+		QVector2D pt = roads->vertexPt(v) / (float)city_size * grid_size + QVector2D(grid_size, grid_size) * 0.5f;
+		int c = (int)floor(pt.x()) + window_size;
+		int r = (int)floor(pt.y()) + window_size;
+		if (c < 0 || c >= size || r < 0 || r >= size) continue;
 
-	for (int dx = -window_size; dx <= window_size; ++dx) {
-		if (x + dx < 0 || x + dx >= grid_size) continue;
-		for (int dy = -window_size; dy <= window_size; ++dy) {
-			if (y + dy < 0 || y + dy >= grid_size) continue;
-			if (zones(y + dy, x + dx) != type) continue;
+		histogram(r, c) += 1.0f;
+	}
 
-			total += 1.0 / (1.0 + sqrtf(dx * dx + dy * dy));
+	float dist_max = SQR(window_size * cell_length);
+	Mat_<float> kernel = Mat_<float>::zeros(window_size * 2 + 1, window_size * 2 + 1);
+	for (int dy = -window_size; dy <= window_size; ++dy) {
+		for (int dx = -window_size; dx <= window_size; ++dx) {
+			float d = (dx * dx + dy * dy) * SQR(cell_length);
+			if (d <= dist_max) {
+				kernel(dy + window_size, dx + window_size) = 1.0f / (1.0f + sqrtf(d));
+			}
 		}
 	}
 
-	return total;
+	Mat filtered;
+	filter2D(histogram, filtered, CV_32F, kernel, Point(-1, -1), 0, BORDER_CONSTANT);
+	filtered(Rect(window_size, window_size, grid_size, grid_size)).copyTo(field);
 }
 
 /**
@@ -149,9 +257,10 @@ float BMZoning::computeAccessibility(int x, int y, int window_size) {
 
 	QVector2D pt = gridToCity(QVector2D(x, y));
 
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		float d = (roads.graph[*vi]->pt - pt).lengthSquared();
+	vector<int> candidates;
+	roads->findVertices(pt, window_size * cell_length, candidates);
+	for (int i = 0; i < candidates.size(); ++i) {
+		float d = (roads->vertexPt(candidates[i]) - pt).lengthSquared();
 		if (d < dist_max) {
 			total += 1.0 / (1.0 + sqrtf(d));
 		}
@@ -161,43 +270,74 @@ float BMZoning::computeAccessibility(int x, int y, int window_size) {
 }
 
 /**
- * 指定された人数を、セルから削除する。セルはランダムに選択し、1人だけ削除し、これを繰り返す。
+ * 指定された人数を、セルから削除する。
+ * 全員の中から一様に非復元抽出するので、各セルから削除する人数は多変量超幾何分布に従う。
+ * 削除する人数が少ない場合は、累積和から1人ずつ選んで削除する。
+ * 多い場合は、セルの順に、残りの人数のうち何人をそのセルから削除するかを超幾何分布で決める。
+ * 人口より多い人数を指定した場合は、全員を削除する。
  */
-void BMZoning::removePeople(int type, int num) {
-	while (num > 0) {
-		int cell_id = Util::genRand(0, grid_size * grid_size);
-		int x = cell_id % grid_size;
-		int y = cell_id / grid_size;
+void BMZoning::removePeople(int type, int num, Rng& rng) {
+	int num_cells = grid_size * grid_size;
+	int total = totalPeople(type);
+	num = min(num, total);
+	if (num <= 0) return;
 
-		if (people[type](y, x) > 0) {
-			people[type](y, x)--;
-			num--;
+	if (num * 16 <= num_cells) {
+		for (int k = 0; k < num; ++k) {
+			int cell_id = populations[type].sample(rng);
+			populations[type].add(cell_id, -1.0);
+			people[type](cell_id / grid_size, cell_id % grid_size)--;
 		}
+		return;
 	}
+
+	int remaining = total;
+	for (int r = 0; r < grid_size && num > 0; ++r) {
+		for (int c = 0; c < grid_size && num > 0; ++c) {
+			int count = people[type](r, c);
+			if (count <= 0) continue;
+
+			int removed = sampler::hypergeometric(rng, remaining, count, num);
+			people[type](r, c) -= removed;
+			remaining -= count;
+			num -= removed;
+		}
+	}
+	rebuildPopulation(type);
 }
 
 /**
  * 指定された人数を、セルに追加する。
- * セルは、人ならquality、商業ならland value、工業ならaccessibilityに基づいて決める。
+ * セルは、人ならquality、商業ならland value、工業ならaccessibilityに比例する確率で決める。
+ * 全員分の配置を、多項分布として一度にサンプリングする。
  */
-void BMZoning::addPeople(int type, int num) {
-	while (num > 0) {
-		vector<float> pdf;
-		vector<int> cell_ids;
-		for (int i = 0; i < 10; ++i) {
-			int cell_id = Util::genRand(0, grid_size * grid_size);
-			cell_ids.push_back(cell_id);
-			int r = cell_id / grid_size;
-			int c = cell_id % grid_size;
-			pdf.push_back(properties[type + 6](r, c));
-		}
-
-		int index = Util::sampleFromPdf(pdf);
-		int cell_id = cell_ids[index];
-		int r = cell_id / grid_size;
-		int c = cell_id % grid_size;
-
-		people[type](r, c)++;
-		num--;
+void BMZoning::addPeople(int type, int num, Rng& rng) {
+	if (num <= 0) return;
+
+	Mat_<float> weights = properties[type + 6];
+	if (!weights.isContinuous()) weights = weights.clone();
+	sampler::AliasTable table(weights[0], grid_size * grid_size);
+
+	vector<int> counts;
+	table.sampleCounts(rng, num, counts);
+	for (int r = 0; r < grid_size; ++r) {
+		for (int c = 0; c < grid_size; ++c) {
+			people[type](r, c) += counts[r * grid_size + c];
+		}
 	}
+	rebuildPopulation(type);
+}
+
+/**
+ * 指定されたタイプの人数の合計を返却する。
+ */
+int BMZoning::totalPeople(int type) const {
+	return (int)(populations[type].totalWeight() + 0.5);
+}
+
+/**
+ * 人数の累積和を、peopleから作り直す。
+ */
+void BMZoning::rebuildPopulation(int type) {
+	populations[type].build(people[type][0], grid_size * grid_size);
 }
@@ -1,6 +1,8 @@
 ﻿#pragma once
 
 #include "Zoning.h"
+#include "Rng.h"
+#include "Sampler.h"
 
 using namespace std;
 using namespace cv;
@@ -16,18 +18,27 @@ using namespace cv;
 class BMZoning : public Zoning {
 private:
 	Mat_<int> people[3];
-	Mat_<float> properties[9];
+	sampler::FenwickSampler populations[3];		// 各セルの人数の累積和 (peopleと一緒に更新する)
+	Mat_<float> property_buffer;	// 9枚のpropertyを縦に並べたバッファ
+	Mat_<float> properties[9];		// property_bufferの各部分 (それぞれ連続している)
+	bool exact_accessibility;
 
 public:
-	BMZoning(int city_size, int grid_size, vector<float>& zone_distribution, RoadGraph& roads);
+	BMZoning(int city_size, int grid_size, vector<float>& zone_distribution, const RoadSnapshotPtr& roads, Rng& rng, bool exact_accessibility = false);
 
-	void update();
+	void update(Rng& rng);
+	void computeProperties();
+	/** 次のcomputeProperties()から有効になる (コンストラクタで計算済みのpropertyは変わらない) */
+	void setExactAccessibility(bool exact) { exact_accessibility = exact; }
+	const Mat_<float>& accessibilityField() const { return properties[4]; }
 
 private:
-	void computeProperties();
-	float computeProximity(int type, int x, int y, int window_size);
+	void computeProximityFields(int window_size, Mat_<float> fields[4]);
+	void computeAccessibilityField(int window_size, Mat_<float>& field);
 	float computeAccessibility(int x, int y, int window_size);
-	void removePeople(int type, int num);
-	void addPeople(int type, int num);
+	int totalPeople(int type) const;
+	void rebuildPopulation(int type);
+	void removePeople(int type, int num, Rng& rng);
+	void addPeople(int type, int num, Rng& rng);
 };
 
@@ -0,0 +1,96 @@
+﻿#include "BatchRunner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <QString>
+
+namespace {
+
+void printUsage(const char* program) {
+	fprintf(stderr,
+		"Usage: %s [options] [job ...]\n"
+		"Runs zoning jobs without the GUI and writes one tab-separated result line per job.\n"
+		"\n"
+		"Options:\n"
+		"  -j, --jobs FILE      read jobs from FILE, one per line ('-' for stdin)\n"
+		"  -o, --output FILE    write results to FILE instead of stdout\n"
+		"  -t, --threads N      number of jobs run concurrently (default: all cores)\n"
+		"  --KEY=VALUE          default parameter for every job, e.g. --roads=osm/urayasu_small.gsm\n"
+		"\n"
+		"A job is 'TYPE key=value ...' where TYPE is pm, best, bm or prefs, e.g.\n"
+		"  %s --roads=osm/urayasu_small.gsm --prefs=preferences.txt \"pm seed=1\" \"best candidates=500\"\n",
+		program, program);
+}
+
+}
+
+/**
+ * GUIを使わずに、ゾーニングの生成とスコア計算をまとめて実行する。
+ */
+int main(int argc, char *argv[]) {
+	vector<QString> job_files;
+	vector<QString> job_lines;
+	QString output;
+	int num_threads = 0;
+	vector<pair<QString, QString> > defaults;
+
+	for (int i = 1; i < argc; ++i) {
+		QString arg = QString::fromLocal8Bit(argv[i]);
+
+		if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+			job_files.push_back(QString::fromLocal8Bit(argv[++i]));
+		} else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+			output = QString::fromLocal8Bit(argv[++i]);
+		} else if ((arg == "-t" || arg == "--threads") && i + 1 < argc) {
+			num_threads = atoi(argv[++i]);
+		} else if (arg == "-h" || arg == "--help") {
+			printUsage(argv[0]);
+			return 0;
+		} else if (arg.startsWith("--") && arg.contains('=')) {
+			int pos = arg.indexOf('=');
+			defaults.push_back(make_pair(arg.mid(2, pos - 2), arg.mid(pos + 1)));
+		} else if (arg.startsWith("-")) {
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			printUsage(argv[0]);
+			return 2;
+		} else {
+			job_lines.push_back(arg);
+		}
+	}
+
+	FILE* out = stdout;
+	if (!output.isEmpty()) {
+		out = fopen(output.toUtf8().data(), "w");
+		if (out == NULL) {
+			fprintf(stderr, "cannot open output file: %s\n", output.toUtf8().data());
+			return 1;
+		}
+	}
+
+	BatchRunner runner(out);
+	runner.setNumThreads(num_threads);
+	for (int i = 0; i < defaults.size(); ++i) {
+		runner.setDefault(defaults[i].first, defaults[i].second);
+	}
+
+	vector<BatchJob> jobs;
+	for (int i = 0; i < job_files.size(); ++i) {
+		if (!runner.readJobFile(job_files[i], jobs)) return 1;
+	}
+	for (int i = 0; i < job_lines.size(); ++i) {
+		if (!runner.addJob(job_lines[i], jobs)) {
+			fprintf(stderr, "invalid job: %s\n", job_lines[i].toUtf8().data());
+			return 2;
+		}
+	}
+
+	if (jobs.empty()) {
+		printUsage(argv[0]);
+		return 2;
+	}
+
+	int num_failed = runner.run(jobs);
+
+	if (out != stdout) fclose(out);
+
+	return num_failed > 0 ? 1 : 0;
+}
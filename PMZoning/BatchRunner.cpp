@@ -0,0 +1,376 @@
+﻿#include "BatchRunner.h"
+#include "PMZoning.h"
+#include "ZoningPyramid.h"
+#include "TiledZoning.h"
+#include "BMZoning.h"
+#include "ZoningSearch.h"
+#include "GraphUtil.h"
+#include "RoadSnapshotFile.h"
+#include "OsmImporter.h"
+#include "Rng.h"
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QRegExp>
+#include <QElapsedTimer>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * 「種類 key=value key=value ...」の形式の1行を解析する。
+ *
+ * @param line		ジョブの文字列
+ * @return			正しい形式ならtrue
+ */
+bool BatchJob::parse(const QString& line) {
+	QStringList tokens = line.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+	if (tokens.empty()) return false;
+
+	type = tokens[0];
+	params.clear();
+	for (int i = 1; i < tokens.size(); ++i) {
+		int pos = tokens[i].indexOf('=');
+		if (pos <= 0) return false;
+
+		params[tokens[i].left(pos)] = tokens[i].mid(pos + 1);
+	}
+
+	return true;
+}
+
+QString BatchJob::value(const QString& key, const QString& default_value) const {
+	return params.value(key, default_value);
+}
+
+int BatchJob::intValue(const QString& key, int default_value) const {
+	if (!params.contains(key)) return default_value;
+
+	bool ok;
+	int ret = params.value(key).toInt(&ok);
+	return ok ? ret : default_value;
+}
+
+/**
+ * @param out		結果の出力先
+ */
+BatchRunner::BatchRunner(FILE* out) {
+	this->out = out;
+	num_threads = 0;
+
+	defaults["city"] = "5000";
+	defaults["grid"] = "64";
+	defaults["dist"] = "0.7,0.1,0.1,0.1";
+	defaults["iterations"] = "40";
+	defaults["candidates"] = "500";
+	defaults["people"] = "10000";
+	defaults["groups"] = "10";
+	defaults["img"] = "400";
+}
+
+/**
+ * ジョブを1つ追加する。デフォルト値は、ジョブで指定されていないパラメータにだけ適用する。
+ *
+ * @param line		ジョブの文字列
+ * @param jobs		ジョブのリスト
+ * @return			正しい形式ならtrue
+ */
+bool BatchRunner::addJob(const QString& line, vector<BatchJob>& jobs) {
+	BatchJob job;
+	if (!job.parse(line)) return false;
+
+	for (QMap<QString, QString>::const_iterator it = defaults.constBegin(); it != defaults.constEnd(); ++it) {
+		if (!job.params.contains(it.key())) {
+			job.params[it.key()] = it.value();
+		}
+	}
+
+	job.index = jobs.size();
+	jobs.push_back(job);
+	return true;
+}
+
+/**
+ * ジョブファイルを読み込む。1行が1ジョブで、空行と#で始まる行は無視する。
+ *
+ * @param filename		ファイル名 ("-"なら標準入力)
+ * @param jobs			ジョブのリスト
+ * @return				全ての行を読み込めたらtrue
+ */
+bool BatchRunner::readJobFile(const QString& filename, vector<BatchJob>& jobs) {
+	QFile file;
+	bool opened;
+	if (filename == "-") {
+		opened = file.open(stdin, QIODevice::ReadOnly);
+	} else {
+		file.setFileName(filename);
+		opened = file.open(QIODevice::ReadOnly);
+	}
+	if (!opened) {
+		fprintf(stderr, "cannot open job file: %s\n", filename.toUtf8().data());
+		return false;
+	}
+
+	QTextStream in(&file);
+	int line_no = 0;
+	while (!in.atEnd()) {
+		QString line = in.readLine().trimmed();
+		line_no++;
+		if (line.isEmpty() || line.startsWith("#")) continue;
+
+		if (!addJob(line, jobs)) {
+			fprintf(stderr, "%s:%d: invalid job: %s\n", filename.toUtf8().data(), line_no, line.toUtf8().data());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * 全てのジョブを実行し、結果を出力する。
+ *
+ * @param jobs		ジョブのリスト
+ * @return			失敗したジョブの数
+ */
+int BatchRunner::run(vector<BatchJob>& jobs) {
+	preload(jobs);
+	writeHeader();
+
+	int threads = num_threads;
+#ifdef _OPENMP
+	if (threads <= 0) threads = omp_get_max_threads();
+#else
+	threads = 1;
+#endif
+	if (threads > (int)jobs.size()) threads = jobs.size();
+	if (threads < 1) threads = 1;
+
+	// 複数のジョブを並列に実行する場合は、bestのワーカーは1つにする
+	int default_workers = threads > 1 ? 1 : 0;
+
+	int num_failed = 0;
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+	for (int i = 0; i < (int)jobs.size(); ++i) {
+		BatchResult result = runJob(jobs[i], default_workers);
+
+#pragma omp critical(batch_output)
+		{
+			writeResult(result);
+			if (result.status != "ok") num_failed++;
+		}
+	}
+
+	return num_failed;
+}
+
+/**
+ * ジョブを1つ実行する。
+ * 道路網とpreferenceは、preload()で読み込み済みであること。
+ * 複数のスレッドから同時に呼び出してよい。
+ *
+ * @param job				ジョブ
+ * @param default_workers	bestのワーカー数のデフォルト値
+ * @return					実行結果
+ */
+BatchResult BatchRunner::runJob(const BatchJob& job, int default_workers) {
+	BatchResult result;
+	result.index = job.index;
+	result.type = job.type;
+	result.seed = job.intValue("seed", job.index);
+	result.status = "ok";
+
+	QElapsedTimer timer;
+	timer.start();
+
+	int city_size = job.intValue("city", 5000);
+	int grid_size = job.intValue("grid", 64);
+	int num_iterations = job.intValue("iterations", 40);
+	int img_size = job.intValue("img", 400);
+	vector<float> zone_distribution = parseDistribution(job.value("dist"));
+	QString save = job.value("save");
+	if (save.contains("%1")) save = save.arg(job.index);
+
+	// preferenceは、ジョブごとにコピーして使う
+	vector<pair<float, vector<float> > > preferences;
+	bool has_preferences = !job.value("prefs").isEmpty();
+	if (has_preferences) {
+		preferences = preferences_cache.value(job.value("prefs"));
+		if (preferences.empty()) {
+			result.status = "cannot read preferences: " + job.value("prefs");
+			return result;
+		}
+	}
+
+	if (job.type != "prefs" && !roadsFor(job)) {
+		result.status = "cannot read roads: " + job.value("roads");
+		return result;
+	}
+
+	Rng rng(result.seed, 0);
+
+	if (job.type == "pm" && job.intValue("tile", 0) > 0) {
+		// タイル分割: スコアの計算 (propertyベクトル) には対応していない
+		if (has_preferences) {
+			result.status = "tiled pm does not support prefs";
+			return result;
+		}
+
+		TiledZoning tiled(city_size, grid_size, roadsFor(job), job.intValue("tile", 0), job.value("spill"));
+		if (!tiled.isValid()) {
+			result.status = "cannot allocate tiled grid in " + job.value("spill");
+			return result;
+		}
+		tiled.initialZoning(zone_distribution, rng);
+		for (int iter = 0; iter < num_iterations; ++iter) {
+			tiled.update(rng);
+		}
+		if (!save.isEmpty()) tiled.save(save.toUtf8().data(), img_size);
+	} else if (job.type == "pm") {
+		boost::shared_ptr<PMZoning> zoning;
+		int coarse_size = job.intValue("coarse", 0);
+		if (coarse_size > 0 && coarse_size < grid_size) {
+			// 多重解像度: 最も粗いレベルでnum_iterations回、細かいレベルほど少なく更新する
+			ZoningPyramid pyramid(city_size, grid_size, zone_distribution, roadsFor(job), coarse_size, num_iterations);
+			zoning = pyramid.generate(rng);
+		} else {
+			zoning = boost::shared_ptr<PMZoning>(new PMZoning(city_size, grid_size, zone_distribution, roadsFor(job)));
+			zoning->initialZoning(zone_distribution, rng);
+			for (int iter = 0; iter < num_iterations; ++iter) {
+				zoning->update(rng);
+			}
+		}
+		PMZoning& pm = *zoning;
+
+		if (has_preferences) {
+			pm.computePropertyVectors();
+			result.score = pm.computeScore(preferences);
+			result.has_score = true;
+		}
+		if (!save.isEmpty()) pm.save(save.toUtf8().data(), img_size);
+	} else if (job.type == "best") {
+		if (!has_preferences) {
+			result.status = "best requires prefs";
+			return result;
+		}
+
+		ZoningSearch search(city_size, grid_size, zone_distribution, roadsFor(job), job.intValue("workers", default_workers), result.seed);
+		Mat_<uchar> best_zone_map;
+		result.score = search.findBest(preferences, job.intValue("candidates", 500), num_iterations, best_zone_map);
+		result.has_score = true;
+
+		if (!save.isEmpty()) {
+			PMZoning best_zones(city_size, grid_size, zone_distribution, roadsFor(job));
+			best_zones.setZoneMap(best_zone_map);
+			best_zones.save(save.toUtf8().data(), img_size);
+		}
+	} else if (job.type == "bm") {
+		BMZoning bm(city_size, grid_size, zone_distribution, roadsFor(job), rng, job.intValue("exact", 0) != 0);
+		for (int iter = 0; iter < num_iterations; ++iter) {
+			bm.update(rng);
+		}
+
+		if (has_preferences) {
+			bm.computePropertyVectors();
+			result.score = bm.computeScore(preferences);
+			result.has_score = true;
+		}
+		if (!save.isEmpty()) bm.save(save.toUtf8().data(), img_size);
+	} else if (job.type == "prefs") {
+		QString filename = job.value("out");
+		if (filename.isEmpty()) {
+			result.status = "prefs requires out";
+			return result;
+		}
+
+		Mat_<double> samples = Zoning::generateRandomPreferences(job.intValue("people", 10000), rng);
+		vector<pair<float, vector<float> > > clusters = Zoning::clusterPreferences(samples, job.intValue("groups", 10), rng);
+		if (!Zoning::writePreferences(filename.toUtf8().data(), clusters)) {
+			result.status = "cannot write preferences: " + filename;
+		}
+	} else {
+		result.status = "unknown job type: " + job.type;
+	}
+
+	result.msec = timer.nsecsElapsed() / 1000000.0;
+
+	return result;
+}
+
+/**
+ * 全ジョブが使う道路網とpreferenceファイルを、並列処理に入る前に読み込んでおく。
+ * 並列処理の中では、キャッシュを読み出すだけにする。
+ */
+void BatchRunner::preload(const vector<BatchJob>& jobs) {
+	for (int i = 0; i < jobs.size(); ++i) {
+		QString roads_file = jobs[i].value("roads");
+		if (!roads_cache.contains(roads_file)) {
+			if (!roads_file.isEmpty() && RoadSnapshotFile::isSnapshotFile(roads_file)) {
+				// バイナリ形式は、メモリにマップしてそのまま使う
+				QString error;
+				roads_cache[roads_file] = RoadSnapshotFile::load(roads_file, &error);
+				if (!roads_cache[roads_file]) fprintf(stderr, "%s\n", error.toUtf8().data());
+			} else if (OsmImporter::isOsmFile(roads_file)) {
+				// OpenStreetMapのファイルは、道路を抽出してから使う
+				OsmImporter importer;
+				RoadGraph roads;
+				if (importer.import(roads_file, roads)) {
+					roads_cache[roads_file] = RoadSnapshotPtr(new RoadSnapshot(roads));
+				} else {
+					fprintf(stderr, "%s\n", importer.errorString().toUtf8().data());
+					roads_cache[roads_file] = RoadSnapshotPtr();
+				}
+			} else {
+				// 読み込めない (頂点が1つもない) 場合は、ジョブが"cannot read roads"を報告できるようにNULLを入れる
+				RoadGraph roads;
+				if (!roads_file.isEmpty()) {
+					GraphUtil::loadRoads(roads, roads_file);
+				}
+				if (boost::num_vertices(roads.graph) > 0) {
+					roads_cache[roads_file] = RoadSnapshotPtr(new RoadSnapshot(roads));
+				} else {
+					roads_cache[roads_file] = RoadSnapshotPtr();
+				}
+			}
+		}
+
+		QString prefs_file = jobs[i].value("prefs");
+		if (!prefs_file.isEmpty() && !preferences_cache.contains(prefs_file)) {
+			preferences_cache[prefs_file] = Zoning::readPreferences(prefs_file.toUtf8().data());
+		}
+	}
+}
+
+RoadSnapshotPtr BatchRunner::roadsFor(const BatchJob& job) {
+	return roads_cache.value(job.value("roads"));
+}
+
+void BatchRunner::writeHeader() {
+	fprintf(out, "# job\ttype\tseed\tscore\tmsec\tstatus\n");
+	fflush(out);
+}
+
+/**
+ * 結果を1行出力する。途中経過を追えるように、1行ごとにflushする。
+ */
+void BatchRunner::writeResult(const BatchResult& result) {
+	if (result.has_score) {
+		fprintf(out, "%d\t%s\t%u\t%f\t%.3f\t%s\n", result.index, result.type.toUtf8().data(), result.seed, result.score, result.msec, result.status.toUtf8().data());
+	} else {
+		fprintf(out, "%d\t%s\t%u\t-\t%.3f\t%s\n", result.index, result.type.toUtf8().data(), result.seed, result.msec, result.status.toUtf8().data());
+	}
+	fflush(out);
+}
+
+/**
+ * 「0.7,0.1,0.1,0.1」の形式の、ゾーンタイプの分布を解析する。
+ */
+vector<float> BatchRunner::parseDistribution(const QString& str) {
+	vector<float> zone_distribution(4, 0.0f);
+	QStringList list = str.split(",");
+	for (int i = 0; i < list.size() && i < zone_distribution.size(); ++i) {
+		zone_distribution[i] = list[i].toFloat();
+	}
+	return zone_distribution;
+}
@@ -0,0 +1,102 @@
+﻿#pragma once
+
+#include <vector>
+#include <stdio.h>
+#include <QString>
+#include <QMap>
+#include <boost/shared_ptr.hpp>
+#include "RoadSnapshot.h"
+
+using namespace std;
+
+/**
+ * バッチ処理の1ジョブ。
+ * 「種類 key=value key=value ...」の形式の1行から作成する。
+ *
+ * 種類:
+ *   pm		PM方式でゾーニングを1つ生成する (prefsを指定すれば、スコアも計算する)
+ *   best	PM方式でcandidates個のゾーニングを生成し、ベストスコアのものを探す
+ *   bm		Behavioral modelingでゾーニングを1つ生成する (prefsを指定すれば、スコアも計算する)
+ *   prefs	ランダムにpreferenceベクトルを生成してクラスタリングし、outに保存する
+ *
+ * パラメータ (省略時は、BatchRunnerのデフォルト値):
+ *   roads		道路網のファイル (.gsm、RoadSnapshotFileの.rsn、またはOpenStreetMapの.osm/.osm.pbf)
+ *   prefs		preferenceファイル
+ *   city		cityの一辺の距離 [m] (5000)
+ *   grid		グリッドの一辺のサイズ (64)
+ *   dist		ゾーンタイプの分布 (0.7,0.1,0.1,0.1)
+ *   iterations	更新回数 (40、coarseを指定した場合は、最も粗いレベルの更新回数)
+ *   coarse		pmを多重解像度で生成する場合の、最も粗いグリッドの一辺のサイズ (0 - 使わない)
+ *   tile		pmをタイルに分割して生成する場合の、タイルの一辺のセル数 (0 - 分割しない、prefsは指定できない)
+ *   spill		tileを指定した場合に、グリッドを置く一時ファイルのディレクトリ (省略時はメモリに置く)
+ *   exact		bmのaccessibilityを、頂点ごとの距離で厳密に計算する (0 - 近似)
+ *   seed		乱数のシード (ジョブ番号)
+ *   candidates	bestの候補の数 (500)
+ *   workers	bestのワーカー数 (0 - 全コア、ただし複数ジョブを並列に実行する場合は1)
+ *   people		prefsの人数 (10000)
+ *   groups		prefsのクラスタ数 (10)
+ *   out		prefsの保存先
+ *   save		ゾーニングの画像の保存先 (%1はジョブ番号に置換される)
+ *   img		画像のサイズ (400)
+ */
+class BatchJob {
+public:
+	int index;
+	QString type;
+	QMap<QString, QString> params;
+
+public:
+	BatchJob() : index(0) {}
+
+	bool parse(const QString& line);
+	QString value(const QString& key, const QString& default_value = QString()) const;
+	int intValue(const QString& key, int default_value) const;
+};
+
+/**
+ * 1ジョブの実行結果。
+ */
+class BatchResult {
+public:
+	int index;
+	QString type;
+	unsigned int seed;
+	float score;
+	bool has_score;
+	double msec;
+	QString status;		// "ok"、またはエラーメッセージ
+
+public:
+	BatchResult() : index(0), seed(0), score(0.0f), has_score(false), msec(0.0) {}
+};
+
+/**
+ * GUIを使わずに、複数のジョブを1つのプロセスでまとめて実行する。
+ * 道路網とpreferenceファイルは、ファイルごとに1回だけ読み込んで、全ジョブで共有する。
+ * ジョブはOpenMPで並列に実行し、終わったものから順に結果を1行ずつ出力する。
+ */
+class BatchRunner {
+private:
+	QMap<QString, QString> defaults;
+	QMap<QString, RoadSnapshotPtr> roads_cache;
+	QMap<QString, vector<pair<float, vector<float> > > > preferences_cache;
+	FILE* out;
+	int num_threads;
+
+public:
+	BatchRunner(FILE* out);
+
+	void setDefault(const QString& key, const QString& value) { defaults[key] = value; }
+	void setNumThreads(int num_threads) { this->num_threads = num_threads; }
+	bool addJob(const QString& line, vector<BatchJob>& jobs);
+	bool readJobFile(const QString& filename, vector<BatchJob>& jobs);
+	int run(vector<BatchJob>& jobs);
+	BatchResult runJob(const BatchJob& job, int default_workers);
+
+private:
+	void preload(const vector<BatchJob>& jobs);
+	RoadSnapshotPtr roadsFor(const BatchJob& job);
+	void writeHeader();
+	void writeResult(const BatchResult& result);
+	static vector<float> parseDistribution(const QString& str);
+};
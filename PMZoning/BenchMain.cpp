@@ -0,0 +1,118 @@
+﻿#include "Benchmark.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <QString>
+#include <QStringList>
+
+namespace {
+
+void printUsage(const char* program) {
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"Times the main zoning stages with fixed seeds and writes CSV or JSON.\n"
+		"\n"
+		"Options:\n"
+		"  -f, --format csv|json   output format (default: csv)\n"
+		"  -o, --output FILE       write results to FILE instead of stdout\n"
+		"  -r, --repeats N         samples per benchmark (default: 5)\n"
+		"  -s, --seed N            random seed (default: 12345)\n"
+		"  -g, --grids LIST        grid sizes, e.g. 64,128,256 (default: 64..2048)\n"
+		"  -n, --networks LIST     road networks (default: %s)\n"
+		"  -p, --prefs LIST        preference files (default: preferences.txt,preferences_1000000.txt)\n"
+		"  -d, --data DIR          directory containing osm/ and the preference files (default: .)\n"
+		"  -b, --bench LIST        run only benchmarks whose name contains one of LIST\n"
+		"  -c, --city-size N       city size [m] (default: 5000)\n",
+		program, Benchmark::defaultNetworks().join(",").toUtf8().data());
+}
+
+}
+
+/**
+ * 固定シードで主要な処理の処理時間を計測し、結果をCSVまたはJSONで出力する。
+ */
+int main(int argc, char *argv[]) {
+	int format = Benchmark::FORMAT_CSV;
+	QString output;
+	int repeats = 5;
+	unsigned int seed = 12345;
+	int city_size = 5000;
+	QString data_dir = ".";
+	QString grids, networks, prefs, benches;
+
+	for (int i = 1; i < argc; ++i) {
+		QString arg = QString::fromLocal8Bit(argv[i]);
+		bool has_value = i + 1 < argc;
+
+		if ((arg == "-f" || arg == "--format") && has_value) {
+			QString value = QString::fromLocal8Bit(argv[++i]);
+			if (value == "json") {
+				format = Benchmark::FORMAT_JSON;
+			} else if (value == "csv") {
+				format = Benchmark::FORMAT_CSV;
+			} else {
+				fprintf(stderr, "unknown format: %s\n", argv[i]);
+				return 2;
+			}
+		} else if ((arg == "-o" || arg == "--output") && has_value) {
+			output = QString::fromLocal8Bit(argv[++i]);
+		} else if ((arg == "-r" || arg == "--repeats") && has_value) {
+			repeats = atoi(argv[++i]);
+		} else if ((arg == "-s" || arg == "--seed") && has_value) {
+			seed = strtoul(argv[++i], NULL, 10);
+		} else if ((arg == "-g" || arg == "--grids") && has_value) {
+			grids = QString::fromLocal8Bit(argv[++i]);
+		} else if ((arg == "-n" || arg == "--networks") && has_value) {
+			networks = QString::fromLocal8Bit(argv[++i]);
+		} else if ((arg == "-p" || arg == "--prefs") && has_value) {
+			prefs = QString::fromLocal8Bit(argv[++i]);
+		} else if ((arg == "-d" || arg == "--data") && has_value) {
+			data_dir = QString::fromLocal8Bit(argv[++i]);
+		} else if ((arg == "-b" || arg == "--bench") && has_value) {
+			benches = QString::fromLocal8Bit(argv[++i]);
+		} else if ((arg == "-c" || arg == "--city-size") && has_value) {
+			city_size = atoi(argv[++i]);
+		} else if (arg == "-h" || arg == "--help") {
+			printUsage(argv[0]);
+			return 0;
+		} else {
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			printUsage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (repeats < 1) repeats = 1;
+
+	FILE* out = stdout;
+	if (!output.isEmpty()) {
+		out = fopen(output.toUtf8().data(), "w");
+		if (out == NULL) {
+			fprintf(stderr, "cannot open output file: %s\n", output.toUtf8().data());
+			return 1;
+		}
+	}
+
+	Benchmark benchmark(out, format);
+	benchmark.setRepeats(repeats);
+	benchmark.setSeed(seed);
+	benchmark.setCitySize(city_size);
+	benchmark.setDataDir(data_dir);
+	if (!grids.isEmpty()) {
+		vector<int> grid_sizes;
+		QStringList list = grids.split(",");
+		for (int i = 0; i < list.size(); ++i) {
+			int grid_size = list[i].toInt();
+			if (grid_size > 0) grid_sizes.push_back(grid_size);
+		}
+		benchmark.setGridSizes(grid_sizes);
+	}
+	if (!networks.isEmpty()) benchmark.setNetworks(networks.split(","));
+	if (!prefs.isEmpty()) benchmark.setPreferenceFiles(prefs.split(","));
+	if (!benches.isEmpty()) benchmark.setFilters(benches.split(","));
+
+	benchmark.run();
+
+	if (out != stdout) fclose(out);
+
+	return 0;
+}
@@ -0,0 +1,592 @@
+﻿#include "Benchmark.h"
+#include "PMZoning.h"
+#include "ZoningPyramid.h"
+#include "BMZoning.h"
+#include "ModifiedBrushFire.h"
+#include "DistanceTransform.h"
+#include "ZoningScorer.h"
+#include "ScoringKernel.h"
+#include "KMeans.h"
+#include "PackedZoneMap.h"
+#include "RoadRaster.h"
+#include "RoadSnapshotFile.h"
+#include "RoadPlanarizer.h"
+#include "GraphUtil.h"
+#include "Rng.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QElapsedTimer>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+/** 処理時間 [msec] を返却する */
+double elapsedMsec(const QElapsedTimer& timer) {
+	return timer.nsecsElapsed() / 1000000.0;
+}
+
+}
+
+/**
+ * @param out		結果の出力先
+ * @param format	FORMAT_CSV / FORMAT_JSON
+ */
+Benchmark::Benchmark(FILE* out, int format) {
+	this->out = out;
+	this->format = format;
+	num_records = 0;
+	repeats = 5;
+	seed = 12345;
+	city_size = 5000;
+	data_dir = ".";
+
+	for (int grid_size = 64; grid_size <= 2048; grid_size *= 2) {
+		grid_sizes.push_back(grid_size);
+	}
+	networks = defaultNetworks();
+	preference_files << "preferences.txt" << "preferences_1000000.txt";
+}
+
+/**
+ * デフォルトの道路網のリスト。
+ * regular_N / curvy_N は、street間隔N [m]、avenue間隔5N [m] で生成した道路網を表す。
+ */
+QStringList Benchmark::defaultNetworks() {
+	QStringList ret;
+	ret << "urayasu_small" << "san-francisco";
+	ret << "regular_200" << "regular_100" << "regular_50";
+	ret << "curvy_200" << "curvy_100" << "curvy_50";
+	return ret;
+}
+
+/**
+ * 全てのベンチマークを実行する。
+ */
+void Benchmark::run() {
+	beginOutput();
+
+	for (int n = 0; n < networks.size(); ++n) {
+		RoadSnapshotPtr roads;
+		if (!prepareNetwork(networks[n], roads)) {
+			fprintf(stderr, "skipping network %s\n", networks[n].toUtf8().data());
+			continue;
+		}
+
+		for (int g = 0; g < grid_sizes.size(); ++g) {
+			// 道路網とグリッドサイズの組ごとに、独立した乱数系列を使う
+			runGrid(networks[n], roads, grid_sizes[g], n * 100 + g);
+		}
+	}
+
+	runPlanarizerLattice();
+	runKMeans();
+
+	endOutput();
+}
+
+/**
+ * 道路網を読み込む、または生成して、スナップショットを作成する。その処理時間も計測する。
+ *
+ * @param network		道路網の名前
+ * @param snapshot [OUT]	道路網のスナップショット
+ * @return				道路網を用意できたらtrue
+ */
+bool Benchmark::prepareNetwork(const QString& network, RoadSnapshotPtr& snapshot) {
+	RoadGraph roads;
+	vector<double> samples;
+
+	if (network.startsWith("regular_") || network.startsWith("curvy_")) {
+		bool curvy = network.startsWith("curvy_");
+		float street_interval = network.mid(network.indexOf('_') + 1).toFloat();
+		if (street_interval <= 0.0f) return false;
+
+		for (int i = 0; i < repeats; ++i) {
+			roads.clear();
+			QElapsedTimer timer;
+			timer.start();
+			if (curvy) {
+				GraphUtil::generateCurvyGrid(roads, city_size, street_interval * 5.0f, street_interval);
+			} else {
+				GraphUtil::generateRegularGrid(roads, city_size, street_interval * 5.0f, street_interval);
+			}
+			samples.push_back(elapsedMsec(timer));
+		}
+
+		if (enabled("generate_roads")) report("generate_roads", network, 0, QString(), samples);
+	} else {
+		QString filename = data_dir + "/osm/" + network + ".gsm";
+		if (!QFile::exists(filename)) {
+			fprintf(stderr, "road file not found: %s\n", filename.toUtf8().data());
+			return false;
+		}
+
+		for (int i = 0; i < repeats; ++i) {
+			QElapsedTimer timer;
+			timer.start();
+			GraphUtil::loadRoads(roads, filename);
+			samples.push_back(elapsedMsec(timer));
+		}
+
+		if (enabled("load_roads")) report("load_roads", network, 0, QString(), samples);
+	}
+
+	if (enabled("planarify")) {
+		samples.clear();
+		for (int i = 0; i < repeats; ++i) {
+			RoadGraph temp;
+			GraphUtil::copyRoads(roads, temp);
+			QElapsedTimer timer;
+			timer.start();
+			GraphUtil::planarify(temp);
+			samples.push_back(elapsedMsec(timer));
+		}
+		report("planarify", network, 0, QString(), samples);
+	}
+
+	samples.clear();
+	for (int i = 0; i < repeats; ++i) {
+		QElapsedTimer timer;
+		timer.start();
+		snapshot = RoadSnapshotPtr(new RoadSnapshot(roads));
+		samples.push_back(elapsedMsec(timer));
+	}
+	if (enabled("road_snapshot")) report("road_snapshot", network, 0, QString(), samples);
+
+	// バイナリ形式 (RoadSnapshotFile) に保存したものを、マップして読み込む
+	if (enabled("load_snapshot_file")) {
+		QTemporaryFile temp;
+		if (temp.open()) {
+			temp.close();
+			if (RoadSnapshotFile::save(*snapshot, temp.fileName())) {
+				samples.clear();
+				for (int i = 0; i < repeats; ++i) {
+					QElapsedTimer timer;
+					timer.start();
+					RoadSnapshotPtr loaded = RoadSnapshotFile::load(temp.fileName());
+					samples.push_back(elapsedMsec(timer));
+				}
+				report("load_snapshot_file", network, 0, QString(), samples);
+			}
+		}
+	}
+
+	return GraphUtil::getNumVertices(roads) > 0;
+}
+
+/**
+ * 指定された道路網とグリッドサイズで、ゾーニング関係の処理時間を計測する。
+ *
+ * @param network		道路網の名前
+ * @param roads			道路網のスナップショット
+ * @param grid_size		グリッドサイズ
+ * @param stream		乱数のストリーム番号
+ */
+void Benchmark::runGrid(const QString& network, const RoadSnapshotPtr& roads, int grid_size, int stream) {
+	Rng rng(seed, stream);
+
+	vector<float> zone_distribution(4);
+	zone_distribution[0] = 0.7f; zone_distribution[1] = 0.1f; zone_distribution[2] = 0.1f; zone_distribution[3] = 0.1f;
+
+	QElapsedTimer timer;
+	vector<double> samples;
+
+	// 道路までの距離マップの計算を含む、初期化 (毎回キャッシュを空にして計測する)
+	if (enabled("zoning_init")) {
+		samples.clear();
+		for (int i = 0; i < repeats; ++i) {
+			RoadRaster::clearCache();
+			timer.start();
+			PMZoning temp(city_size, grid_size, zone_distribution, roads);
+			samples.push_back(elapsedMsec(timer));
+		}
+		report("zoning_init", network, grid_size, QString(), samples);
+	}
+
+	PMZoning pm(city_size, grid_size, zone_distribution, roads);
+
+	// 道路までの距離マップがキャッシュにある場合の初期化
+	if (enabled("zoning_init_cached")) {
+		samples.clear();
+		for (int i = 0; i < repeats; ++i) {
+			timer.start();
+			PMZoning temp(city_size, grid_size, zone_distribution, roads);
+			samples.push_back(elapsedMsec(timer));
+		}
+		report("zoning_init_cached", network, grid_size, QString(), samples);
+	}
+
+	pm.initialZoning(zone_distribution, rng);
+	pm.computePropertyVectors();
+
+	// PMの1ステップと、その後のpropertyベクトルの差分更新
+	if (enabled("pm_update") || enabled("property_vectors_update")) {
+		vector<double> update_samples;
+		vector<double> property_samples;
+		for (int i = 0; i < repeats; ++i) {
+			timer.start();
+			pm.update(rng);
+			update_samples.push_back(elapsedMsec(timer));
+
+			timer.start();
+			pm.computePropertyVectors();
+			property_samples.push_back(elapsedMsec(timer));
+		}
+		if (enabled("pm_update")) report("pm_update", network, grid_size, QString(), update_samples);
+		if (enabled("property_vectors_update")) report("property_vectors_update", network, grid_size, QString(), property_samples);
+	}
+
+	// propertyベクトルを最初から計算する
+	if (enabled("property_vectors_full")) {
+		samples.clear();
+		for (int i = 0; i < repeats; ++i) {
+			pm.setZoneMap(pm.zoneMap());
+			timer.start();
+			pm.computePropertyVectors();
+			samples.push_back(elapsedMsec(timer));
+		}
+		report("property_vectors_full", network, grid_size, QString(), samples);
+	}
+
+	// セルオートマトンの1ステップを、隣接セルの数え方ごとに計測する
+	// 同じゾーンマップと乱数系列から始めるので、結果が一致しなければエラーを出力する
+	if (enabled("ca_step")) {
+		const char* mode_names[2] = { "bytes", "packed" };
+		int modes[2] = { CellularAutomaton::COUNT_BYTES, CellularAutomaton::COUNT_PACKED };
+		Mat_<uchar> results[2];
+		for (int m = 0; m < 2; ++m) {
+			CellularAutomaton automaton(grid_size);
+			automaton.setCountingMode(modes[m]);
+			Rng ca_rng(seed, stream);
+			vector<float> needs(4, 0.0f);
+			samples.clear();
+			for (int i = 0; i < repeats; ++i) {
+				automaton.setZones(pm.zoneMap());
+				timer.start();
+				automaton.step(needs, ca_rng);
+				samples.push_back(elapsedMsec(timer));
+			}
+			results[m] = automaton.zones().clone();
+			report("ca_step", network, grid_size, mode_names[m], samples);
+		}
+		if (countNonZero(results[0] != results[1]) > 0) {
+			fprintf(stderr, "ca_step: packed counting gave a different zone map\n");
+		}
+	}
+
+	// 多重解像度で、初期ゾーンから更新まで全て行う (64x64から、40回の更新を1/4ずつ減らしながら)
+	// 比較のため、最も細かいグリッドだけで40回更新する場合 (pm_flat) も計測し、
+	// preferenceファイルがあれば、最初のファイルでの両者のスコアをparamに出力する
+	if (enabled("pm_pyramid") && grid_size > 64) {
+		ZoningPyramid pyramid(city_size, grid_size, zone_distribution, roads, 64, 40);
+		boost::shared_ptr<PMZoning> pyramid_zoning;
+		samples.clear();
+		for (int i = 0; i < repeats; ++i) {
+			timer.start();
+			pyramid_zoning = pyramid.generate(rng);
+			samples.push_back(elapsedMsec(timer));
+		}
+
+		PMZoning flat(city_size, grid_size, zone_distribution, roads);
+		vector<double> flat_samples;
+		for (int i = 0; i < repeats; ++i) {
+			timer.start();
+			flat.initialZoning(zone_distribution, rng);
+			for (int iter = 0; iter < 40; ++iter) {
+				flat.update(rng);
+			}
+			flat_samples.push_back(elapsedMsec(timer));
+		}
+
+		QString pyramid_param = "coarse=64";
+		QString flat_param = "iterations=40";
+		for (int p = 0; p < preference_files.size() && pyramid_zoning; ++p) {
+			vector<pair<float, vector<float> > > preferences = Zoning::readPreferences((data_dir + "/" + preference_files[p]).toUtf8().data());
+			if (preferences.empty()) continue;
+
+			ZoningScorer scorer(preferences);
+			pyramid_zoning->computePropertyVectors();
+			flat.computePropertyVectors();
+			pyramid_param += QString(" %1 score=%2").arg(preference_files[p]).arg(pyramid_zoning->computeScore(scorer));
+			flat_param += QString(" %1 score=%2").arg(preference_files[p]).arg(flat.computeScore(scorer));
+			break;
+		}
+
+		report("pm_pyramid", network, grid_size, pyramid_param, samples);
+		report("pm_flat", network, grid_size, flat_param, flat_samples);
+	}
+
+	// 住宅地の距離マップを、brushfireとEDTで計算する
+	Mat_<uchar> zones = pm.zoneMap();
+	Mat_<uchar> residential = Mat_<uchar>::zeros(grid_size, grid_size);
+	for (int r = 0; r < grid_size; ++r) {
+		for (int c = 0; c < grid_size; ++c) {
+			if (zones(r, c) == 0) residential(r, c) = 1;
+		}
+	}
+
+	if (enabled("brushfire_construct")) {
+		samples.clear();
+		for (int i = 0; i < repeats; ++i) {
+			timer.start();
+			modifiedbrushfire::ModifiedBrushFire bf(grid_size, grid_size, residential);
+			samples.push_back(elapsedMsec(timer));
+		}
+		report("brushfire_construct", network, grid_size, QString(), samples);
+	}
+
+	if (enabled("edt")) {
+		samples.clear();
+		for (int i = 0; i < repeats; ++i) {
+			Mat_<float> dist;
+			Mat_<Vec2i> nearest;
+			timer.start();
+			distancetransform::computeEDT(residential, dist, &nearest);
+			samples.push_back(elapsedMsec(timer));
+		}
+		report("edt", network, grid_size, QString(), samples);
+	}
+
+	// ゾーンマップを1セル2ビットに詰める処理と、詰めたままの隣接セルの数え上げ
+	if (enabled("pack_zones")) {
+		samples.clear();
+		for (int i = 0; i < repeats; ++i) {
+			timer.start();
+			PackedZoneMap packed(zones);
+			samples.push_back(elapsedMsec(timer));
+		}
+		report("pack_zones", network, grid_size, QString(), samples);
+	}
+
+	if (enabled("packed_neighbors")) {
+		PackedZoneMap packed(zones);
+		vector<uchar> counts(grid_size * PackedZoneMap::NUM_TYPES);
+		uchar* rows[PackedZoneMap::NUM_TYPES];
+		for (int t = 0; t < PackedZoneMap::NUM_TYPES; ++t) {
+			rows[t] = &counts[t * grid_size];
+		}
+		vector<quint64> work(3 * packed.wordsPerRow());
+
+		samples.clear();
+		for (int i = 0; i < repeats; ++i) {
+			timer.start();
+			for (int r = 0; r < grid_size; ++r) {
+				packed.countNeighbors(r, rows, &work[0]);
+			}
+			samples.push_back(elapsedMsec(timer));
+		}
+		report("packed_neighbors", network, grid_size, QString(), samples);
+	}
+
+	// スコア
+	if (enabled("score")) {
+		for (int p = 0; p < preference_files.size(); ++p) {
+			QString filename = data_dir + "/" + preference_files[p];
+			vector<pair<float, vector<float> > > preferences = Zoning::readPreferences(filename.toUtf8().data());
+			if (preferences.empty()) {
+				fprintf(stderr, "cannot read preferences: %s\n", filename.toUtf8().data());
+				continue;
+			}
+
+			ZoningScorer scorer(preferences);
+			samples.clear();
+			for (int i = 0; i < repeats; ++i) {
+				timer.start();
+				pm.computeScore(scorer);
+				samples.push_back(elapsedMsec(timer));
+			}
+			report("score", network, grid_size, preference_files[p], samples);
+		}
+	}
+
+	// Behavioral modeling
+	if (enabled("bm_update") || enabled("bm_compute_properties")) {
+		BMZoning bm(city_size, grid_size, zone_distribution, roads, rng);
+
+		vector<double> update_samples;
+		vector<double> property_samples;
+		for (int i = 0; i < repeats; ++i) {
+			timer.start();
+			bm.update(rng);
+			update_samples.push_back(elapsedMsec(timer));
+
+			timer.start();
+			bm.computeProperties();
+			property_samples.push_back(elapsedMsec(timer));
+		}
+		if (enabled("bm_update")) report("bm_update", network, grid_size, QString(), update_samples);
+		if (enabled("bm_compute_properties")) {
+			report("bm_compute_properties", network, grid_size, QString(), property_samples);
+
+			// accessibilityを厳密に計算した場合の時間と、近似の誤差 (accessibilityは道路網だけで決まるので、ゾーンが違っても比べられる)
+			BMZoning exact(city_size, grid_size, zone_distribution, roads, rng, true);
+			samples.clear();
+			for (int i = 0; i < repeats; ++i) {
+				timer.start();
+				exact.computeProperties();
+				samples.push_back(elapsedMsec(timer));
+			}
+
+			Mat_<float> error;
+			absdiff(bm.accessibilityField(), exact.accessibilityField(), error);
+			double max_error, max_value;
+			minMaxLoc(error, NULL, &max_error);
+			minMaxLoc(exact.accessibilityField(), NULL, &max_value);
+			report("bm_compute_properties", network, grid_size, QString("exact max_err=%1 mean_err=%2 max=%3").arg(max_error).arg(mean(error)[0]).arg(max_value), samples);
+		}
+	}
+}
+
+/**
+ * 縦横それぞれ64本の直線道路を、100m間隔で格子状に並べた道路網を平面化する時間を計測する。
+ * 各道路のpolylineの点は交点の間に置くので、線分の長さは100m、RoadPlanarizerのセルの大きさは200mとなり、
+ * 1本おきの道路がセルの境界の線上で交差する。交点の数が (64-1)^2個でなければ、エラーを出力する。
+ */
+void Benchmark::runPlanarizerLattice() {
+	if (!enabled("planarify_lattice")) return;
+
+	const int num_lines = 64;
+	const float spacing = 100.0f;
+	const float origin = -3210.0f;
+
+	// 道路kは、origin + k * spacingの位置にあり、origin + spacing * 0.5からorigin + spacing * (num_lines - 0.5)まで延びる
+	RoadGraph lattice;
+	for (int dir = 0; dir < 2; ++dir) {
+		for (int k = 0; k < num_lines; ++k) {
+			RoadEdgePtr edge = RoadEdgePtr(new RoadEdge(RoadEdge::TYPE_STREET, 1));
+			for (int j = 0; j < num_lines; ++j) {
+				float along = origin + spacing * (j + 0.5f);
+				float across = origin + spacing * k;
+				edge->addPoint(dir == 0 ? QVector2D(along, across) : QVector2D(across, along));
+			}
+
+			RoadVertexDesc src = GraphUtil::addVertex(lattice, RoadVertexPtr(new RoadVertex(edge->polyline[0])));
+			RoadVertexDesc tgt = GraphUtil::addVertex(lattice, RoadVertexPtr(new RoadVertex(edge->polyline.back())));
+			GraphUtil::addEdge(lattice, src, tgt, edge);
+		}
+	}
+
+	// 道路0は、他の方向の道路の範囲の外にあるので交差しない
+	int expected = (num_lines - 1) * (num_lines - 1);
+
+	vector<double> samples;
+	for (int i = 0; i < repeats; ++i) {
+		RoadGraph temp;
+		GraphUtil::copyRoads(lattice, temp);
+		QElapsedTimer timer;
+		timer.start();
+		RoadPlanarizer planarizer(temp);
+		int found = planarizer.planarify();
+		samples.push_back(elapsedMsec(timer));
+
+		if (found != expected) {
+			fprintf(stderr, "planarify_lattice: found %d crossings, expected %d\n", found, expected);
+		}
+	}
+
+	report("planarify_lattice", "lattice", 0, QString(), samples);
+}
+
+/**
+ * 10000人分のpreferenceベクトルを、10個のグループにクラスタリングする時間を計測する。
+ */
+void Benchmark::runKMeans() {
+	if (!enabled("kmeans")) return;
+
+	Rng rng(seed, 999999);
+	Mat_<double> preferences = Zoning::generateRandomPreferences(10000, rng);
+
+	vector<double> samples;
+	for (int i = 0; i < repeats; ++i) {
+		KMeans kmeans(6, 10);
+		Mat_<double> mu;
+		vector<int> groups;
+
+		QElapsedTimer timer;
+		timer.start();
+		kmeans.cluster(preferences, 40, mu, groups, rng);
+		samples.push_back(elapsedMsec(timer));
+	}
+
+	report("kmeans", QString(), 0, "10000x10", samples);
+}
+
+/**
+ * 指定されたベンチマークを実行するか？
+ * フィルタが指定されていれば、名前にいずれかのフィルタ文字列を含むものだけを実行する。
+ */
+bool Benchmark::enabled(const char* name) const {
+	if (filters.empty()) return true;
+
+	QString str(name);
+	for (int i = 0; i < filters.size(); ++i) {
+		if (str.contains(filters[i])) return true;
+	}
+	return false;
+}
+
+/**
+ * 出力の先頭部分を書き出す。実行環境の情報も含める。
+ */
+void Benchmark::beginOutput() {
+#ifdef _OPENMP
+	int threads = omp_get_max_threads();
+#else
+	int threads = 1;
+#endif
+	const char* kernel = scoringkernel::instructionSetName(scoringkernel::instructionSet());
+
+	if (format == FORMAT_JSON) {
+		fprintf(out, "{\n");
+		fprintf(out, "  \"seed\": %u,\n  \"repeats\": %d,\n  \"city_size\": %d,\n  \"threads\": %d,\n  \"score_kernel\": \"%s\",\n", seed, repeats, city_size, threads, kernel);
+		fprintf(out, "  \"results\": [\n");
+	} else {
+		fprintf(out, "# seed=%u repeats=%d city_size=%d threads=%d score_kernel=%s\n", seed, repeats, city_size, threads, kernel);
+		fprintf(out, "benchmark,network,grid,param,repeats,min_ms,median_ms,mean_ms,max_ms\n");
+	}
+	fflush(out);
+}
+
+/**
+ * 1つのベンチマークの結果を書き出す。
+ *
+ * @param name			ベンチマークの名前
+ * @param network		道路網の名前 (無関係なら空)
+ * @param grid_size		グリッドサイズ (無関係なら0)
+ * @param param			その他のパラメータ (preferenceファイルなど)
+ * @param samples		各回の処理時間 [msec]
+ */
+void Benchmark::report(const char* name, const QString& network, int grid_size, const QString& param, vector<double>& samples) {
+	if (samples.empty()) return;
+
+	std::sort(samples.begin(), samples.end());
+	double total = 0.0;
+	for (int i = 0; i < samples.size(); ++i) {
+		total += samples[i];
+	}
+	double median = samples.size() % 2 == 1 ? samples[samples.size() / 2] : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) * 0.5;
+
+	if (format == FORMAT_JSON) {
+		fprintf(out, "%s    {\"benchmark\": \"%s\", \"network\": \"%s\", \"grid\": %d, \"param\": \"%s\", \"repeats\": %d, \"min_ms\": %.4f, \"median_ms\": %.4f, \"mean_ms\": %.4f, \"max_ms\": %.4f}",
+			num_records > 0 ? ",\n" : "", name, network.toUtf8().data(), grid_size, param.toUtf8().data(), (int)samples.size(), samples.front(), median, total / samples.size(), samples.back());
+	} else {
+		fprintf(out, "%s,%s,%d,%s,%d,%.4f,%.4f,%.4f,%.4f\n",
+			name, network.toUtf8().data(), grid_size, param.toUtf8().data(), (int)samples.size(), samples.front(), median, total / samples.size(), samples.back());
+	}
+	fflush(out);
+
+	num_records++;
+}
+
+/**
+ * 出力の末尾部分を書き出す。
+ */
+void Benchmark::endOutput() {
+	if (format == FORMAT_JSON) {
+		fprintf(out, "\n  ]\n}\n");
+	}
+	fflush(out);
+}
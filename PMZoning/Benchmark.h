@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include <vector>
+#include <stdio.h>
+#include <QString>
+#include <QStringList>
+#include "RoadSnapshot.h"
+
+using namespace std;
+
+/**
+ * 主要な処理の処理時間を計測するベンチマーク。
+ * 乱数のシードは固定なので、同じ入力なら毎回同じ処理内容となり、リリース間で比較できる。
+ *
+ * 入力:
+ *   - 道路網ファイル (osm/urayasu_small.gsm、osm/san-francisco.gsm)
+ *   - GraphUtil::generateRegularGrid / generateCurvyGridで生成した道路網 (street間隔を変えて複数)
+ *   - preferenceファイル (preferences.txt、preferences_1000000.txt)
+ *
+ * 計測項目 (道路網ごと):
+ *   load_roads / generate_roads、planarify、road_snapshot、load_snapshot_file
+ * 計測項目 (道路網×グリッドサイズごと):
+ *   zoning_init、zoning_init_cached、pm_update、property_vectors_update、property_vectors_full、ca_step、pm_pyramid、pm_flat、
+ *   brushfire_construct、edt、pack_zones、packed_neighbors、score、bm_update、bm_compute_properties
+ *   (bm_compute_propertiesのparamがexactの行は、accessibilityを厳密に計算した場合で、近似との誤差も出力する)
+ * 計測項目 (1回だけ):
+ *   planarify_lattice (グリッドの線上で交差する格子状の道路網。交点の数が正しいかも確認する)、kmeans
+ *
+ * 結果は、CSVまたはJSONで出力する。
+ */
+class Benchmark {
+public:
+	enum { FORMAT_CSV = 0, FORMAT_JSON };
+
+private:
+	FILE* out;
+	int format;
+	int num_records;
+	int repeats;
+	unsigned int seed;
+	int city_size;
+	QString data_dir;
+	vector<int> grid_sizes;
+	QStringList networks;
+	QStringList preference_files;
+	QStringList filters;
+
+public:
+	Benchmark(FILE* out, int format);
+
+	void setRepeats(int repeats) { this->repeats = repeats; }
+	void setSeed(unsigned int seed) { this->seed = seed; }
+	void setCitySize(int city_size) { this->city_size = city_size; }
+	void setDataDir(const QString& data_dir) { this->data_dir = data_dir; }
+	void setGridSizes(const vector<int>& grid_sizes) { this->grid_sizes = grid_sizes; }
+	void setNetworks(const QStringList& networks) { this->networks = networks; }
+	void setPreferenceFiles(const QStringList& preference_files) { this->preference_files = preference_files; }
+	void setFilters(const QStringList& filters) { this->filters = filters; }
+	static QStringList defaultNetworks();
+
+	void run();
+
+private:
+	bool prepareNetwork(const QString& network, RoadSnapshotPtr& roads);
+	void runGrid(const QString& network, const RoadSnapshotPtr& roads, int grid_size, int stream);
+	void runPlanarizerLattice();
+	void runKMeans();
+	bool enabled(const char* name) const;
+	void beginOutput();
+	void report(const char* name, const QString& network, int grid_size, const QString& param, vector<double>& samples);
+	void endOutput();
+};
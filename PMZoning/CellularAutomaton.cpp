@@ -0,0 +1,281 @@
+﻿#include "CellularAutomaton.h"
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CA_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// ゾーンタイプ (Zoningと同じ値)
+const uchar TYPE_RESIDENTIAL = 0;
+const uchar TYPE_COMMERCIAL = 1;
+const uchar TYPE_INDUSTRIAL = 2;
+const uchar TYPE_PARK = 3;
+
+}
+
+const int CellularAutomaton::NUM_TYPES;
+const uchar CellularAutomaton::TYPE_UNUSED;
+
+CellularAutomaton::CellularAutomaton(int grid_size) {
+	this->grid_size = grid_size;
+	needs_mode = NEEDS_PER_CELL;
+	counting_mode = COUNT_BYTES;
+
+	for (int i = 0; i < 2; ++i) {
+		buffers[i] = Mat_<uchar>(grid_size + 2, grid_size + 2, TYPE_UNUSED);
+	}
+	front = 0;
+	road_factor = Mat_<float>::zeros(grid_size, grid_size);
+
+	column_sums.resize(grid_size + 2);
+	for (int t = 0; t < NUM_TYPES; ++t) {
+		counts[t].resize(grid_size);
+	}
+	uniforms.resize(grid_size * 3);
+}
+
+CellularAutomaton::CellularAutomaton(const CellularAutomaton& ref) {
+	*this = ref;
+}
+
+CellularAutomaton& CellularAutomaton::operator=(const CellularAutomaton& ref) {
+	grid_size = ref.grid_size;
+	needs_mode = ref.needs_mode;
+	counting_mode = ref.counting_mode;
+	for (int i = 0; i < 2; ++i) {
+		buffers[i] = ref.buffers[i].clone();
+	}
+	front = ref.front;
+	road_factor = ref.road_factor.clone();
+
+	column_sums.resize(grid_size + 2);
+	for (int t = 0; t < NUM_TYPES; ++t) {
+		counts[t].resize(grid_size);
+	}
+	uniforms.resize(grid_size * 3);
+
+	return *this;
+}
+
+/**
+ * 現在のゾーンマップを返却する。
+ * paddingを除いた部分のヘッダを返すだけで、コピーはしない。
+ * 次のstep()の後は、別のバッファが現在のゾーンマップとなる。
+ */
+Mat_<uchar> CellularAutomaton::zones() {
+	return buffers[front](Rect(1, 1, grid_size, grid_size));
+}
+
+/**
+ * ゾーンマップを設定する。
+ */
+void CellularAutomaton::setZones(const Mat_<uchar>& zones) {
+	Mat_<uchar> roi = this->zones();
+	zones.copyTo(roi);
+}
+
+/**
+ * 周囲1セル分の隣接セルを含めて、ゾーンマップを設定する。
+ * タイルごとに更新する場合に、隣のタイルのセルをpaddingとして読み込むために使う。
+ *
+ * @param padded	(grid_size + 2) x (grid_size + 2)のゾーンマップ
+ */
+void CellularAutomaton::setPaddedZones(const Mat_<uchar>& padded) {
+	padded.copyTo(buffers[front]);
+}
+
+/**
+ * major道路までの距離マップから、accessibilityの項を事前に計算しておく。
+ * 道路は変化しないので、各セルの減衰関数は1回だけ計算すればよい。
+ *
+ * @param distMap		major道路までの距離 [m]
+ * @param factor		減衰係数
+ */
+void CellularAutomaton::setRoadAccessibility(const Mat_<float>& distMap, float factor) {
+	for (int r = 0; r < grid_size; ++r) {
+		for (int c = 0; c < grid_size; ++c) {
+			float attenuation = 1.0 / (1.0 + distMap(r, c) / factor);
+			road_factor(r, c) = attenuation * 0.4f;
+		}
+	}
+}
+
+/**
+ * セルオートマトンを1ステップ進める。
+ * 各セルについて、隣接8セルの各タイプの比率、major道路へのaccessibility、ニーズに基づいて、
+ * 商業地、工業地、住宅地の順に確率的に判定し、いずれでもなければ公園とする。
+ *
+ * @param needs			各ゾーンタイプのニーズ
+ * @param rng			乱数生成器
+ * @param changed [OUT]	NULLでなければ、ゾーンタイプが変化したセルのインデックス (r * grid_size + c) を追加する
+ */
+void CellularAutomaton::step(vector<float>& needs, Rng& rng, vector<int>* changed) {
+	const Mat_<uchar>& src = buffers[front];
+	Mat_<uchar>& dst = buffers[1 - front];
+
+	float logistics[NUM_TYPES];
+	for (int t = 0; t < NUM_TYPES; ++t) {
+		logistics[t] = logistic(needs[t]);
+	}
+
+	if (counting_mode == COUNT_PACKED) {
+		packed.pack(src);
+	}
+
+	for (int r = 0; r < grid_size; ++r) {
+		const uchar* num[NUM_TYPES];
+		if (counting_mode == COUNT_PACKED) {
+			countNeighborsPacked(r);
+			for (int t = 0; t < NUM_TYPES; ++t) {
+				num[t] = &packed_counts[t][1];
+			}
+		} else {
+			countNeighbors(r);
+			for (int t = 0; t < NUM_TYPES; ++t) {
+				num[t] = &counts[t][0];
+			}
+		}
+
+		// 1セルにつき3個のUniform乱数を、1行分まとめて生成する
+		rng.fillUniform(&uniforms[0], grid_size * 3);
+
+		const uchar* cur = src[r + 1] + 1;
+		uchar* next = dst[r + 1] + 1;
+		const float* road = road_factor[r];
+		const float* u = &uniforms[0];
+		const uchar* num_res = num[TYPE_RESIDENTIAL];
+		const uchar* num_com = num[TYPE_COMMERCIAL];
+		const uchar* num_ind = num[TYPE_INDUSTRIAL];
+		const uchar* num_park = num[TYPE_PARK];
+		int delta[NUM_TYPES] = { 0, 0, 0, 0 };
+
+		for (int c = 0; c < grid_size; ++c) {
+			uchar old_type = cur[c];
+			if (old_type == TYPE_UNUSED) {
+				next[c] = TYPE_UNUSED;
+				continue;
+			}
+
+			float sum = (float)(num_res[c] + num_com[c] + num_ind[c] + num_park[c]);
+
+			bool com = num_com[c] / sum * 1.6f + road[c] + logistics[TYPE_COMMERCIAL] - 1.0f >= u[c * 3];
+			bool ind = num_ind[c] / sum * 1.6f + road[c] + logistics[TYPE_INDUSTRIAL] - 1.0f >= u[c * 3 + 1];
+			bool res = num_res[c] / sum * 1.2f + road[c] + logistics[TYPE_RESIDENTIAL] - 1.0f >= u[c * 3 + 2];
+
+			uchar new_type = TYPE_PARK;
+			new_type = res ? TYPE_RESIDENTIAL : new_type;
+			new_type = ind ? TYPE_INDUSTRIAL : new_type;
+			new_type = com ? TYPE_COMMERCIAL : new_type;
+			next[c] = new_type;
+
+			if (new_type == old_type) continue;
+
+			if (changed != NULL) {
+				changed->push_back(r * grid_size + c);
+			}
+
+			// ゾーンタイプのニーズを更新
+			if (needs_mode == NEEDS_PER_CELL) {
+				needs[old_type]++;		// このセルから削除されたゾーンタイプのニーズは増加する
+				needs[new_type]--;		// このセルに使用されたゾーンタイプのニーズは減る
+				logistics[old_type] = logistic(needs[old_type]);
+				logistics[new_type] = logistic(needs[new_type]);
+			} else {
+				delta[old_type]++;
+				delta[new_type]--;
+			}
+		}
+
+		if (needs_mode == NEEDS_PER_ROW) {
+			for (int t = 0; t < NUM_TYPES; ++t) {
+				if (delta[t] == 0) continue;
+				needs[t] += delta[t];
+				logistics[t] = logistic(needs[t]);
+			}
+		}
+	}
+
+	front = 1 - front;
+}
+
+/**
+ * 指定された行の各セルについて、隣接8セルの各タイプの数を数え、countsに格納する。
+ * paddingのセルはTYPE_UNUSEDなので、数えられない。
+ *
+ * @param r		行番号 (paddingを除く)
+ */
+void CellularAutomaton::countNeighbors(int r) {
+	const Mat_<uchar>& src = buffers[front];
+	const uchar* up = src[r];
+	const uchar* mid = src[r + 1];
+	const uchar* down = src[r + 2];
+	int width = grid_size + 2;
+	uchar* sums = &column_sums[0];
+
+	for (int t = 0; t < NUM_TYPES; ++t) {
+		uchar* count = &counts[t][0];
+
+		// 列方向の3セルのうち、タイプtのセルの数
+		int c = 0;
+#ifdef CA_USE_SSE2
+		__m128i type = _mm_set1_epi8((char)t);
+		for (; c + 16 <= width; c += 16) {
+			// 一致したバイトは0xFF(=-1)になるので、引き算で数える
+			__m128i s = _mm_setzero_si128();
+			s = _mm_sub_epi8(s, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(up + c)), type));
+			s = _mm_sub_epi8(s, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(mid + c)), type));
+			s = _mm_sub_epi8(s, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(down + c)), type));
+			_mm_storeu_si128((__m128i*)(sums + c), s);
+		}
+#endif
+		for (; c < width; ++c) {
+			sums[c] = (up[c] == t) + (mid[c] == t) + (down[c] == t);
+		}
+
+		// 横に3列分を足し、中心のセル自身を引く
+		c = 0;
+#ifdef CA_USE_SSE2
+		for (; c + 16 <= grid_size; c += 16) {
+			__m128i s = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(sums + c)), _mm_loadu_si128((const __m128i*)(sums + c + 1)));
+			s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i*)(sums + c + 2)));
+			s = _mm_add_epi8(s, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(mid + c + 1)), type));
+			_mm_storeu_si128((__m128i*)(count + c), s);
+		}
+#endif
+		for (; c < grid_size; ++c) {
+			count[c] = sums[c] + sums[c + 1] + sums[c + 2] - (mid[c + 1] == t);
+		}
+	}
+}
+
+/**
+ * countNeighbors()と同じだが、step()の最初に詰めたゾーンマップから、ビットプレーンで数える。
+ * paddingも含めて詰めてあるので、paddingの列の分も含めてgrid_size + 2セル分を数え、
+ * packed_counts[t][c + 1]が、セルcの隣接セルのうちタイプtのものの数になる。
+ *
+ * @param r		行番号 (paddingを除く)
+ */
+void CellularAutomaton::countNeighborsPacked(int r) {
+	int width = grid_size + 2;
+	if (packed_work.size() != 3 * packed.wordsPerRow()) {
+		packed_work.resize(3 * packed.wordsPerRow());
+	}
+
+	uchar* rows[NUM_TYPES];
+	for (int t = 0; t < NUM_TYPES; ++t) {
+		if (packed_counts[t].size() != width) packed_counts[t].resize(width);
+		rows[t] = &packed_counts[t][0];
+	}
+
+	packed.countNeighbors(r + 1, rows, &packed_work[0]);
+}
+
+/**
+ * ニーズの項。0.8 / (1 + exp(-need))
+ */
+float CellularAutomaton::logistic(float need) {
+	return 0.8f / (1.0f + expf(-need));
+}
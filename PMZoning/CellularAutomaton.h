@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <vector>
+#include <opencv/cv.h>
+#include "Rng.h"
+#include "PackedZoneMap.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * PMZoning::update()用のセルオートマトンのカーネル。
+ * ゾーンマップは、周囲1セル分をTYPE_UNUSEDで埋めたpadding付きのバッファ2つで保持し、
+ * 1ステップごとに読み込み用と書き込み用を入れ替える。(ping-pong)
+ * タイルごとに更新する場合は、setPaddedZones()でpaddingに隣のタイルのセルを読み込む。
+ * 隣接8セルの各タイプの数は、列方向の3セルの和を1行分まとめて計算し、それを横にスライドさせて求める。
+ * COUNT_PACKEDを指定すると、各ステップの最初にゾーンマップをPackedZoneMapに詰め、ビットプレーンで数える。
+ */
+class CellularAutomaton {
+public:
+	/** ニーズの更新方法 */
+	enum {
+		NEEDS_PER_CELL = 0,		// セルごとにニーズを更新する（従来のPMZoning::update()と同じ）
+		NEEDS_PER_ROW			// 行ごとにまとめてニーズを更新する（同じ行の中では、ニーズは固定）
+	};
+
+	/** 隣接セルの数え方 */
+	enum {
+		COUNT_BYTES = 0,		// 1バイト/セルのバッファで数える (SSE2が使えれば、16セルずつ)
+		COUNT_PACKED			// PackedZoneMapのビットプレーンで、64セルずつ数える
+	};
+
+private:
+	static const int NUM_TYPES = 4;
+	static const uchar TYPE_UNUSED = 9;
+
+	int grid_size;
+	int needs_mode;
+	int counting_mode;
+	Mat_<uchar> buffers[2];		// padding付きのゾーンマップ
+	int front;					// 現在のゾーンマップのバッファ番号
+	Mat_<float> road_factor;	// major道路へのaccessibilityの項 (減衰済み)
+
+	// 1行分の作業領域
+	vector<uchar> column_sums;
+	vector<uchar> counts[NUM_TYPES];
+	vector<float> uniforms;
+
+	// COUNT_PACKED用 (paddingを含めて詰めるので、各行はgrid_size + 2セル)
+	PackedZoneMap packed;
+	vector<uchar> packed_counts[NUM_TYPES];
+	vector<quint64> packed_work;
+
+public:
+	CellularAutomaton(int grid_size);
+	CellularAutomaton(const CellularAutomaton& ref);
+	CellularAutomaton& operator=(const CellularAutomaton& ref);
+
+	Mat_<uchar> zones();
+	void setZones(const Mat_<uchar>& zones);
+	void setPaddedZones(const Mat_<uchar>& padded);
+	void setRoadAccessibility(const Mat_<float>& distMap, float factor);
+	void setNeedsMode(int mode) { needs_mode = mode; }
+	int needsMode() const { return needs_mode; }
+	void setCountingMode(int mode) { counting_mode = mode; }
+	int countingMode() const { return counting_mode; }
+	void step(vector<float>& needs, Rng& rng, vector<int>* changed = NULL);
+
+private:
+	void countNeighbors(int r);
+	void countNeighborsPacked(int r);
+	static float logistic(float need);
+};
@@ -0,0 +1,62 @@
+﻿#include "RoadSnapshotFile.h"
+#include "GraphUtil.h"
+#include "OsmImporter.h"
+#include <stdio.h>
+#include <QString>
+
+/**
+ * 道路網のファイル (.gsm)、またはOpenStreetMapのファイル (.osm、.osm.pbf) を、
+ * RoadSnapshotFileのバイナリ形式 (.rsn)、または.gsmに変換する。
+ */
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		fprintf(stderr,
+			"Usage: %s INPUT OUTPUT\n"
+			"Converts a road network to the memory-mapped binary format read by the batch tool and the GUI.\n"
+			"  INPUT   .gsm road network, or OpenStreetMap .osm / .osm.pbf file\n"
+			"  OUTPUT  .rsn binary snapshot, or .gsm road network\n",
+			argv[0]);
+		return 2;
+	}
+
+	QString input = QString::fromLocal8Bit(argv[1]);
+	QString output = QString::fromLocal8Bit(argv[2]);
+
+	RoadGraph roads;
+	if (OsmImporter::isOsmFile(input)) {
+		OsmImporter importer;
+		if (!importer.import(input, roads)) {
+			fprintf(stderr, "%s\n", importer.errorString().toUtf8().data());
+			return 1;
+		}
+	} else {
+		GraphUtil::loadRoads(roads, input);
+	}
+	if (boost::num_vertices(roads.graph) == 0) {
+		fprintf(stderr, "cannot read roads: %s\n", argv[1]);
+		return 1;
+	}
+
+	if (output.endsWith(".gsm", Qt::CaseInsensitive)) {
+		GraphUtil::saveRoads(roads, output);
+		printf("%s: %d vertices, %d edges\n", argv[2], (int)boost::num_vertices(roads.graph), (int)boost::num_edges(roads.graph));
+		return 0;
+	}
+
+	RoadSnapshot snapshot(roads);
+	QString error;
+	if (!RoadSnapshotFile::save(snapshot, output, &error)) {
+		fprintf(stderr, "%s\n", error.toUtf8().data());
+		return 1;
+	}
+
+	// 書き込んだファイルを読み直して、検証しておく
+	RoadSnapshotPtr loaded = RoadSnapshotFile::load(output, &error);
+	if (!loaded) {
+		fprintf(stderr, "%s\n", error.toUtf8().data());
+		return 1;
+	}
+
+	printf("%s: %d vertices, %d edges, %d polyline points\n", argv[2], loaded->numVertices(), loaded->numEdges(), loaded->numPolylinePoints());
+	return 0;
+}
@@ -0,0 +1,199 @@
+﻿#include "DistanceTransform.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+namespace distancetransform {
+
+namespace {
+
+/**
+ * 1行分の2乗距離の下側包絡線を計算する。(Felzenszwalb-Huttenlocher)
+ * f[c']が有限のc'だけを放物線の中心とし、d[c] = min_{c'} (c - c')^2 + f[c'] を計算する。
+ * 幅が数千を超えると、f + c^2はfloatで正確に表せないので、放物線の境界は整数の差をとってからdoubleで割る。
+ *
+ * @param f			各列の2乗距離 (NO_FEATUREは、その列に店がないことを表す)
+ * @param width		列の数
+ * @param d [OUT]	2乗距離 (整数の値を、丸めずに格納する)
+ * @param arg [OUT]	最小値を与えるc' (店がない場合はNO_FEATURE)
+ * @param v			作業領域 (放物線の中心)
+ * @param z			作業領域 (放物線の境界)
+ */
+void lowerEnvelope(const int* f, int width, double* d, int* arg, int* v, double* z) {
+	int k = -1;
+
+	for (int q = 0; q < width; ++q) {
+		if (f[q] == NO_FEATURE) continue;
+
+		double s = 0.0;
+		while (k >= 0) {
+			int p = v[k];
+			long long numerator = ((long long)f[q] + (long long)q * q) - ((long long)f[p] + (long long)p * p);
+			s = (double)numerator / (double)(2 * (q - p));
+			if (s > z[k]) break;
+			k--;
+		}
+
+		k++;
+		v[k] = q;
+		z[k] = k == 0 ? -std::numeric_limits<double>::max() : s;
+		z[k + 1] = std::numeric_limits<double>::max();
+	}
+
+	if (k < 0) {
+		for (int c = 0; c < width; ++c) {
+			d[c] = -1.0;
+			arg[c] = NO_FEATURE;
+		}
+		return;
+	}
+
+	int j = 0;
+	for (int c = 0; c < width; ++c) {
+		while (z[j + 1] < c) j++;
+		int p = v[j];
+		d[c] = (double)((long long)(c - p) * (c - p) + f[p]);
+		arg[c] = p;
+	}
+}
+
+}
+
+/**
+ * 厳密なユークリッド距離変換を計算する。
+ * 列方向に1次元の距離を求めた後、各行で放物線の下側包絡線を求める、分離可能なアルゴリズムなので、
+ * 計算量はセル数に比例する。
+ *
+ * @param data				1 - 店 / 0 - 無し
+ * @param dist [OUT]		直近の店までの距離 [セル] (店が1つもない場合は、floatの最大値)
+ * @param nearest [OUT]		NULLでなければ、直近の店の座標 (r, c) を格納する (店がない場合は(-1, -1))
+ */
+void computeEDT(const Mat_<uchar>& data, Mat_<float>& dist, Mat_<Vec2i>* nearest) {
+	Mat_<int> g;
+	Mat_<int> g_row;
+	computeColumnDistances(data, g, nearest != NULL ? &g_row : NULL);
+	computeRowDistances(g, dist, nearest != NULL ? &g_row : NULL, nearest);
+}
+
+/**
+ * 距離変換の1段目。各列について、同じ列の直近の店までの距離を求める。
+ * 列ごとに独立なので、列の一部 (縦長の帯) だけを渡してもよい。
+ * 行を順に走査しながら全列をまとめて更新し、列のブロックごとに並列化する。
+ *
+ * @param data				1 - 店 / 0 - 無し
+ * @param g [OUT]			同じ列の直近の店までの距離 [セル] (店がない場合はNO_FEATURE)
+ * @param g_row [OUT]		NULLでなければ、同じ列の直近の店の行番号を格納する
+ */
+void computeColumnDistances(const Mat_<uchar>& data, Mat_<int>& g, Mat_<int>* g_row) {
+	int height = data.rows;
+	int width = data.cols;
+
+	g.create(height, width);
+	Mat_<int> rows;
+	if (g_row != NULL) {
+		g_row->create(height, width);
+		rows = *g_row;
+	}
+
+	const int block = 256;
+	int num_blocks = (width + block - 1) / block;
+
+#pragma omp parallel for schedule(static)
+	for (int b = 0; b < num_blocks; ++b) {
+		int c0 = b * block;
+		int c1 = std::min(width, c0 + block);
+
+		// 上から下へ
+		for (int r = 0; r < height; ++r) {
+			const uchar* in = data[r];
+			int* out = g[r];
+			int* out_row = rows.empty() ? NULL : rows[r];
+			const int* prev = r > 0 ? g[r - 1] : NULL;
+			const int* prev_row = r > 0 && out_row != NULL ? rows[r - 1] : NULL;
+			for (int c = c0; c < c1; ++c) {
+				if (in[c]) {
+					out[c] = 0;
+					if (out_row != NULL) out_row[c] = r;
+				} else if (prev != NULL && prev[c] != NO_FEATURE) {
+					out[c] = prev[c] + 1;
+					if (out_row != NULL) out_row[c] = prev_row[c];
+				} else {
+					out[c] = NO_FEATURE;
+					if (out_row != NULL) out_row[c] = NO_FEATURE;
+				}
+			}
+		}
+
+		// 下から上へ
+		for (int r = height - 2; r >= 0; --r) {
+			int* out = g[r];
+			int* out_row = rows.empty() ? NULL : rows[r];
+			const int* next = g[r + 1];
+			const int* next_row = out_row != NULL ? rows[r + 1] : NULL;
+			for (int c = c0; c < c1; ++c) {
+				if (next[c] == NO_FEATURE) continue;
+				if (out[c] == NO_FEATURE || next[c] + 1 < out[c]) {
+					out[c] = next[c] + 1;
+					if (out_row != NULL) out_row[c] = next_row[c];
+				}
+			}
+		}
+	}
+}
+
+/**
+ * 距離変換の2段目。computeColumnDistancesの結果から、行方向に放物線の下側包絡線を求める。
+ * 行ごとに独立なので、行の一部 (横長の帯) だけを渡してもよい。行ごとに並列化する。
+ *
+ * @param g					computeColumnDistancesで求めた、同じ列の直近の店までの距離
+ * @param dist [OUT]		直近の店までの距離 [セル] (店が1つもない場合は、floatの最大値)
+ * @param g_row				nearestを求める場合は、computeColumnDistancesで求めた行番号
+ * @param nearest [OUT]		NULLでなければ、直近の店の座標 (r, c) を格納する (店がない場合は(-1, -1))
+ */
+void computeRowDistances(const Mat_<int>& g, Mat_<float>& dist, const Mat_<int>* g_row, Mat_<Vec2i>* nearest) {
+	int height = g.rows;
+	int width = g.cols;
+
+	dist.create(height, width);
+	if (nearest != NULL) {
+		nearest->create(height, width);
+	}
+
+#pragma omp parallel
+	{
+		std::vector<int> f(width);
+		std::vector<double> d(width);
+		std::vector<int> arg(width);
+		std::vector<int> v(width);
+		std::vector<double> z(width + 1);
+
+#pragma omp for schedule(static)
+		for (int r = 0; r < height; ++r) {
+			const int* in = g[r];
+			for (int c = 0; c < width; ++c) {
+				f[c] = in[c] == NO_FEATURE ? NO_FEATURE : in[c] * in[c];
+			}
+
+			lowerEnvelope(&f[0], width, &d[0], &arg[0], &v[0], &z[0]);
+
+			float* out = dist[r];
+			for (int c = 0; c < width; ++c) {
+				out[c] = arg[c] == NO_FEATURE ? std::numeric_limits<float>::max() : (float)sqrt(d[c]);
+			}
+
+			if (nearest != NULL) {
+				Vec2i* out_nearest = (*nearest)[r];
+				for (int c = 0; c < width; ++c) {
+					if (arg[c] == NO_FEATURE) {
+						out_nearest[c] = Vec2i(-1, -1);
+					} else {
+						out_nearest[c] = Vec2i((*g_row)(r, arg[c]), arg[c]);
+					}
+				}
+			}
+		}
+	}
+}
+
+}
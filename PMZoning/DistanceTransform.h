@@ -0,0 +1,24 @@
+﻿#pragma once
+
+#include <opencv/cv.h>
+
+using namespace cv;
+
+/**
+ * 距離マップを計算するためのバックエンド。
+ */
+namespace distancetransform {
+
+enum {
+	BACKEND_BRUSHFIRE = 0,		// ModifiedBrushFire (近似、差分更新可能)
+	BACKEND_EXACT_EDT			// Felzenszwalb-Huttenlockerの厳密なユークリッド距離変換
+};
+
+/** computeColumnDistancesで、同じ列に店がないことを表す値 */
+const int NO_FEATURE = -1;
+
+void computeEDT(const Mat_<uchar>& data, Mat_<float>& dist, Mat_<Vec2i>* nearest = NULL);
+void computeColumnDistances(const Mat_<uchar>& data, Mat_<int>& g, Mat_<int>* g_row = NULL);
+void computeRowDistances(const Mat_<int>& g, Mat_<float>& dist, const Mat_<int>* g_row = NULL, Mat_<Vec2i>* nearest = NULL);
+
+}
@@ -8,6 +8,8 @@
 #include <boost/geometry/geometries/linestring.hpp>
 #include "common.h"
 #include "Util.h"
+#include "RoadGraphIndex.h"
+#include "RoadPlanarizer.h"
 
 /**
  * Return the number of vertices.
@@ -34,11 +36,12 @@ int GraphUtil::getNumVertices(RoadGraph& roads, const QVector2D& pos, float radi
 
 	int count = 0;
 
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		if (!roads.graph[*vi]->valid) continue;
+	vector<RoadVertexDesc> candidates;
+	RoadGraphSearch(roads, pos, radius).findVertices(candidates);
+	for (int i = 0; i < candidates.size(); ++i) {
+		if (!roads.graph[candidates[i]]->valid) continue;
 
-		if ((roads.graph[*vi]->pt - pos).lengthSquared() <= radius2) {
+		if ((roads.graph[candidates[i]]->pt - pos).lengthSquared() <= radius2) {
 			count++;
 		}
 	}
@@ -102,17 +105,22 @@ RoadVertexDesc GraphUtil::getVertex(RoadGraph& roads, int index, bool onlyValidV
  */
 RoadVertexDesc GraphUtil::getVertex(RoadGraph& roads, const QVector2D& pt, bool onlyValidVertex) {
 	RoadVertexDesc nearest_desc;
-	float min_dist = std::numeric_limits<float>::max();
 
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		if (onlyValidVertex && !roads.graph[*vi]->valid) continue;
+	RoadGraphSearch search(roads, pt);
+	vector<RoadVertexDesc> candidates;
+	while (search.nextVertices(candidates)) {
+		float min_dist = std::numeric_limits<float>::max();
+		for (int i = 0; i < candidates.size(); ++i) {
+			if (onlyValidVertex && !roads.graph[candidates[i]]->valid) continue;
 
-		float dist = (roads.graph[*vi]->getPt() - pt).lengthSquared();
-		if (dist < min_dist) {
-			nearest_desc = *vi;
-			min_dist = dist;
+			float dist = (roads.graph[candidates[i]]->getPt() - pt).lengthSquared();
+			if (dist < min_dist) {
+				nearest_desc = candidates[i];
+				min_dist = dist;
+			}
 		}
+
+		if (search.covers(sqrtf(min_dist))) break;
 	}
 
 	return nearest_desc;
@@ -123,18 +131,23 @@ RoadVertexDesc GraphUtil::getVertex(RoadGraph& roads, const QVector2D& pt, bool
  */
 RoadVertexDesc GraphUtil::getVertex(RoadGraph& roads, const QVector2D& pt, RoadVertexDesc ignore, bool onlyValidVertex) {
 	RoadVertexDesc nearest_desc;
-	float min_dist = std::numeric_limits<float>::max();
 
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		if (*vi == ignore) continue;
-		if (onlyValidVertex && !roads.graph[*vi]->valid) continue;
+	RoadGraphSearch search(roads, pt);
+	vector<RoadVertexDesc> candidates;
+	while (search.nextVertices(candidates)) {
+		float min_dist = std::numeric_limits<float>::max();
+		for (int i = 0; i < candidates.size(); ++i) {
+			if (candidates[i] == ignore) continue;
+			if (onlyValidVertex && !roads.graph[candidates[i]]->valid) continue;
 
-		float dist = (roads.graph[*vi]->getPt() - pt).lengthSquared();
-		if (dist < min_dist) {
-			nearest_desc = *vi;
-			min_dist = dist;
+			float dist = (roads.graph[candidates[i]]->getPt() - pt).lengthSquared();
+			if (dist < min_dist) {
+				nearest_desc = candidates[i];
+				min_dist = dist;
+			}
 		}
+
+		if (search.covers(sqrtf(min_dist))) break;
 	}
 
 	return nearest_desc;
@@ -146,21 +159,26 @@ RoadVertexDesc GraphUtil::getVertex(RoadGraph& roads, const QVector2D& pt, RoadV
  */
 RoadVertexDesc GraphUtil::getVertex(RoadGraph& roads, const QVector2D& pt, float angle, float angle_threshold, bool onlyValidVertex) {
 	RoadVertexDesc nearest_desc;
-	float min_dist = std::numeric_limits<float>::max();
 
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		if (onlyValidVertex && !roads.graph[*vi]->valid) continue;
+	RoadGraphSearch search(roads, pt);
+	vector<RoadVertexDesc> candidates;
+	while (search.nextVertices(candidates)) {
+		float min_dist = std::numeric_limits<float>::max();
+		for (int i = 0; i < candidates.size(); ++i) {
+			if (onlyValidVertex && !roads.graph[candidates[i]]->valid) continue;
 
-		QVector2D vec = roads.graph[*vi]->getPt() - pt;
-		float angle2 = atan2f(vec.y(), vec.x());
-		if (Util::diffAngle(angle, angle2) > angle_threshold) continue;
+			QVector2D vec = roads.graph[candidates[i]]->getPt() - pt;
+			float angle2 = atan2f(vec.y(), vec.x());
+			if (Util::diffAngle(angle, angle2) > angle_threshold) continue;
 
-		float dist = vec.lengthSquared();
-		if (dist < min_dist) {
-			nearest_desc = *vi;
-			min_dist = dist;
+			float dist = vec.lengthSquared();
+			if (dist < min_dist) {
+				nearest_desc = candidates[i];
+				min_dist = dist;
+			}
 		}
+
+		if (search.covers(sqrtf(min_dist))) break;
 	}
 
 	return nearest_desc;
@@ -172,24 +190,30 @@ RoadVertexDesc GraphUtil::getVertex(RoadGraph& roads, const QVector2D& pt, float
  * また、距離がdistance_threshold未満であること。
  */
 bool GraphUtil::getVertex(RoadGraph& roads, RoadVertexDesc srcDesc, float distance_threshold, float angle, float angle_threshold, RoadVertexDesc& nearest_desc, bool onlyValidVertex) {
-	float min_dist = distance_threshold * distance_threshold;
-	bool found = false;;
+	bool found = false;
 
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		if (onlyValidVertex && !roads.graph[*vi]->valid) continue;
-		if (*vi == srcDesc) continue;
+	RoadGraphSearch search(roads, roads.graph[srcDesc]->pt, distance_threshold);
+	vector<RoadVertexDesc> candidates;
+	while (search.nextVertices(candidates)) {
+		float min_dist = distance_threshold * distance_threshold;
+		found = false;
+		for (int i = 0; i < candidates.size(); ++i) {
+			if (onlyValidVertex && !roads.graph[candidates[i]]->valid) continue;
+			if (candidates[i] == srcDesc) continue;
 
-		QVector2D vec = roads.graph[*vi]->getPt() - roads.graph[srcDesc]->pt;
-		float angle2 = atan2f(vec.y(), vec.x());
-		if (Util::diffAngle(angle, angle2) > angle_threshold) continue;
+			QVector2D vec = roads.graph[candidates[i]]->getPt() - roads.graph[srcDesc]->pt;
+			float angle2 = atan2f(vec.y(), vec.x());
+			if (Util::diffAngle(angle, angle2) > angle_threshold) continue;
 
-		float dist = vec.lengthSquared();
-		if (dist < min_dist) {
-			nearest_desc = *vi;
-			min_dist = dist;
-			found = true;
+			float dist = vec.lengthSquared();
+			if (dist < min_dist) {
+				nearest_desc = candidates[i];
+				min_dist = dist;
+				found = true;
+			}
 		}
+
+		if (found && search.covers(sqrtf(min_dist))) break;
 	}
 
 	return found;
@@ -202,15 +226,21 @@ bool GraphUtil::getVertex(RoadGraph& roads, RoadVertexDesc srcDesc, float distan
 bool GraphUtil::getVertex(RoadGraph& roads, const QVector2D& pos, float threshold, RoadVertexDesc& desc, bool onlyValidVertex) {
 	float min_dist = std::numeric_limits<float>::max();
 
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		if (onlyValidVertex && !roads.graph[*vi]->valid) continue;
+	RoadGraphSearch search(roads, pos, threshold);
+	vector<RoadVertexDesc> candidates;
+	while (search.nextVertices(candidates)) {
+		min_dist = std::numeric_limits<float>::max();
+		for (int i = 0; i < candidates.size(); ++i) {
+			if (onlyValidVertex && !roads.graph[candidates[i]]->valid) continue;
 
-		float dist = (roads.graph[*vi]->getPt() - pos).lengthSquared();
-		if (dist < min_dist) {
-			min_dist = dist;
-			desc = *vi;
+			float dist = (roads.graph[candidates[i]]->getPt() - pos).lengthSquared();
+			if (dist < min_dist) {
+				min_dist = dist;
+				desc = candidates[i];
+			}
 		}
+
+		if (search.covers(sqrtf(min_dist))) break;
 	}
 
 	if (min_dist <= threshold * threshold) return true;
@@ -232,16 +262,22 @@ bool GraphUtil::getVertex(RoadGraph& roads, RoadVertexDesc v, float threshold, R
 bool GraphUtil::getVertex(RoadGraph& roads, const QVector2D& pos, float threshold, RoadVertexDesc ignore, RoadVertexDesc& desc, bool onlyValidVertex) {
 	float min_dist = std::numeric_limits<float>::max();
 
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		if (onlyValidVertex && !roads.graph[*vi]->valid) continue;
-		if (*vi == ignore) continue;
+	RoadGraphSearch search(roads, pos, threshold);
+	vector<RoadVertexDesc> candidates;
+	while (search.nextVertices(candidates)) {
+		min_dist = std::numeric_limits<float>::max();
+		for (int i = 0; i < candidates.size(); ++i) {
+			if (onlyValidVertex && !roads.graph[candidates[i]]->valid) continue;
+			if (candidates[i] == ignore) continue;
 
-		float dist = (roads.graph[*vi]->getPt() - pos).lengthSquared();
-		if (dist < min_dist) {
-			min_dist = dist;
-			desc = *vi;
+			float dist = (roads.graph[candidates[i]]->getPt() - pos).lengthSquared();
+			if (dist < min_dist) {
+				min_dist = dist;
+				desc = candidates[i];
+			}
 		}
+
+		if (search.covers(sqrtf(min_dist))) break;
 	}
 
 	if (min_dist <= threshold * threshold) return true;
@@ -268,17 +304,23 @@ bool GraphUtil::getVertex2(RoadGraph& roads, const QVector2D& pos, float thresho
 		}
 	}
 
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		if (onlyValidVertex && !roads.graph[*vi]->valid) continue;
-		if (*vi == ignore) continue;
-		if (neighbors.contains(*vi)) continue;
+	RoadGraphSearch search(roads, pos, threshold);
+	vector<RoadVertexDesc> candidates;
+	while (search.nextVertices(candidates)) {
+		min_dist = std::numeric_limits<float>::max();
+		for (int i = 0; i < candidates.size(); ++i) {
+			if (onlyValidVertex && !roads.graph[candidates[i]]->valid) continue;
+			if (candidates[i] == ignore) continue;
+			if (neighbors.contains(candidates[i])) continue;
 
-		float dist = (roads.graph[*vi]->getPt() - pos).lengthSquared();
-		if (dist < min_dist) {
-			min_dist = dist;
-			desc = *vi;
+			float dist = (roads.graph[candidates[i]]->getPt() - pos).lengthSquared();
+			if (dist < min_dist) {
+				min_dist = dist;
+				desc = candidates[i];
+			}
 		}
+
+		if (search.covers(sqrtf(min_dist))) break;
 	}
 
 	if (min_dist <= threshold * threshold) return true;
@@ -291,20 +333,26 @@ bool GraphUtil::getVertex2(RoadGraph& roads, const QVector2D& pos, float thresho
  */
 bool GraphUtil::getVertexInArea(RoadGraph &roads, const QVector2D &pos, const BBox &area, RoadVertexDesc &desc) {
 	bool found = false;
-	float min_dist = std::numeric_limits<float>::max();
 
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		if (!roads.graph[*vi]->valid) continue;
+	RoadGraphSearch search(roads, pos);
+	vector<RoadVertexDesc> candidates;
+	while (search.nextVertices(candidates)) {
+		float min_dist = std::numeric_limits<float>::max();
+		found = false;
+		for (int i = 0; i < candidates.size(); ++i) {
+			if (!roads.graph[candidates[i]]->valid) continue;
 
-		if (!area.contains(pos)) continue;
+			if (!area.contains(roads.graph[candidates[i]]->pt)) continue;
 
-		float dist = (roads.graph[*vi]->pt - pos).lengthSquared();
-		if (dist < min_dist) {
-			min_dist = dist;
-			desc = *vi;
-			found = true;
+			float dist = (roads.graph[candidates[i]]->pt - pos).lengthSquared();
+			if (dist < min_dist) {
+				min_dist = dist;
+				desc = candidates[i];
+				found = true;
+			}
 		}
+
+		if (found && search.covers(sqrtf(min_dist))) break;
 	}
 
 	return found;
@@ -392,7 +440,7 @@ void GraphUtil::removeIsolatedVertices(RoadGraph& roads, bool onlyValidVertex) {
 		if (onlyValidVertex && !roads.graph[*vi]->valid) continue;
 
 		if (getDegree(roads, *vi, onlyValidVertex) == 0) {
-			roads.graph[*vi]->valid = false;
+			roads.invalidateVertex(*vi);
 		}
 	}
 }
@@ -408,7 +456,7 @@ void GraphUtil::removeLoop(RoadGraph& roads) {
 		RoadVertexDesc src = boost::source(*ei, roads.graph);
 		RoadVertexDesc tgt = boost::target(*ei, roads.graph);
 		if (src == tgt) {
-			roads.graph[*ei]->valid = false;
+			roads.invalidateEdge(*ei);
 		}
 	}
 
@@ -428,7 +476,7 @@ void GraphUtil::snapVertex(RoadGraph& roads, RoadVertexDesc v1, RoadVertexDesc v
 
 		// if the edge is too short, remove it. (This might be contraversial...)
 		if (roads.graph[e]->getLength() < 1.0f) {
-			roads.graph[e]->valid = false;
+			roads.invalidateEdge(e);
 		}
 	}
 
@@ -443,7 +491,7 @@ void GraphUtil::snapVertex(RoadGraph& roads, RoadVertexDesc v1, RoadVertexDesc v
 		RoadEdgePtr new_edge = RoadEdgePtr(new RoadEdge(*roads.graph[*ei]));
 
 		// invalidate the old edge
-		roads.graph[*ei]->valid = false;
+		roads.invalidateEdge(*ei);
 
 		if (v1b == v2) continue;
 		if (hasEdge(roads, v2, v1b)) continue;
@@ -457,7 +505,7 @@ void GraphUtil::snapVertex(RoadGraph& roads, RoadVertexDesc v1, RoadVertexDesc v
 	}
 
 	// invalidate v1
-	roads.graph[v1]->valid = false;
+	roads.invalidateVertex(v1);
 
 	roads.setModified();
 }
@@ -471,20 +519,7 @@ RoadVertexDesc GraphUtil::getCentralVertex(RoadGraph& roads) {
 }
 
 float GraphUtil::getDensity(RoadGraph& roads, const QVector2D& pos, float radius) {
-	float radius2 = radius * radius;
-
-	int count = 0;
-
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
-		if (!roads.graph[*vi]->valid) continue;
-
-		if ((roads.graph[*vi]->pt - pos).lengthSquared() <= radius2) {
-			count++;
-		}
-	}
-
-	return (float)count / radius2 / M_PI;
+	return (float)getNumVertices(roads, pos, radius) / (radius * radius) / M_PI;
 }
 
 /**
@@ -601,17 +636,23 @@ RoadEdgeDesc GraphUtil::findNearestEdge(RoadGraph& roads, const QVector2D& pt, i
 	dist = std::numeric_limits<float>::max();
 	RoadEdgeDesc min_e;
 
-	RoadEdgeIter ei, eend;
-	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
-		if (!roads.graph[*ei]->valid) continue;
-		if (roadType != 0 && !(roads.graph[*ei]->type & roadType)) continue;
-
-		QVector2D closestPt;
-		float d = distance(roads, pt, *ei, closestPt);
-		if (d < dist) {
-			dist = d;
-			min_e = *ei;
+	RoadGraphSearch search(roads, pt);
+	vector<RoadEdgeDesc> candidates;
+	while (search.nextEdges(candidates)) {
+		dist = std::numeric_limits<float>::max();
+		for (int i = 0; i < candidates.size(); ++i) {
+			if (!roads.graph[candidates[i]]->valid) continue;
+			if (roadType != 0 && !(roads.graph[candidates[i]]->type & roadType)) continue;
+
+			QVector2D closestPt;
+			float d = distance(roads, pt, candidates[i], closestPt);
+			if (d < dist) {
+				dist = d;
+				min_e = candidates[i];
+			}
 		}
+
+		if (search.covers(dist)) break;
 	}
 
 	return min_e;
@@ -642,7 +683,7 @@ float GraphUtil::getTotalEdgeLength(RoadGraph& roads, RoadVertexDesc v) {
 	if (v1 == v2) return;
 
 	// invalidate the edge
-	roads->graph[e]->valid = false;
+	roads->invalidateEdge(e);
 
 	if (getDegree(roads, v1) < getDegree(roads, v2)) {
 		snapVertex(roads, v1, v2);
@@ -1035,11 +1076,11 @@ bool GraphUtil::removeDeadEnd(RoadGraph& roads) {
 				// invalidate all the outing edges.
 				RoadOutEdgeIter ei, eend;
 				for (boost::tie(ei, eend) = boost::out_edges(*vi, roads.graph); ei != eend; ++ei) {
-					roads.graph[*ei]->valid = false;
+					roads.invalidateEdge(*ei);
 				}
 
 				// invalidate the vertex as well.
-				roads.graph[*vi]->valid = false;
+				roads.invalidateVertex(*vi);
 
 				removedOne = true;
 				removed = true;
@@ -1067,9 +1108,9 @@ void GraphUtil::removeIsolatedEdges(RoadGraph& roads, bool onlyValidEdge) {
 		RoadVertexDesc tgt = boost::target(*ei, roads.graph);
 
 		if (getDegree(roads, src, onlyValidEdge) == 1 && getDegree(roads, tgt, onlyValidEdge) == 1) {
-			roads.graph[*ei]->valid = false;
-			roads.graph[src]->valid = false;
-			roads.graph[tgt]->valid = false;
+			roads.invalidateEdge(*ei);
+			roads.invalidateVertex(src);
+			roads.invalidateVertex(tgt);
 		}
 	}
 
@@ -1183,7 +1224,7 @@ RoadVertexDesc GraphUtil::splitEdge(RoadGraph &roads, RoadEdgeDesc edge_desc, co
 	}
 
 	// remove the original edge
-	roads.graph[edge_desc]->valid = false;
+	roads.invalidateEdge(edge_desc);
 
 	return v_desc;
 }
@@ -1391,7 +1432,7 @@ void GraphUtil::removeShortEdges(RoadGraph& roads, float threshold) {
 		if (!roads.graph[*ei]->valid) continue;
 
 		if (roads.graph[*ei]->getLength() <= threshold) {
-			roads.graph[*ei]->valid = false;
+			roads.invalidateEdge(*ei);
 		}
 	}
 
@@ -1404,7 +1445,7 @@ void GraphUtil::removeShortEdges(RoadGraph& roads, float threshold) {
 void GraphUtil::removeLinkEdges(RoadGraph& roads) {
 	RoadEdgeIter ei, eend;
 	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
-		if (roads.graph[*ei]->link) roads.graph[*ei]->valid = false;
+		if (roads.graph[*ei]->link) roads.invalidateEdge(*ei);
 	}
 }
 
@@ -1612,9 +1653,9 @@ RoadVertexDesc GraphUtil::cutoffEdge(RoadGraph &roads, RoadEdgeDesc edge, RoadVe
 	RoadVertexDesc v = splitEdge(roads, edge, pt, e1, e2);
 
 	if ((polyline[0] - roads.graph[v_desc]->pt).lengthSquared() <= (polyline.back() - roads.graph[v_desc]->pt).lengthSquared()) {
-		roads.graph[e2]->valid = false;
+		roads.invalidateEdge(e2);
 	} else {
-		roads.graph[e1]->valid = false;
+		roads.invalidateEdge(e1);
 	}
 
 	return v;
@@ -1714,6 +1755,7 @@ void GraphUtil::loadRoads(RoadGraph& roads, const QString& filename, int roadTyp
 	roads.clear();
 
 	FILE* fp = fopen(filename.toUtf8().data(), "rb");
+	if (fp == NULL) return;
 
 	QMap<uint, RoadVertexDesc> idToDesc;
 
@@ -1723,10 +1765,11 @@ void GraphUtil::loadRoads(RoadGraph& roads, const QString& filename, int roadTyp
 
 	// Read each vertex's information: desc, x, and y.
 	for (int i = 0; i < nVertices; i++) {
-		RoadVertexDesc id;
+		// IDは、32bitで保存されている (64bit環境では、RoadVertexDescは8バイトなので注意)
+		unsigned int id;
 		float x, y;
 		unsigned int onBoundary;
-		fread(&id, sizeof(RoadVertexDesc), 1, fp);
+		fread(&id, sizeof(unsigned int), 1, fp);
 		fread(&x, sizeof(float), 1, fp);
 		fread(&y, sizeof(float), 1, fp);
 		fread(&onBoundary, sizeof(unsigned int), 1, fp);
@@ -1747,9 +1790,9 @@ void GraphUtil::loadRoads(RoadGraph& roads, const QString& filename, int roadTyp
 	// Read each edge's information: the descs of two vertices, road type, the number of lanes, the number of points along the polyline, and the coordinate of each point along the polyline.
 	for (int i = 0; i < nEdges; i++) {
 		unsigned int type, lanes, oneWay, link, roundabout;
-		RoadVertexDesc id1, id2;
-		fread(&id1, sizeof(RoadVertexDesc), 1, fp);
-		fread(&id2, sizeof(RoadVertexDesc), 1, fp);
+		unsigned int id1, id2;
+		fread(&id1, sizeof(unsigned int), 1, fp);
+		fread(&id2, sizeof(unsigned int), 1, fp);
 
 		RoadVertexDesc src = idToDesc[id1];
 		RoadVertexDesc tgt = idToDesc[id2];
@@ -1794,6 +1837,7 @@ void GraphUtil::loadRoads(RoadGraph& roads, const QString& filename, int roadTyp
  */
 void GraphUtil::saveRoads(RoadGraph& roads, const QString& filename) {
 	FILE* fp = fopen(filename.toUtf8().data(), "wb");
+	if (fp == NULL) return;
 	
 	int nVertices = getNumVertices(roads);//boost::num_vertices(roads.graph);
 	fwrite(&nVertices, sizeof(int), 1, fp);
@@ -1813,7 +1857,7 @@ void GraphUtil::saveRoads(RoadGraph& roads, const QString& filename) {
 		RoadVertexDesc desc = *vi;
 		float x = v->getPt().x();
 		float y = v->getPt().y();
-		fwrite(&cnt, sizeof(RoadVertexDesc), 1, fp);
+		fwrite(&cnt, sizeof(unsigned int), 1, fp);
 		fwrite(&x, sizeof(float), 1, fp);
 		fwrite(&y, sizeof(float), 1, fp);
 
@@ -1854,8 +1898,10 @@ void GraphUtil::saveRoads(RoadGraph& roads, const QString& filename) {
 
 		if (!conv.contains(src) || !conv.contains(tgt)) continue;
 
-		fwrite(&conv[src], sizeof(RoadVertexDesc), 1, fp);
-		fwrite(&conv[tgt], sizeof(RoadVertexDesc), 1, fp);
+		unsigned int id1 = conv[src];
+		unsigned int id2 = conv[tgt];
+		fwrite(&id1, sizeof(unsigned int), 1, fp);
+		fwrite(&id2, sizeof(unsigned int), 1, fp);
 		
 		unsigned int type = edge->type;
 		fwrite(&type, sizeof(unsigned int), 1, fp);
@@ -1907,18 +1953,20 @@ void GraphUtil::saveRoads(RoadGraph& roads, const QString& filename) {
 /**
  * Copy the road graph.
  * Note: This function copies all the vertices and edges including the invalid ones. Thus, their IDs will be preserved.
+ * The invalid ones are marked through invalidateVertex() / invalidateEdge(), so that the copy counts them for compactIfNeeded().
  */
 void GraphUtil::copyRoads(const RoadGraph& srcRoads, RoadGraph& dstRoads) {
 	dstRoads.clear();
 
-	QMap<RoadVertexDesc, RoadVertexDesc> conv;
+	std::vector<RoadVertexDesc> conv(boost::num_vertices(srcRoads.graph));
 	RoadVertexIter vi, vend;
 	for (boost::tie(vi, vend) = boost::vertices(srcRoads.graph); vi != vend; ++vi) {
 		// Add a vertex
 		RoadVertexPtr new_v = RoadVertexPtr(new RoadVertex(*srcRoads.graph[*vi]));
-		new_v->valid = srcRoads.graph[*vi]->valid;
+		new_v->valid = true;
 		RoadVertexDesc new_v_desc = boost::add_vertex(dstRoads.graph);
 		dstRoads.graph[new_v_desc] = new_v;
+		if (!srcRoads.graph[*vi]->valid) dstRoads.invalidateVertex(new_v_desc);
 
 		conv[*vi] = new_v_desc;
 	}
@@ -1933,8 +1981,10 @@ void GraphUtil::copyRoads(const RoadGraph& srcRoads, RoadGraph& dstRoads) {
 
 		// Add an edge
 		RoadEdgePtr new_e = RoadEdgePtr(new RoadEdge(*srcRoads.graph[*ei]));
+		new_e->valid = true;
 		std::pair<RoadEdgeDesc, bool> edge_pair = boost::add_edge(new_src, new_tgt, dstRoads.graph);
 		dstRoads.graph[edge_pair.first] = new_e;
+		if (!srcRoads.graph[*ei]->valid) dstRoads.invalidateEdge(edge_pair.first);
 	}
 
 	dstRoads.setModified();
@@ -2042,7 +2092,7 @@ void GraphUtil::extractRoads(RoadGraph& roads, int roadType) {
 		if (!roads.graph[*ei]->valid) continue;
 
 		if (!isRoadTypeMatched(roads.graph[*ei]->type, roadType)) {
-			roads.graph[*ei]->valid = false;
+			roads.invalidateEdge(*ei);
 		}
 	}
 
@@ -2068,16 +2118,16 @@ void GraphUtil::extractRoads(RoadGraph& roads, Polygon2D& area, bool strict, int
 			if (strict) {
 				// if either vertice is out of the range, invalidate this edge.
 				if (!area.contains(roads.graph[src]->pt) || !area.contains(roads.graph[tgt]->pt)) {
-					roads.graph[*ei]->valid = false;
+					roads.invalidateEdge(*ei);
 				}
 			} else {
 				// if both the vertices is out of the range, invalidate this edge.
 				if (!area.contains(roads.graph[src]->pt) && !area.contains(roads.graph[tgt]->pt)) {
-					roads.graph[*ei]->valid = false;
+					roads.invalidateEdge(*ei);
 				}
 			}
 		} else {
-			roads.graph[*ei]->valid = false;
+			roads.invalidateEdge(*ei);
 		}
 	}
 
@@ -2102,12 +2152,12 @@ void GraphUtil::extractRoads2(RoadGraph& roads, const Polygon2D& area, int roadT
 
 		if (isRoadTypeMatched(roads.graph[*ei]->type, roadType)) {
 			if (!area.contains(roads.graph[src]->pt) && !area.contains(roads.graph[tgt]->pt)) {
-				roads.graph[*ei]->valid = false;
+				roads.invalidateEdge(*ei);
 			} else if (!area.contains(roads.graph[src]->pt) || !area.contains(roads.graph[tgt]->pt)) {
 				edges.push_back(*ei);
 			}
 		} else {
-			roads.graph[*ei]->valid = false;
+			roads.invalidateEdge(*ei);
 		}
 	}
 
@@ -2141,20 +2191,21 @@ void GraphUtil::extractRoads2(RoadGraph& roads, const Polygon2D& area, int roadT
 
 		if ((polyline[0] - roads.graph[src]->pt).lengthSquared() <= (polyline[0] - roads.graph[tgt]->pt).lengthSquared()) {
 			if (area.contains(roads.graph[src]->pt)) {
-				roads.graph[e2]->valid = false;
+				roads.invalidateEdge(e2);
 			} else {
-				roads.graph[e1]->valid = false;
+				roads.invalidateEdge(e1);
 			}
 		} else {
 			if (area.contains(roads.graph[src]->pt)) {
-				roads.graph[e1]->valid = false;
+				roads.invalidateEdge(e1);
 			} else {
-				roads.graph[e2]->valid = false;
+				roads.invalidateEdge(e2);
 			}
 		}
 	}
 
 	removeIsolatedVertices(roads);
+	roads.compactIfNeeded();
 
 	roads.setModified();
 }
@@ -2175,7 +2226,7 @@ void GraphUtil::trim(RoadGraph& roads, const Polygon2D& area) {
 		RoadVertexDesc tgt = boost::target(*ei, roads.graph);
 
 		if (!area.contains(roads.graph[src]->pt) && !area.contains(roads.graph[tgt]->pt)) {
-			roads.graph[*ei]->valid = false;
+			roads.invalidateEdge(*ei);
 		} else if (!area.contains(roads.graph[src]->pt) || !area.contains(roads.graph[tgt]->pt)) {
 			edges.push_back(*ei);
 		} else {
@@ -2233,7 +2284,7 @@ void GraphUtil::trim(RoadGraph& roads, const Polygon2D& area) {
 			}
 			RoadVertexDesc v = cutoffEdge(roads, edges[e_id], src, intPt);
 			roads.graph[v]->onBoundary = true;
-			roads.graph[tgt]->valid = false;
+			roads.invalidateVertex(tgt);
 		} else {
 			QVector2D intPt;
 			{
@@ -2248,7 +2299,7 @@ void GraphUtil::trim(RoadGraph& roads, const Polygon2D& area) {
 			}
 			RoadVertexDesc v = cutoffEdge(roads, edges[e_id], tgt, intPt);
 			roads.graph[v]->onBoundary = true;
-			roads.graph[src]->valid = false;
+			roads.invalidateVertex(src);
 		}
 	}
 
@@ -2273,12 +2324,12 @@ void GraphUtil::subtractRoads(RoadGraph& roads, Polygon2D& area, bool strict) {
 		if (strict) {
 			// if both the vertices is within the range, invalidate this edge.
 			if (area.contains(roads.graph[src]->pt) && area.contains(roads.graph[tgt]->pt)) {
-				roads.graph[*ei]->valid = false;
+				roads.invalidateEdge(*ei);
 			}
 		} else {
 			// if either vertice is within the range, invalidate this edge.
 			if (area.contains(roads.graph[src]->pt) || area.contains(roads.graph[tgt]->pt)) {
-				roads.graph[*ei]->valid = false;
+				roads.invalidateEdge(*ei);
 			}
 		}
 	}
@@ -2303,7 +2354,7 @@ void GraphUtil::subtractRoads2(RoadGraph& roads, Polygon2D& area) {
 		RoadVertexDesc tgt = boost::target(*ei, roads.graph);
 		
 		if (area.contains(roads.graph[src]->pt) && area.contains(roads.graph[tgt]->pt)) {
-			roads.graph[*ei]->valid = false;
+			roads.invalidateEdge(*ei);
 		} else if (area.contains(roads.graph[src]->pt) || area.contains(roads.graph[tgt]->pt)) {
 			edges.push_back(*ei);
 		}
@@ -2335,10 +2386,10 @@ void GraphUtil::subtractRoads2(RoadGraph& roads, Polygon2D& area) {
 		RoadVertexDesc v = splitEdge(roads, edges[e_id], intPt);
 		if (area.contains(roads.graph[src]->pt)) {
 			RoadEdgeDesc e = getEdge(roads, v, src);
-			roads.graph[e]->valid = false;
+			roads.invalidateEdge(e);
 		} else {
 			RoadEdgeDesc e = getEdge(roads, v, tgt);
-			roads.graph[e]->valid = false;
+			roads.invalidateEdge(e);
 		}
 	}
 
@@ -2406,9 +2457,9 @@ void GraphUtil::removeSelfIntersectingRoads(RoadGraph &roads) {
 				RoadEdgeDesc toBeRemoved;
 
 				if (roads.graph[*ei]->type >= roads.graph[*ei2]->type) {
-					roads.graph[*ei2]->valid = false;
+					roads.invalidateEdge(*ei2);
 				} else {
-					roads.graph[*ei]->valid = false;
+					roads.invalidateEdge(*ei);
 				}
 			}
 		}
@@ -2558,22 +2609,25 @@ bool GraphUtil::getEdge(RoadGraph &roads, const QVector2D &pt, float threshold,
 	float min_dist = std::numeric_limits<float>::max();
 	RoadEdgeDesc min_e;
 
-	RoadEdgeIter ei, eend;
-	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
-		if (onlyValidEdge && !roads.graph[*ei]->valid) continue;
+	// threshold以上離れたエッジは結果に影響しないので、thresholdの範囲の候補だけを調べる
+	vector<RoadEdgeDesc> candidates;
+	RoadGraphSearch(roads, pt, threshold).findEdges(candidates);
+	for (int k = 0; k < candidates.size(); ++k) {
+		RoadEdgeDesc ei = candidates[k];
+		if (onlyValidEdge && !roads.graph[ei]->valid) continue;
 
-		RoadVertexPtr src = roads.graph[boost::source(*ei, roads.graph)];
-		RoadVertexPtr tgt = roads.graph[boost::target(*ei, roads.graph)];
+		RoadVertexPtr src = roads.graph[boost::source(ei, roads.graph)];
+		RoadVertexPtr tgt = roads.graph[boost::target(ei, roads.graph)];
 
 		if (onlyValidEdge && !src->valid) continue;
 		if (onlyValidEdge && !tgt->valid) continue;
 
 		QVector2D pt2;
-		for (int i = 0; i < roads.graph[*ei]->polyline.size() - 1; i++) {
-			float dist = Util::pointSegmentDistanceXY(roads.graph[*ei]->polyline[i], roads.graph[*ei]->polyline[i + 1], pt, pt2);
+		for (int i = 0; i < roads.graph[ei]->polyline.size() - 1; i++) {
+			float dist = Util::pointSegmentDistanceXY(roads.graph[ei]->polyline[i], roads.graph[ei]->polyline[i + 1], pt, pt2);
 			if (dist < min_dist) {
 				min_dist = dist;
-				e = *ei;
+				e = ei;
 			}
 		}
 	}
@@ -2590,12 +2644,14 @@ bool GraphUtil::getEdge(RoadGraph &roads, const QVector2D &pt, float threshold,
 	float min_dist = std::numeric_limits<float>::max();
 	RoadEdgeDesc min_e;
 
-	RoadEdgeIter ei, eend;
-	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
-		if (onlyValidEdge && !roads.graph[*ei]->valid) continue;
+	vector<RoadEdgeDesc> candidates;
+	RoadGraphSearch(roads, pt, threshold).findEdges(candidates);
+	for (int k = 0; k < candidates.size(); ++k) {
+		RoadEdgeDesc ei = candidates[k];
+		if (onlyValidEdge && !roads.graph[ei]->valid) continue;
 
-		RoadVertexDesc src = boost::source(*ei, roads.graph);
-		RoadVertexDesc tgt = boost::target(*ei, roads.graph);
+		RoadVertexDesc src = boost::source(ei, roads.graph);
+		RoadVertexDesc tgt = boost::target(ei, roads.graph);
 
 		if (onlyValidEdge && !roads.graph[src]->valid) continue;
 		if (onlyValidEdge && !roads.graph[tgt]->valid) continue;
@@ -2603,11 +2659,11 @@ bool GraphUtil::getEdge(RoadGraph &roads, const QVector2D &pt, float threshold,
 		if (src == srcDesc || tgt == srcDesc) continue;
 
 		QVector2D pt2;
-		for (int i = 0; i < roads.graph[*ei]->polyline.size() - 1; i++) {
-			float dist = Util::pointSegmentDistanceXY(roads.graph[*ei]->polyline[i], roads.graph[*ei]->polyline[i + 1], pt, pt2);
+		for (int i = 0; i < roads.graph[ei]->polyline.size() - 1; i++) {
+			float dist = Util::pointSegmentDistanceXY(roads.graph[ei]->polyline[i], roads.graph[ei]->polyline[i + 1], pt, pt2);
 			if (dist < min_dist) {
 				min_dist = dist;
-				e = *ei;
+				e = ei;
 				closestPt = pt2;
 			}
 		}
@@ -2624,12 +2680,14 @@ bool GraphUtil::getEdge(RoadGraph& roads, RoadVertexDesc v, float threshold, Roa
 	float min_dist = std::numeric_limits<float>::max();
 	RoadEdgeDesc min_e;
 
-	RoadEdgeIter ei, eend;
-	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
-		if (onlyValidEdge && !roads.graph[*ei]->valid) continue;
+	vector<RoadEdgeDesc> candidates;
+	RoadGraphSearch(roads, roads.graph[v]->pt, threshold).findEdges(candidates);
+	for (int k = 0; k < candidates.size(); ++k) {
+		RoadEdgeDesc ei = candidates[k];
+		if (onlyValidEdge && !roads.graph[ei]->valid) continue;
 
-		RoadVertexDesc src = boost::source(*ei, roads.graph);
-		RoadVertexDesc tgt = boost::target(*ei, roads.graph);
+		RoadVertexDesc src = boost::source(ei, roads.graph);
+		RoadVertexDesc tgt = boost::target(ei, roads.graph);
 
 		if (onlyValidEdge && !roads.graph[src]->valid) continue;
 		if (onlyValidEdge && !roads.graph[tgt]->valid) continue;
@@ -2638,11 +2696,11 @@ bool GraphUtil::getEdge(RoadGraph& roads, RoadVertexDesc v, float threshold, Roa
 		if (src == v || tgt == v) continue;
 
 		QVector2D pt2;
-		for (int i = 0; i < roads.graph[*ei]->polyline.size() - 1; i++) {
-			float dist = Util::pointSegmentDistanceXY(roads.graph[*ei]->polyline[i], roads.graph[*ei]->polyline[i + 1], roads.graph[v]->pt, pt2);
+		for (int i = 0; i < roads.graph[ei]->polyline.size() - 1; i++) {
+			float dist = Util::pointSegmentDistanceXY(roads.graph[ei]->polyline[i], roads.graph[ei]->polyline[i + 1], roads.graph[v]->pt, pt2);
 			if (dist < min_dist) {
 				min_dist = dist;
-				e = *ei;
+				e = ei;
 				closestPt = pt2;
 			}
 		}
@@ -2657,31 +2715,36 @@ bool GraphUtil::getEdge(RoadGraph& roads, RoadVertexDesc v, float threshold, Roa
  * ただし、指定された頂点に隣接するエッジは、対象外とする。
  */
 RoadEdgeDesc GraphUtil::getEdge(RoadGraph& roads, RoadVertexDesc v, QVector2D &closestPt, bool onlyValidEdge) {
-	float min_dist = std::numeric_limits<float>::max();
 	RoadEdgeDesc min_e;
 
-	RoadEdgeIter ei, eend;
-	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
-		if (onlyValidEdge && !roads.graph[*ei]->valid) continue;
+	RoadGraphSearch search(roads, roads.graph[v]->pt);
+	vector<RoadEdgeDesc> candidates;
+	while (search.nextEdges(candidates)) {
+		float min_dist = std::numeric_limits<float>::max();
+		for (int i = 0; i < candidates.size(); ++i) {
+			if (onlyValidEdge && !roads.graph[candidates[i]]->valid) continue;
 
-		RoadVertexDesc src = boost::source(*ei, roads.graph);
-		RoadVertexDesc tgt = boost::target(*ei, roads.graph);
-		if (v == src || v == tgt) continue;
+			RoadVertexDesc src = boost::source(candidates[i], roads.graph);
+			RoadVertexDesc tgt = boost::target(candidates[i], roads.graph);
+			if (v == src || v == tgt) continue;
 
-		// 長さ0のエッジは、無視する。(何らかのバグの可能性で生成された可能性が高い。)
-		if (roads.graph[*ei]->getLength() <= 0.1f) continue;
+			// 長さ0のエッジは、無視する。(何らかのバグの可能性で生成された可能性が高い。)
+			if (roads.graph[candidates[i]]->getLength() <= 0.1f) continue;
 
-		// ループエッジにスナップさせない方が良いかなと思って。少し議論の余地があるかも
-		if (src == tgt) continue;
+			// ループエッジにスナップさせない方が良いかなと思って。少し議論の余地があるかも
+			if (src == tgt) continue;
 
-		QVector2D pt2;
-		float d = distance(roads, roads.graph[v]->pt, *ei, pt2);
+			QVector2D pt2;
+			float d = distance(roads, roads.graph[v]->pt, candidates[i], pt2);
 
-		if (d < min_dist) {
-			min_dist = d;
-			min_e = *ei;
-			closestPt = pt2;
+			if (d < min_dist) {
+				min_dist = d;
+				min_e = candidates[i];
+				closestPt = pt2;
+			}
 		}
+
+		if (search.covers(min_dist)) break;
 	}
 
 	return min_e;
@@ -2691,42 +2754,10 @@ RoadEdgeDesc GraphUtil::getEdge(RoadGraph& roads, RoadVertexDesc v, QVector2D &c
  * Clean the road graph by removing all the invalid vertices and edges.
  */
 void GraphUtil::clean(RoadGraph& roads) {
-	RoadGraph temp;
-	GraphUtil::copyRoads(roads, temp);
-
-	roads.clear();
-
-	removeIsolatedVertices(temp);
-
-	QMap<RoadVertexDesc, RoadVertexDesc> conv;
-	RoadVertexIter vi, vend;
-	for (boost::tie(vi, vend) = boost::vertices(temp.graph); vi != vend; ++vi) {
-		if (!temp.graph[*vi]->valid) continue;
-
-		// Add a vertex
-		RoadVertexPtr new_v = RoadVertexPtr(new RoadVertex(*temp.graph[*vi]));
-		RoadVertexDesc new_v_desc = boost::add_vertex(roads.graph);
-		roads.graph[new_v_desc] = new_v;
-
-		conv[*vi] = new_v_desc;
-	}
-
-	RoadEdgeIter ei, eend;
-	for (boost::tie(ei, eend) = boost::edges(temp.graph); ei != eend; ++ei) {
-		if (!temp.graph[*ei]->valid) continue;
-
-		RoadVertexDesc src = boost::source(*ei, temp.graph);
-		RoadVertexDesc tgt = boost::target(*ei, temp.graph);
-
-		RoadVertexDesc new_src = conv[src];
-		RoadVertexDesc new_tgt = conv[tgt];
-
-		// Add an edge
-		RoadEdgePtr new_e = RoadEdgePtr(new RoadEdge(*temp.graph[*ei]));
-		std::pair<RoadEdgeDesc, bool> edge_pair = boost::add_edge(new_src, new_tgt, roads.graph);
-		roads.graph[edge_pair.first] = new_e;
-	}
+	removeIsolatedVertices(roads);
 
+	// 頂点・エッジをコピーせずに、その場で詰める
+	roads.compact();
 	roads.setModified();
 }
 
@@ -2750,6 +2781,9 @@ void GraphUtil::reduce(RoadGraph& roads) {
 				if (reduce(roads, *vi)) {
 					deleted = true;
 					actuallReduced = true;
+
+					// 頂点の走査は最初からやり直すので、ここで詰めてもよい
+					roads.compactIfNeeded();
 					break;
 				}
 			}
@@ -2805,11 +2839,11 @@ bool GraphUtil::reduce(RoadGraph& roads, RoadVertexDesc desc) {
 	roads.graph[edge_pair.first] = new_edge;
 
 	// invalidate the old edge
-	roads.graph[ed[0]]->valid = false;
-	roads.graph[ed[1]]->valid = false;
+	roads.invalidateEdge(ed[0]);
+	roads.invalidateEdge(ed[1]);
 
 	// invalidate the vertex
-	roads.graph[desc]->valid = false;
+	roads.invalidateVertex(desc);
 
 	return true;
 }
@@ -2857,7 +2891,7 @@ void GraphUtil::simplify(RoadGraph& roads, float dist_threshold) {
 			RoadVertexDesc tgt = boost::target(e, roads.graph);
 
 			// invalidate the edge
-			roads.graph[e]->valid = false;
+			roads.invalidateEdge(e);
 
 			// update the edge
 			if (!GraphUtil::hasEdge(roads, src, *vi)) {
@@ -3128,7 +3162,7 @@ void GraphUtil::normalize(RoadGraph& roads) {
 		if (roads.graph[*ei]->polyline.size() <= 2) continue;
 
 		// invalidate the edge
-		roads.graph[*ei]->valid = false;
+		roads.invalidateEdge(*ei);
 
 		RoadVertexDesc src = boost::source(*ei, roads.graph);
 		RoadVertexDesc tgt = boost::target(*ei, roads.graph);
@@ -3169,7 +3203,7 @@ void GraphUtil::normalize(RoadGraph& roads, float step_size) {
 
 	RoadEdgeIter ei, eend;
 	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
-		roads.graph[*ei]->valid = false;
+		roads.invalidateEdge(*ei);
 	}
 	
 	for (boost::tie(ei, eend) = boost::edges(temp.graph); ei != eend; ++ei) {
@@ -3288,13 +3322,12 @@ void GraphUtil::singlify(RoadGraph& roads) {
 
 /**
  * Convert the road graph to a planar graph.
+ * 全ての交差をグリッドを使って一度に見つけ、まとめて分割する。(RoadPlanarizer参照)
  */
 void GraphUtil::planarify(RoadGraph& roads) {
-	bool split = true;
-
-	while (split) {
-		split = planarifyOne(roads);
-	}
+	RoadPlanarizer planarizer(roads);
+	planarizer.planarify();
+	roads.compactIfNeeded();
 }
 
 /**
@@ -3341,8 +3374,8 @@ bool GraphUtil::planarifyOne(RoadGraph& roads) {
 						//roads.graph[new_v_desc] = new_v;
 
 						// もともとのエッジを無効にする
-						roads.graph[*ei]->valid = false;
-						roads.graph[*ei2]->valid = false;
+						roads.invalidateEdge(*ei);
+						roads.invalidateEdge(*ei2);
 
 						// スナップする
 						snapVertex(roads, new_v_desc2, new_v_desc);
@@ -3354,6 +3387,9 @@ bool GraphUtil::planarifyOne(RoadGraph& roads) {
 						//addEdge(roads, src2, new_v_desc, roads.graph[*ei2]->type, roads.graph[*ei2]->lanes, roads.graph[*ei2]->oneWay);
 						//addEdge(roads, new_v_desc, tgt2, roads.graph[*ei2]->type, roads.graph[*ei2]->lanes, roads.graph[*ei2]->oneWay);
 
+						// 繰り返し呼び出しても無効な頂点・エッジが溜まらないよう、必要なら詰める
+						roads.compactIfNeeded();
+
 						return true;
 					}
 				}
@@ -3388,11 +3424,11 @@ void GraphUtil::skeltonize(RoadGraph* roads) {
 		for (boost::tie(ei, eend) = boost::out_edges(list[i], roads->graph); ei != eend; ++ei) {
 			if (!roads->graph[*ei]->valid) continue;
 
-			roads->graph[*ei]->valid = false;
+			roads->invalidateEdge(*ei);
 		}
 
 		// 頂点を無効にする
-		roads->graph[list[i]]->valid = false;
+		roads->invalidateVertex(list[i]);
 	}
 }
 
@@ -3595,7 +3631,7 @@ void GraphUtil::snapDeadendEdges(RoadGraph& roads, float threshold) {
 			if (GraphUtil::hasEdge(roads, nearest_desc, tgt, false)) {
 				// もともとエッジがあるが無効となっている場合、それを有効にし、エッジのポリラインを更新する
 				RoadEdgeDesc new_e_desc = GraphUtil::getEdge(roads, nearest_desc, tgt, false);
-				roads.graph[new_e_desc]->valid = true;
+				roads.restoreEdge(new_e_desc);
 				roads.graph[new_e_desc]->polyline = roads.graph[e_desc]->polyline;
 			} else {
 				// 該当頂点間にエッジがない場合は、新しいエッジを追加する
@@ -3603,10 +3639,10 @@ void GraphUtil::snapDeadendEdges(RoadGraph& roads, float threshold) {
 			}
 
 			// 古いエッジを無効にする
-			roads.graph[e_desc]->valid = false;
+			roads.invalidateEdge(e_desc);
 
 			// 当該頂点を無効にする
-			roads.graph[*vi]->valid = false;
+			roads.invalidateVertex(*vi);
 		}
 	}
 }
@@ -3703,8 +3739,8 @@ void GraphUtil::removeShortDeadend(RoadGraph& roads, float threshold) {
 
 				// invalidate the too short edge, and invalidate the dead-end vertex.
 				if (roads.graph[*ei]->getLength() < threshold) {
-					roads.graph[*vi]->valid = false;
-					roads.graph[*ei]->valid = false;
+					roads.invalidateVertex(*vi);
+					roads.invalidateEdge(*ei);
 					deleted = true;
 					actuallyDeleted = true;
 				}
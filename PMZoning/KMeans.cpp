@@ -1,4 +1,5 @@
 ﻿#include "KMeans.h"
+#include "Sampler.h"
 #include <assert.h>
 
 KMeans::KMeans(int dimensions, int num_clusters) {
@@ -12,8 +13,9 @@ KMeans::KMeans(int dimensions, int num_clusters) {
  * @param samples		サンプルデータ
  * @param mu			クラスタの中心
  * @param groups		各サンプルが属するクラスタID
+ * @param rng			乱数生成器
  */
-void KMeans::cluster(Mat_<double> samples, int max_iterations, Mat_<double>& mu, vector<int>& groups) {
+void KMeans::cluster(Mat_<double> samples, int max_iterations, Mat_<double>& mu, vector<int>& groups, Rng& rng) {
 	assert(samples.cols == dimensions);
 
 	mu = Mat_<double>(num_clusters, dimensions);
@@ -30,7 +32,7 @@ void KMeans::cluster(Mat_<double> samples, int max_iterations, Mat_<double>& mu,
 
 	// 初期クラスタリング（K-means++アルゴリズムで、初期クラスタ中心を決定する）
 	{
-		int s = (double)rand() / RAND_MAX * samples.rows;
+		int s = rng.uniformInt(samples.rows);
 		Mat_<double> temp = mu.rowRange(0, 1);
 		samples.row(s).copyTo(temp);
 
@@ -44,7 +46,7 @@ void KMeans::cluster(Mat_<double> samples, int max_iterations, Mat_<double>& mu,
 				pdf.push_back(dist * dist);
 			}
 
-			int s = sampleFromPdf(pdf);
+			int s = sampleFromPdf(pdf, rng);
 			Mat_<double> temp = mu.rowRange(j, j + 1);
 			samples.row(s).copyTo(temp);
 		}
@@ -153,28 +155,8 @@ int KMeans::findNearestCenter(const Mat_<double>& sample, const Mat_<double>& mu
 	return group_id;
 }
 
-int KMeans::sampleFromCdf(std::vector<double> &cdf) {
-	double rnd = (double)rand() / RAND_MAX * cdf.back();
-
-	for (int i = 0; i < cdf.size(); ++i) {
-		if (rnd <= cdf[i]) return i;
-	}
-
-	return cdf.size() - 1;
-}
-
-int KMeans::sampleFromPdf(std::vector<double> &pdf) {
+int KMeans::sampleFromPdf(std::vector<double> &pdf, Rng& rng) {
 	if (pdf.size() == 0) return 0;
 
-	std::vector<double> cdf(pdf.size(), 0.0f);
-	cdf[0] = pdf[0];
-	for (int i = 1; i < pdf.size(); ++i) {
-		if (pdf[i] >= 0) {
-			cdf[i] = cdf[i - 1] + pdf[i];
-		} else {
-			cdf[i] = cdf[i - 1];
-		}
-	}
-
-	return sampleFromCdf(cdf);
+	return sampler::sampleOnce(rng, &pdf[0], pdf.size());
 }
\ No newline at end of file
@@ -12,6 +12,7 @@
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
 #include <vector>
+#include "Rng.h"
 
 using namespace cv;
 using namespace std;
@@ -25,12 +26,11 @@ private:
 public:
 	KMeans(int dimensions, int num_clusters);
 
-	void cluster(Mat_<double> samples, int max_iterations, Mat_<double>& mu, vector<int>& groups);
+	void cluster(Mat_<double> samples, int max_iterations, Mat_<double>& mu, vector<int>& groups, Rng& rng);
 
 private:
 	//int findNearestCenter(const Mat_<double>& sample, const Mat_<double>& mu, double& min_dist);
 	int findNearestCenter(const Mat_<double>& sample, const Mat_<double>& mu, const Mat& invCovar, double& min_dist);
-	int sampleFromCdf(std::vector<double> &cdf);
-	int sampleFromPdf(std::vector<double> &pdf);
+	int sampleFromPdf(std::vector<double> &pdf, Rng& rng);
 };
 
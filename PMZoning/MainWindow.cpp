@@ -2,12 +2,10 @@
 #include "PMZoning.h"
 #include "BMZoning.h"
 #include "GraphUtil.h"
+#include "RoadSnapshotFile.h"
 #include <QFileDialog>
-#include <QFile>
-#include <QTextStream>
 #include "Util.h"
-#include "KMeans.h"
-#include <QElapsedTimer>
+#include "ZoningSearch.h"
 
 using namespace std;
 
@@ -23,44 +21,32 @@ MainWindow::MainWindow(QWidget *parent, Qt::WFlags flags) : QMainWindow(parent,
 	connect(ui.actionGenerateRandomPreferences, SIGNAL(triggered()), this, SLOT(onGenerateRandomPreferences()));
 
 	connect(ui.actionExit, SIGNAL(triggered()), this, SLOT(close()));
-}
 
-MainWindow::~MainWindow() {
+	road_snapshot = RoadSnapshotPtr(new RoadSnapshot(roads));
 }
 
-vector<pair<float, vector<float> > > MainWindow::readPreferences(const char* filename) {
-	vector<pair<float, vector<float> > > preferences;
-
-	QFile file(filename);
-	file.open(QIODevice::ReadOnly);
- 
-	// preference vectorを読み込む
-	QTextStream in(&file);
-	while (true) {
-		QString str = in.readLine(0);
-		if (str == NULL) break;
-
-		float weight = str.split("\t")[0].toFloat();
-		QStringList preference_list = str.split("\t")[1].split(",");
-		std::vector<float> preference;
-		for (int i = 0; i < preference_list.size(); ++i) {
-			preference.push_back(preference_list[i].toFloat());
-		}
-
-		// normalize
-		Util::normalize(preference);
-
-		preferences.push_back(make_pair(weight, preference));
-	}
-
-	return preferences;
+MainWindow::~MainWindow() {
 }
 
 void MainWindow::onLoadRoads() {
-	QString filename = QFileDialog::getOpenFileName(this, tr("Open Street Map file..."), "", tr("StreetMap Files (*.gsm)"));
+	QString filename = QFileDialog::getOpenFileName(this, tr("Open Street Map file..."), "", tr("StreetMap Files (*.gsm *.rsn)"));
 	if (filename.isEmpty()) return;
 
+	// バイナリ形式は、メモリにマップしてそのまま使う (編集用のRoadGraphは空にする)
+	if (RoadSnapshotFile::isSnapshotFile(filename)) {
+		QString error;
+		RoadSnapshotPtr snapshot = RoadSnapshotFile::load(filename, &error);
+		if (!snapshot) {
+			printf("%s\n", error.toUtf8().data());
+			return;
+		}
+		roads.clear();
+		road_snapshot = snapshot;
+		return;
+	}
+
 	GraphUtil::loadRoads(roads, filename);
+	road_snapshot = RoadSnapshotPtr(new RoadSnapshot(roads));
 }
 
 /**
@@ -71,20 +57,20 @@ void MainWindow::onGenerateZoningByPM() {
 	QString filename = QFileDialog::getOpenFileName(this, tr("Load preference file..."), "", tr("Preference files (*.txt)"));
 	if (filename.isEmpty()) return;
 
-	vector<pair<float, vector<float> > > preferences = readPreferences(filename.toUtf8().data());
+	vector<pair<float, vector<float> > > preferences = Zoning::readPreferences(filename.toUtf8().data());
 
 	std::vector<float> zone_distribution(4);
 	zone_distribution[0] = 0.7f; zone_distribution[1] = 0.1f; zone_distribution[2] = 0.1f; zone_distribution[3] = 0.1f;
-	PMZoning pm(5000, 64, zone_distribution, roads);
+	PMZoning pm(5000, 64, zone_distribution, road_snapshot);
 
-	pm.initialZoning(zone_distribution);
+	pm.initialZoning(zone_distribution, rng);
 
 	for (int iter = 0; iter < 40; ++iter) {
 		char filename[256];
 		sprintf(filename, "zoning/zone_%d.jpg", iter);
 		pm.save(filename, 400);
 
-		pm.update();
+		pm.update(rng);
 	}
 
 	pm.computePropertyVectors();
@@ -100,13 +86,13 @@ void MainWindow::onGenerateZoningByPM() {
 void MainWindow::onGenerateManyZoningsByPM() {
 	std::vector<float> zone_distribution(4);
 	zone_distribution[0] = 0.7f; zone_distribution[1] = 0.1f; zone_distribution[2] = 0.1f; zone_distribution[3] = 0.1f;
-	PMZoning pm(5000, 64, zone_distribution, roads);
+	PMZoning pm(5000, 64, zone_distribution, road_snapshot);
 
 	for (int i = 0; i < 100; ++i) {
-		pm.initialZoning(zone_distribution);
+		pm.initialZoning(zone_distribution, rng);
 
 		for (int iter = 0; iter < 40; ++iter) {
-			pm.update();
+			pm.update(rng);
 		}
 		char filename[256];
 		sprintf(filename, "zoning/zone_%d.jpg", i);
@@ -118,56 +104,25 @@ void MainWindow::onGenerateManyZoningsByPM() {
  * PM方式でたくさんのゾーニングを生成し、ベストスコアのものを探す。
  */
 void MainWindow::onFindBestZoningByPM() {
-	QElapsedTimer timer;
-	timer.start();
-
-	double initComputation = 0;
-	double pmComputation = 0;
-	double propertyComputation = 0;
-	double scoreComputation = 0;
-
 	QString filename = QFileDialog::getOpenFileName(this, tr("Load preference file..."), "", tr("Preference files (*.txt)"));
 	if (filename.isEmpty()) return;
 
-	vector<pair<float, vector<float> > > preferences = readPreferences(filename.toUtf8().data());
+	vector<pair<float, vector<float> > > preferences = Zoning::readPreferences(filename.toUtf8().data());
 
 	std::vector<float> zone_distribution(4);
 	zone_distribution[0] = 0.7f; zone_distribution[1] = 0.1f; zone_distribution[2] = 0.1f; zone_distribution[3] = 0.1f;
-	PMZoning pm(5000, 64, zone_distribution, roads);
-
-	float best_score = 0.0f;
-	PMZoning best_zones(1, 1, zone_distribution, roads);
-	for (int i = 0; i < 500; ++i) {
-		timer.restart();
-		pm.initialZoning(zone_distribution);
-		initComputation += timer.elapsed();
 
-		timer.restart();
-		for (int iter = 0; iter < 40; ++iter) {
-			pm.update();
-		}
-		pmComputation += timer.elapsed();
-
-		timer.restart();
-		pm.computePropertyVectors();
-		propertyComputation += timer.elapsed();
-
-		timer.restart();
-		float score = pm.computeScore(preferences);
-		scoreComputation += timer.elapsed();
-
-		if (score > best_score) {
-			best_score = score;
-			best_zones = pm;
-		}
-	}
+	// 500個の候補を、複数のワーカーで並列に生成する
+	ZoningSearch search(5000, 64, zone_distribution, road_snapshot);
+	Mat_<uchar> best_zone_map;
+	float best_score = search.findBest(preferences, 500, 40, best_zone_map);
 
+	PMZoning best_zones(5000, 64, zone_distribution, road_snapshot);
+	best_zones.setZoneMap(best_zone_map);
 	best_zones.save("zoning/best_zone.jpg", 400);
 
-	printf("init zones: %lf sec\n", initComputation / 1000.0);
-	printf("PM: %lf sec\n", pmComputation / 1000.0);
-	printf("property vector: %lf sec\n", propertyComputation / 1000.0);
-	printf("score: %lf sec\n", scoreComputation / 1000.0);
+	printf("Best score: %lf\n", best_score);
+	search.printStatistics();
 }
 
 /**
@@ -179,19 +134,19 @@ void MainWindow::onGenerateZoningByBM() {
 	QString filename = QFileDialog::getOpenFileName(this, tr("Load preference file..."), "", tr("Preference files (*.txt)"));
 	if (filename.isEmpty()) return;
 
-	vector<pair<float, vector<float> > > preferences = readPreferences(filename.toUtf8().data());
+	vector<pair<float, vector<float> > > preferences = Zoning::readPreferences(filename.toUtf8().data());
 	*/
 
 	std::vector<float> zone_distribution(4);
 	zone_distribution[0] = 0.7f; zone_distribution[1] = 0.1f; zone_distribution[2] = 0.1f; zone_distribution[3] = 0.1f;
-	BMZoning bm(5000, 64, zone_distribution, roads);
+	BMZoning bm(5000, 64, zone_distribution, road_snapshot, rng);
 
 	for (int iter = 0; iter < 40; ++iter) {
 		char filename[256];
 		sprintf(filename, "zoning/zone_%d.jpg", iter);
 		bm.save(filename, 400);
 
-		bm.update();
+		bm.update(rng);
 	}
 
 	/*
@@ -206,40 +161,13 @@ void MainWindow::onGenerateZoningByBM() {
  * ランダムに、preferenceベクトルを10000人分作成し、10個のグループにクラスタリングする。
  */
 void MainWindow::onGenerateRandomPreferences() {
-	Mat_<double> preferences = Zoning::generateRandomPreferences(10000);
+	Mat_<double> preferences = Zoning::generateRandomPreferences(10000, rng);
 
 	// K-meansクラスタリング
-	KMeans kmeans(6, 10);
-	Mat_<double> mu;
-	vector<int> groups;
-	kmeans.cluster(preferences, 40, mu, groups);
-
-	// 各クラスタの割合を計算する
-	vector<float> ratio(mu.rows, 0.0f);
-	for (int u = 0; u < groups.size(); ++u) {
-		ratio[groups[u]]++;
-	}
-	for (int j = 0; j < ratio.size(); ++j) {
-		ratio[j] /= (float)groups.size();
-	}
+	vector<pair<float, vector<float> > > clusters = Zoning::clusterPreferences(preferences, 10, rng);
 
 	QString filename = QFileDialog::getSaveFileName(this, tr("Save preference file..."), "", tr("Preference files (*.txt)"));
 	if (filename.isEmpty()) return;
 
-	QFile file(filename);
-	if (!file.open(QIODevice::WriteOnly)) return;
-
-	QTextStream out(&file);
-	for (int j = 0; j < mu.rows; ++j) {
-		if (ratio[j] == 0.0f) continue;
-
-		out << ratio[j] << "\t";
-
-		for (int k = 0; k < mu.cols; ++k) {
-			if (k > 0) out << ",";
-			out << mu(j, k);
-		}
-		out << endl;
-	}
-	file.close();
+	Zoning::writePreferences(filename.toUtf8().data(), clusters);
 }
@@ -4,6 +4,8 @@
 #include <QtGui/QMainWindow>
 #include "ui_MainWindow.h"
 #include "RoadGraph.h"
+#include "RoadSnapshot.h"
+#include "Rng.h"
 
 using namespace std;
 
@@ -13,13 +15,13 @@ class MainWindow : public QMainWindow {
 private:
 	Ui::MainWindowClass ui;
 	RoadGraph roads;
+	RoadSnapshotPtr road_snapshot;
+	Rng rng;
 
 public:
 	MainWindow(QWidget *parent = 0, Qt::WFlags flags = 0);
 	~MainWindow();
 
-	vector<pair<float, vector<float> > > readPreferences(const char* filename);
-
 public slots:
 	void onLoadRoads();
 	void onGenerateZoningByPM();
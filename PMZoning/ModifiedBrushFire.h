@@ -3,6 +3,7 @@
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
 #include <list>
+#include <vector>
 
 using namespace cv;
 using namespace std;
@@ -18,11 +19,15 @@ private:
 	Mat_<Vec2i> obst;		// 直近のストアの座標
 	Mat_<bool> toRaise;		// 要更新マーク
 	list<Vec2i> queue;
+	vector<Vec2i> updated;	// 前回clearUpdatedCells()を呼んでから、距離が変化したセル
 
 public:
 	ModifiedBrushFire(int width, int height, Mat& data);
+	ModifiedBrushFire(int width, int height, Mat& data, const Mat_<float>& dist, const Mat_<Vec2i>& obst);
 	
 	const Mat_<float>& distMap() { return dist; }
+	const vector<Vec2i>& updatedCells() { return updated; }
+	void clearUpdatedCells() { updated.clear(); }
 
 	void updateDistanceMap();
 	void setStore(int r, int c);
@@ -0,0 +1,833 @@
+﻿#include "OsmImporter.h"
+#include "GraphUtil.h"
+#include "Util.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QByteArray>
+#include <QXmlStreamReader>
+#include <algorithm>
+#include <limits>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// way_flagsのビット
+const unsigned char FLAG_ONEWAY = 1;
+const unsigned char FLAG_LINK = 2;
+const unsigned char FLAG_ROUNDABOUT = 4;
+
+/** wayのタグのうち、道路の判定に使うもの */
+struct WayTags {
+	string highway;
+	string lanes;
+	string oneway;
+	string junction;
+	string area;
+
+	void set(const char* key, int key_size, const char* value, int value_size) {
+		string k(key, key_size);
+		if (k == "highway") highway.assign(value, value_size);
+		else if (k == "lanes") lanes.assign(value, value_size);
+		else if (k == "oneway") oneway.assign(value, value_size);
+		else if (k == "junction") junction.assign(value, value_size);
+		else if (k == "area") area.assign(value, value_size);
+	}
+};
+
+/**
+ * wayのタグから、道路のタイプ、車線数、フラグを決める。
+ * 読み込まない道路の場合は、falseを返却する。
+ *
+ * @param reversed [OUT]	oneway=-1 (ノードの逆順に一方通行) ならtrue
+ */
+bool classifyWay(const WayTags& tags, unsigned char& type, unsigned char& lanes, unsigned char& flags, bool& reversed) {
+	if (tags.area == "yes") return false;
+
+	string highway = tags.highway;
+	flags = 0;
+	if (highway.size() > 5 && highway.compare(highway.size() - 5, 5, "_link") == 0) {
+		highway = highway.substr(0, highway.size() - 5);
+		flags |= FLAG_LINK;
+	}
+
+	int default_lanes;
+	if (highway == "motorway" || highway == "trunk") {
+		type = RoadEdge::TYPE_HIGHWAY;
+		default_lanes = 4;
+	} else if (highway == "primary" || highway == "secondary") {
+		type = RoadEdge::TYPE_AVENUE;
+		default_lanes = 2;
+	} else if (highway == "tertiary" || highway == "residential" || highway == "unclassified" || highway == "living_street" || highway == "road") {
+		type = RoadEdge::TYPE_STREET;
+		default_lanes = 1;
+	} else {
+		return false;
+	}
+
+	int num_lanes = atoi(tags.lanes.c_str());
+	lanes = num_lanes > 0 ? min(num_lanes, 255) : default_lanes;
+
+	reversed = tags.oneway == "-1";
+	if (tags.oneway == "yes" || tags.oneway == "true" || tags.oneway == "1" || reversed) flags |= FLAG_ONEWAY;
+	if (tags.junction == "roundabout") flags |= FLAG_ROUNDABOUT | FLAG_ONEWAY;
+
+	return true;
+}
+
+/**
+ * 座標を、10^-7度単位の整数に丸める。
+ */
+int toFixed(double degree) {
+	double value = degree * 1e7;
+	return (int)(value >= 0.0 ? value + 0.5 : value - 0.5);
+}
+
+/**
+ * Protocol Buffersのメッセージを、先頭から順に読む。
+ * 範囲外を読もうとした場合や、不正な値の場合は、okをfalseにしてそれ以降は何も読まない。
+ */
+struct ProtoReader {
+	const uchar* ptr;
+	const uchar* end;
+	bool ok;
+
+	ProtoReader(const uchar* data, qint64 size) : ptr(data), end(data + size), ok(true) {}
+
+	bool atEnd() const { return !ok || ptr >= end; }
+
+	quint64 varint() {
+		quint64 value = 0;
+		for (int shift = 0; shift < 64 && ptr < end; shift += 7) {
+			uchar b = *ptr++;
+			value |= (quint64)(b & 0x7f) << shift;
+			if (!(b & 0x80)) return value;
+		}
+		ok = false;
+		return 0;
+	}
+
+	qint64 svarint() {
+		quint64 value = varint();
+		return (qint64)(value >> 1) ^ -(qint64)(value & 1);
+	}
+
+	bool field(int& number, int& wire_type) {
+		quint64 key = varint();
+		if (!ok) return false;
+		number = (int)(key >> 3);
+		wire_type = (int)(key & 7);
+		return true;
+	}
+
+	ProtoReader bytes() {
+		quint64 size = varint();
+		if (!ok || size > (quint64)(end - ptr)) {
+			ok = false;
+			return ProtoReader(end, 0);
+		}
+		ProtoReader ret(ptr, size);
+		ptr += size;
+		return ret;
+	}
+
+	void advance(qint64 size) {
+		if (size > end - ptr) {
+			ok = false;
+			return;
+		}
+		ptr += size;
+	}
+
+	void skip(int wire_type) {
+		switch (wire_type) {
+		case 0: varint(); break;
+		case 1: advance(8); break;
+		case 2: bytes(); break;
+		case 5: advance(4); break;
+		default: ok = false; break;
+		}
+	}
+};
+
+/**
+ * 繰り返しの整数のフィールドを読む (packedとpackedでない場合の両方に対応する)。
+ */
+void readUInt32s(ProtoReader& reader, int wire_type, vector<quint32>& values) {
+	if (wire_type == 2) {
+		ProtoReader packed = reader.bytes();
+		while (!packed.atEnd()) values.push_back((quint32)packed.varint());
+		if (!packed.ok) reader.ok = false;
+	} else if (wire_type == 0) {
+		values.push_back((quint32)reader.varint());
+	} else {
+		reader.skip(wire_type);
+	}
+}
+
+void readSInt64s(ProtoReader& reader, int wire_type, vector<qint64>& values) {
+	if (wire_type == 2) {
+		ProtoReader packed = reader.bytes();
+		while (!packed.atEnd()) values.push_back(packed.svarint());
+		if (!packed.ok) reader.ok = false;
+	} else if (wire_type == 0) {
+		values.push_back(reader.svarint());
+	} else {
+		reader.skip(wire_type);
+	}
+}
+
+/** PBFのブロック (BlobHeaderの種類と、Blob) */
+struct PbfBlob {
+	string type;
+	QByteArray data;
+};
+
+/**
+ * PBFのファイルから、次のブロックを読む。
+ *
+ * @return		読めたらtrue (ファイルの終わりの場合は、falseでerrorは空)
+ */
+bool readBlob(QFile& file, PbfBlob& blob, QString& error) {
+	uchar size_bytes[4];
+	qint64 n = file.read((char*)size_bytes, 4);
+	if (n == 0) return false;
+	if (n != 4) {
+		error = "truncated blob header";
+		return false;
+	}
+
+	quint32 header_size = ((quint32)size_bytes[0] << 24) | ((quint32)size_bytes[1] << 16) | ((quint32)size_bytes[2] << 8) | size_bytes[3];
+	if (header_size > 64 * 1024) {
+		error = "blob header too large";
+		return false;
+	}
+	QByteArray header = file.read(header_size);
+	if (header.size() != (int)header_size) {
+		error = "truncated blob header";
+		return false;
+	}
+
+	ProtoReader reader((const uchar*)header.constData(), header.size());
+	qint64 data_size = -1;
+	blob.type.clear();
+	int number, wire_type;
+	while (!reader.atEnd() && reader.field(number, wire_type)) {
+		if (number == 1 && wire_type == 2) {
+			ProtoReader type = reader.bytes();
+			blob.type.assign((const char*)type.ptr, type.end - type.ptr);
+		} else if (number == 3 && wire_type == 0) {
+			data_size = (qint64)reader.varint();
+		} else {
+			reader.skip(wire_type);
+		}
+	}
+	if (!reader.ok || data_size < 0 || data_size > 64 * 1024 * 1024) {
+		error = "corrupt blob header";
+		return false;
+	}
+
+	blob.data = file.read(data_size);
+	if (blob.data.size() != data_size) {
+		error = "truncated blob";
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Blobを展開する。
+ */
+bool decompressBlob(const QByteArray& blob, QByteArray& data, QString& error) {
+	ProtoReader reader((const uchar*)blob.constData(), blob.size());
+	qint64 raw_size = -1;
+	int number, wire_type;
+	while (!reader.atEnd() && reader.field(number, wire_type)) {
+		if (number == 1 && wire_type == 2) {
+			ProtoReader raw = reader.bytes();
+			data = QByteArray((const char*)raw.ptr, raw.end - raw.ptr);
+			return reader.ok;
+		} else if (number == 2 && wire_type == 0) {
+			raw_size = (qint64)reader.varint();
+		} else if (number == 3 && wire_type == 2) {
+			ProtoReader zlib = reader.bytes();
+			if (!reader.ok || raw_size < 0 || raw_size > 64 * 1024 * 1024) break;
+
+			// qUncompressは、先頭に展開後のサイズ (ビッグエンディアン) を付けたzlibのデータを受け取る
+			QByteArray compressed;
+			compressed.resize(4 + (zlib.end - zlib.ptr));
+			compressed[0] = (char)((raw_size >> 24) & 0xff);
+			compressed[1] = (char)((raw_size >> 16) & 0xff);
+			compressed[2] = (char)((raw_size >> 8) & 0xff);
+			compressed[3] = (char)(raw_size & 0xff);
+			memcpy(compressed.data() + 4, zlib.ptr, zlib.end - zlib.ptr);
+			data = qUncompress(compressed);
+			if (data.size() != raw_size) {
+				error = "cannot decompress blob";
+				return false;
+			}
+			return true;
+		} else if (number >= 4 && number <= 7) {
+			error = "unsupported blob compression (only raw and zlib are supported)";
+			return false;
+		} else {
+			reader.skip(wire_type);
+		}
+	}
+
+	error = "corrupt blob";
+	return false;
+}
+
+/**
+ * OSMHeaderのブロックの、必須の機能に対応しているか確認する。
+ */
+bool checkHeaderBlock(const QByteArray& data, QString& error) {
+	ProtoReader reader((const uchar*)data.constData(), data.size());
+	int number, wire_type;
+	while (!reader.atEnd() && reader.field(number, wire_type)) {
+		if (number == 4 && wire_type == 2) {
+			ProtoReader feature = reader.bytes();
+			string name((const char*)feature.ptr, feature.end - feature.ptr);
+			if (name != "OsmSchema-V0.6" && name != "DenseNodes") {
+				error = QString("unsupported required feature: ") + name.c_str();
+				return false;
+			}
+		} else {
+			reader.skip(wire_type);
+		}
+	}
+	return reader.ok;
+}
+
+}
+
+/** 1つのPBFのブロックから読んだway */
+struct OsmImporter::BlockWays {
+	vector<qint64> refs;
+	vector<int> sizes;
+	vector<unsigned char> type;
+	vector<unsigned char> lanes;
+	vector<unsigned char> flags;
+
+	void add(const vector<qint64>& way_refs, const WayTags& tags) {
+		unsigned char t, l, f;
+		bool reversed;
+		if (way_refs.size() < 2 || !classifyWay(tags, t, l, f, reversed)) return;
+
+		if (reversed) {
+			refs.insert(refs.end(), way_refs.rbegin(), way_refs.rend());
+		} else {
+			refs.insert(refs.end(), way_refs.begin(), way_refs.end());
+		}
+		sizes.push_back(way_refs.size());
+		type.push_back(t);
+		lanes.push_back(l);
+		flags.push_back(f);
+	}
+};
+
+/** 1つのPBFのブロックから読んだノード (node_idsの番号と座標) */
+struct OsmImporter::BlockNodes {
+	vector<int> index;
+	vector<int> lat;
+	vector<int> lon;
+};
+
+namespace {
+
+/**
+ * PrimitiveBlockの文字列表と座標の変換係数。
+ */
+struct PrimitiveBlock {
+	vector<pair<const char*, int> > strings;
+	qint64 granularity;
+	qint64 lat_offset;
+	qint64 lon_offset;
+
+	/**
+	 * 座標を、10^-7度単位の整数に変換する。
+	 */
+	int toFixed(qint64 offset, qint64 value) const {
+		qint64 nano = offset + granularity * value;
+		return (int)(nano >= 0 ? (nano + 50) / 100 : -((-nano + 50) / 100));
+	}
+};
+
+/**
+ * PrimitiveBlockの、文字列表と変換係数を読む。
+ */
+bool readPrimitiveBlock(const QByteArray& data, PrimitiveBlock& block) {
+	block.granularity = 100;
+	block.lat_offset = 0;
+	block.lon_offset = 0;
+
+	ProtoReader reader((const uchar*)data.constData(), data.size());
+	int number, wire_type;
+	while (!reader.atEnd() && reader.field(number, wire_type)) {
+		if (number == 1 && wire_type == 2) {
+			ProtoReader table = reader.bytes();
+			int n, w;
+			while (!table.atEnd() && table.field(n, w)) {
+				if (n == 1 && w == 2) {
+					ProtoReader s = table.bytes();
+					block.strings.push_back(make_pair((const char*)s.ptr, (int)(s.end - s.ptr)));
+				} else {
+					table.skip(w);
+				}
+			}
+			if (!table.ok) return false;
+		} else if (number == 17 && wire_type == 0) {
+			block.granularity = (qint64)reader.varint();
+		} else if (number == 19 && wire_type == 0) {
+			block.lat_offset = (qint64)reader.varint();
+		} else if (number == 20 && wire_type == 0) {
+			block.lon_offset = (qint64)reader.varint();
+		} else {
+			reader.skip(wire_type);
+		}
+	}
+	return reader.ok;
+}
+
+}
+
+OsmImporter::OsmImporter() {
+	num_threads = 0;
+	has_center = false;
+	center_lat = 0.0;
+	center_lon = 0.0;
+	num_found = 0;
+}
+
+/**
+ * 投影の中心を指定する。指定しない場合は、読み込んだ道路のバウンディングボックスの中心とする。
+ *
+ * @param lat		緯度
+ * @param lon		経度
+ */
+void OsmImporter::setCenter(double lat, double lon) {
+	has_center = true;
+	center_lat = lat;
+	center_lon = lon;
+}
+
+/**
+ * ファイルから道路網を読み込む。
+ *
+ * @param filename		ファイル名 (.osm、または.pbf)
+ * @param roads [OUT]	道路網
+ * @return				読み込めたらtrue (失敗した場合は、errorString()に理由を格納する)
+ */
+bool OsmImporter::import(const QString& filename, RoadGraph& roads) {
+	roads.clear();
+	error.clear();
+	way_refs.clear();
+	way_start.assign(1, 0);
+	way_type.clear();
+	way_lanes.clear();
+	way_flags.clear();
+
+	bool pbf = filename.endsWith(".pbf", Qt::CaseInsensitive);
+
+	// 1回目: 道路のwayを読む
+	if (!(pbf ? scanPbf(filename, 0) : scanXml(filename, 0))) return false;
+	collectNodes();
+
+	// 2回目: wayが参照するノードの座標を読む
+	if (!(pbf ? scanPbf(filename, 1) : scanXml(filename, 1))) return false;
+
+	buildGraph(roads);
+
+	return true;
+}
+
+/**
+ * OpenStreetMapのファイルかどうか、拡張子で判定する。
+ */
+bool OsmImporter::isOsmFile(const QString& filename) {
+	return filename.endsWith(".osm", Qt::CaseInsensitive) || filename.endsWith(".pbf", Qt::CaseInsensitive);
+}
+
+/**
+ * XMLのファイルを先頭から読む。
+ *
+ * @param filename		ファイル名
+ * @param pass			0 - wayを読む / 1 - ノードを読む
+ */
+bool OsmImporter::scanXml(const QString& filename, int pass) {
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly)) return fail("cannot open " + filename);
+
+	QXmlStreamReader xml(&file);
+	BlockWays ways;
+	BlockNodes nodes;
+	vector<qint64> refs;
+	WayTags tags;
+	bool in_way = false;
+
+	while (!xml.atEnd()) {
+		xml.readNext();
+
+		if (xml.isStartElement()) {
+			if (pass == 1 && xml.name() == "node") {
+				int index = findNode(xml.attributes().value("id").toString().toLongLong());
+				if (index >= 0) {
+					nodes.index.push_back(index);
+					nodes.lat.push_back(toFixed(xml.attributes().value("lat").toString().toDouble()));
+					nodes.lon.push_back(toFixed(xml.attributes().value("lon").toString().toDouble()));
+				}
+			} else if (pass == 0 && xml.name() == "way") {
+				in_way = true;
+				refs.clear();
+				tags = WayTags();
+			} else if (in_way && xml.name() == "nd") {
+				refs.push_back(xml.attributes().value("ref").toString().toLongLong());
+			} else if (in_way && xml.name() == "tag") {
+				QByteArray key = xml.attributes().value("k").toString().toUtf8();
+				QByteArray value = xml.attributes().value("v").toString().toUtf8();
+				tags.set(key.constData(), key.size(), value.constData(), value.size());
+			}
+		} else if (xml.isEndElement()) {
+			if (in_way && xml.name() == "way") {
+				in_way = false;
+				ways.add(refs, tags);
+
+				// 一定数たまったら、登録する
+				if (ways.refs.size() >= 1024 * 1024) {
+					addWays(ways);
+					ways = BlockWays();
+				}
+			}
+		}
+
+		if (pass == 1 && nodes.index.size() >= 1024 * 1024) {
+			addNodes(nodes);
+			nodes = BlockNodes();
+			if (num_found == node_ids.size()) break;
+		}
+	}
+
+	if (xml.hasError()) return fail("XML error in " + filename + ": " + xml.errorString());
+
+	addWays(ways);
+	addNodes(nodes);
+	return true;
+}
+
+/**
+ * PBFのファイルを先頭から読む。
+ * ブロックをまとめて読んでから、並列に展開・解析し、ファイルの順に登録する。
+ *
+ * @param filename		ファイル名
+ * @param pass			0 - wayを読む / 1 - ノードを読む
+ */
+bool OsmImporter::scanPbf(const QString& filename, int pass) {
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly)) return fail("cannot open " + filename);
+
+	int threads = num_threads;
+	if (threads <= 0) {
+#ifdef _OPENMP
+		threads = omp_get_max_threads();
+#else
+		threads = 1;
+#endif
+	}
+
+	// 一度に読むブロックの数 (ブロックは展開後最大32MBなので、メモリの使用量はこれで抑えられる)
+	int batch_size = threads * 2;
+	bool header_checked = false;
+
+	while (true) {
+		vector<PbfBlob> blobs;
+		QString read_error;
+		while (blobs.size() < batch_size) {
+			PbfBlob blob;
+			if (!readBlob(file, blob, read_error)) break;
+
+			if (blob.type == "OSMHeader") {
+				QByteArray data;
+				if (!decompressBlob(blob.data, data, read_error) || !checkHeaderBlock(data, read_error)) break;
+				header_checked = true;
+			} else if (blob.type == "OSMData") {
+				blobs.push_back(blob);
+			}
+		}
+		if (!read_error.isEmpty()) return fail(read_error + ": " + filename);
+		if (blobs.empty()) break;
+		if (!header_checked) return fail("missing OSMHeader: " + filename);
+
+		int num_blobs = blobs.size();
+		vector<BlockWays> ways(pass == 0 ? num_blobs : 0);
+		vector<BlockNodes> nodes(pass == 1 ? num_blobs : 0);
+		vector<QString> errors(num_blobs);
+
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+		for (int b = 0; b < num_blobs; ++b) {
+			QByteArray data;
+			if (!decompressBlob(blobs[b].data, data, errors[b])) continue;
+			blobs[b].data = QByteArray();
+
+			PrimitiveBlock block;
+			if (!readPrimitiveBlock(data, block)) {
+				errors[b] = "corrupt primitive block";
+				continue;
+			}
+
+			ProtoReader reader((const uchar*)data.constData(), data.size());
+			int number, wire_type;
+			while (!reader.atEnd() && reader.field(number, wire_type)) {
+				if (number != 2 || wire_type != 2) {
+					reader.skip(wire_type);
+					continue;
+				}
+
+				ProtoReader group = reader.bytes();
+				int n, w;
+				while (!group.atEnd() && group.field(n, w)) {
+					if (pass == 0 && n == 3 && w == 2) {
+						// Way
+						ProtoReader way = group.bytes();
+						vector<quint32> keys, vals;
+						vector<qint64> refs;
+						int f, fw;
+						while (!way.atEnd() && way.field(f, fw)) {
+							if (f == 2) readUInt32s(way, fw, keys);
+							else if (f == 3) readUInt32s(way, fw, vals);
+							else if (f == 8) readSInt64s(way, fw, refs);
+							else way.skip(fw);
+						}
+						if (!way.ok || keys.size() != vals.size()) {
+							group.ok = false;
+							break;
+						}
+
+						WayTags tags;
+						for (int i = 0; i < keys.size(); ++i) {
+							if (keys[i] >= block.strings.size() || vals[i] >= block.strings.size()) continue;
+							tags.set(block.strings[keys[i]].first, block.strings[keys[i]].second, block.strings[vals[i]].first, block.strings[vals[i]].second);
+						}
+						if (tags.highway.empty()) continue;
+
+						// IDは差分で格納されている
+						for (int i = 1; i < refs.size(); ++i) refs[i] += refs[i - 1];
+						ways[b].add(refs, tags);
+					} else if (pass == 1 && n == 2 && w == 2) {
+						// DenseNodes
+						ProtoReader dense = group.bytes();
+						vector<qint64> ids, lats, lons;
+						int f, fw;
+						while (!dense.atEnd() && dense.field(f, fw)) {
+							if (f == 1) readSInt64s(dense, fw, ids);
+							else if (f == 8) readSInt64s(dense, fw, lats);
+							else if (f == 9) readSInt64s(dense, fw, lons);
+							else dense.skip(fw);
+						}
+						if (!dense.ok || ids.size() != lats.size() || ids.size() != lons.size()) {
+							group.ok = false;
+							break;
+						}
+
+						// ID、緯度、経度は差分で格納されている
+						qint64 id = 0, lat = 0, lon = 0;
+						for (int i = 0; i < ids.size(); ++i) {
+							id += ids[i];
+							lat += lats[i];
+							lon += lons[i];
+							int index = findNode(id);
+							if (index < 0) continue;
+							nodes[b].index.push_back(index);
+							nodes[b].lat.push_back(block.toFixed(block.lat_offset, lat));
+							nodes[b].lon.push_back(block.toFixed(block.lon_offset, lon));
+						}
+					} else if (pass == 1 && n == 1 && w == 2) {
+						// Node
+						ProtoReader node = group.bytes();
+						qint64 id = 0, lat = 0, lon = 0;
+						int f, fw;
+						while (!node.atEnd() && node.field(f, fw)) {
+							if (f == 1 && fw == 0) id = node.svarint();
+							else if (f == 8 && fw == 0) lat = node.svarint();
+							else if (f == 9 && fw == 0) lon = node.svarint();
+							else node.skip(fw);
+						}
+						if (!node.ok) {
+							group.ok = false;
+							break;
+						}
+
+						int index = findNode(id);
+						if (index < 0) continue;
+						nodes[b].index.push_back(index);
+						nodes[b].lat.push_back(block.toFixed(block.lat_offset, lat));
+						nodes[b].lon.push_back(block.toFixed(block.lon_offset, lon));
+					} else {
+						group.skip(w);
+					}
+				}
+				if (!group.ok) {
+					reader.ok = false;
+					break;
+				}
+			}
+			if (!reader.ok) errors[b] = "corrupt primitive group";
+		}
+
+		// ファイルの順に登録する
+		for (int b = 0; b < num_blobs; ++b) {
+			if (!errors[b].isEmpty()) return fail(errors[b] + ": " + filename);
+			if (pass == 0) addWays(ways[b]);
+			else addNodes(nodes[b]);
+		}
+
+		if (pass == 1 && num_found == node_ids.size()) break;
+	}
+
+	return true;
+}
+
+/**
+ * 読んだwayを登録する。
+ */
+void OsmImporter::addWays(const BlockWays& ways) {
+	way_refs.insert(way_refs.end(), ways.refs.begin(), ways.refs.end());
+	for (int i = 0; i < ways.sizes.size(); ++i) {
+		way_start.push_back(way_start.back() + ways.sizes[i]);
+	}
+	way_type.insert(way_type.end(), ways.type.begin(), ways.type.end());
+	way_lanes.insert(way_lanes.end(), ways.lanes.begin(), ways.lanes.end());
+	way_flags.insert(way_flags.end(), ways.flags.begin(), ways.flags.end());
+}
+
+/**
+ * 読んだノードの座標を登録する。同じIDのノードが複数ある場合は、最初のものを使う。
+ */
+void OsmImporter::addNodes(const BlockNodes& nodes) {
+	for (int i = 0; i < nodes.index.size(); ++i) {
+		int index = nodes.index[i];
+		if (node_found[index]) continue;
+
+		node_lat[index] = nodes.lat[i];
+		node_lon[index] = nodes.lon[i];
+		node_found[index] = 1;
+		num_found++;
+	}
+}
+
+/**
+ * wayが参照するノードのIDを整列して重複を除き、参照の回数を数える。
+ * wayの端点は、他のwayと共有していなくても頂点にするため、2回参照されたものとみなす。
+ */
+void OsmImporter::collectNodes() {
+	vector<qint64> refs(way_refs);
+	sort(refs.begin(), refs.end());
+
+	node_ids.clear();
+	node_uses.clear();
+	for (size_t i = 0; i < refs.size(); ) {
+		size_t j = i + 1;
+		while (j < refs.size() && refs[j] == refs[i]) ++j;
+		node_ids.push_back(refs[i]);
+		node_uses.push_back((unsigned char)min(j - i, (size_t)255));
+		i = j;
+	}
+	vector<qint64>().swap(refs);
+
+	for (int w = 0; w + 1 < way_start.size(); ++w) {
+		node_uses[findNode(way_refs[way_start[w]])] = 255;
+		node_uses[findNode(way_refs[way_start[w + 1] - 1])] = 255;
+	}
+
+	node_lat.assign(node_ids.size(), 0);
+	node_lon.assign(node_ids.size(), 0);
+	node_found.assign(node_ids.size(), 0);
+	num_found = 0;
+}
+
+/**
+ * ノードのIDから、node_idsの番号を返却する。wayが参照しないノードなら-1を返却する。
+ */
+int OsmImporter::findNode(qint64 id) const {
+	vector<qint64>::const_iterator it = lower_bound(node_ids.begin(), node_ids.end(), id);
+	if (it == node_ids.end() || *it != id) return -1;
+	return it - node_ids.begin();
+}
+
+/**
+ * 読み込んだwayとノードから、道路網を構築する。
+ * 座標が見つからなかったノードは、wayから取り除く。
+ */
+void OsmImporter::buildGraph(RoadGraph& roads) {
+	// 投影の中心
+	if (!has_center) {
+		int min_lat = numeric_limits<int>::max();
+		int max_lat = numeric_limits<int>::min();
+		int min_lon = numeric_limits<int>::max();
+		int max_lon = numeric_limits<int>::min();
+		for (int i = 0; i < node_ids.size(); ++i) {
+			if (!node_found[i]) continue;
+			min_lat = min(min_lat, node_lat[i]);
+			max_lat = max(max_lat, node_lat[i]);
+			min_lon = min(min_lon, node_lon[i]);
+			max_lon = max(max_lon, node_lon[i]);
+		}
+		if (num_found > 0) {
+			center_lat = ((double)min_lat + max_lat) * 0.5e-7;
+			center_lon = ((double)min_lon + max_lon) * 0.5e-7;
+		}
+	}
+	QVector2D center((float)center_lon, (float)center_lat);
+
+	RoadVertexDesc null_vertex = boost::graph_traits<BGLGraph>::null_vertex();
+	vector<RoadVertexDesc> descs(node_ids.size(), null_vertex);
+	vector<QVector2D> pts(node_ids.size());
+	for (int i = 0; i < node_ids.size(); ++i) {
+		if (node_found[i]) pts[i] = Util::projLatLonToMeter(node_lon[i] * 1e-7, node_lat[i] * 1e-7, center);
+	}
+
+	vector<int> indices;
+	for (int w = 0; w + 1 < way_start.size(); ++w) {
+		indices.clear();
+		for (qint64 k = way_start[w]; k < way_start[w + 1]; ++k) {
+			int index = findNode(way_refs[k]);
+			if (node_found[index]) indices.push_back(index);
+		}
+		if (indices.size() < 2) continue;
+
+		// 両端と、頂点にするノードで、wayをエッジに分割する
+		RoadVertexDesc start = null_vertex;
+		RoadEdgePtr edge;
+		for (int i = 0; i < indices.size(); ++i) {
+			int index = indices[i];
+			if (edge) edge->addPoint(pts[index]);
+			if (i > 0 && i < indices.size() - 1 && node_uses[index] < 2) continue;
+
+			if (descs[index] == null_vertex) {
+				descs[index] = boost::add_vertex(roads.graph);
+				roads.graph[descs[index]] = RoadVertexPtr(new RoadVertex(pts[index]));
+			}
+
+			// 長さのない自己ループは、追加しない
+			if (edge && !(start == descs[index] && edge->polyline.size() <= 2)) {
+				GraphUtil::cleanEdge(edge);
+				std::pair<RoadEdgeDesc, bool> edge_pair = boost::add_edge(start, descs[index], roads.graph);
+				roads.graph[edge_pair.first] = edge;
+			}
+
+			start = descs[index];
+			edge = RoadEdgePtr(new RoadEdge(way_type[w], way_lanes[w], (way_flags[w] & FLAG_ONEWAY) != 0, (way_flags[w] & FLAG_LINK) != 0, (way_flags[w] & FLAG_ROUNDABOUT) != 0));
+			edge->addPoint(pts[index]);
+		}
+	}
+
+	roads.setModified();
+}
+
+bool OsmImporter::fail(const QString& message) {
+	error = message;
+	return false;
+}
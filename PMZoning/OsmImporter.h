@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include <vector>
+#include <string>
+#include <QString>
+#include <QtGlobal>
+#include "RoadGraph.h"
+
+using namespace std;
+
+/**
+ * OpenStreetMapのファイル (XMLの.osm、またはPBFの.osm.pbf) から、道路網を読み込む。
+ *
+ * ファイル全体をメモリに読み込まず、2回に分けて先頭から順に読む。
+ *   1回目: highwayタグを持つwayだけを読み、参照するノードのIDを記録する。
+ *   2回目: 記録したノードの座標だけを読む。
+ * 保持するのは道路のwayと、それが参照するノードだけなので、地域全体のファイルでも読み込める。
+ * PBFのブロックは、まとめて読んでから、OpenMPで並列に展開・解析する。
+ *
+ * 2本以上のwayが共有するノードと、wayの端点を頂点とし、wayを頂点ごとにエッジに分割する。
+ * 座標は、Util::projLatLonToMeterで中心からの距離 [m] に変換する。
+ * highwayタグと道路のタイプの対応は、以下のとおり。
+ *   motorway、trunk (と、その_link)								RoadEdge::TYPE_HIGHWAY
+ *   primary、secondary (と、その_link)							RoadEdge::TYPE_AVENUE
+ *   tertiary、residential、unclassified、living_street、road		RoadEdge::TYPE_STREET
+ * それ以外 (service、footwayなど) は、読み込まない。
+ */
+class OsmImporter {
+private:
+	struct BlockWays;
+	struct BlockNodes;
+
+	int num_threads;
+	bool has_center;
+	double center_lat;
+	double center_lon;
+	QString error;
+
+	// 1回目で読んだ道路のway (wayの番号順に、参照するノードのIDを連結して保持する)
+	vector<qint64> way_refs;
+	vector<qint64> way_start;
+	vector<unsigned char> way_type;
+	vector<unsigned char> way_lanes;
+	vector<unsigned char> way_flags;
+
+	// wayが参照するノード (IDの順に並べる)
+	vector<qint64> node_ids;
+	vector<unsigned char> node_uses;	// 参照されている回数 (端点は2回とみなし、2以上なら頂点にする)
+	vector<int> node_lat;				// 緯度 [10^-7度]
+	vector<int> node_lon;				// 経度 [10^-7度]
+	vector<unsigned char> node_found;
+	int num_found;
+
+public:
+	OsmImporter();
+
+	void setNumThreads(int num_threads) { this->num_threads = num_threads; }
+	void setCenter(double lat, double lon);
+	bool import(const QString& filename, RoadGraph& roads);
+	const QString& errorString() const { return error; }
+	static bool isOsmFile(const QString& filename);
+
+private:
+	bool scanXml(const QString& filename, int pass);
+	bool scanPbf(const QString& filename, int pass);
+	void addWays(const BlockWays& ways);
+	void addNodes(const BlockNodes& nodes);
+	void collectNodes();
+	int findNode(qint64 id) const;
+	void buildGraph(RoadGraph& roads);
+	bool fail(const QString& message);
+};
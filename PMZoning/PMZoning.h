@@ -5,6 +5,8 @@
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
 #include "RoadGraph.h"
+#include "Rng.h"
+#include "CellularAutomaton.h"
 #include <QMap>
 
 using namespace std;
@@ -22,15 +24,17 @@ using namespace cv;
 class PMZoning : public Zoning {
 private:
 	vector<float> needs;
+	CellularAutomaton automaton;
+	vector<int> step_changes;		// 直前のupdate()で変化したセル
 
 public:
-	PMZoning(int city_size, int grid_size, vector<float>& zone_distribution, RoadGraph& roads);
+	PMZoning(int city_size, int grid_size, vector<float>& zone_distribution, const RoadSnapshotPtr& roads, int road_grid_size = 0);
 
-	void initialZoning(vector<float>& zone_distribution);
-	void update();
+	void initialZoning(vector<float>& zone_distribution, Rng& rng);
+	void update(Rng& rng);
+	void setNeedsMode(int mode) { automaton.setNeedsMode(mode); }
 
 private:
-	void computeMooreNeighborhood(int r, int c, vector<float>& neighbors, bool normalize);
 	float modifiedLogistic(float x, float h);
 };
 
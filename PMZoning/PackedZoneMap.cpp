@@ -0,0 +1,229 @@
+﻿#include "PackedZoneMap.h"
+#include <string.h>
+
+const int PackedZoneMap::NUM_TYPES;
+const uchar PackedZoneMap::TYPE_UNUSED;
+
+namespace {
+
+/**
+ * 8ビットの各ビットを、8バイトの各バイト (0または1) に展開する表。
+ * リトルエンディアンなら、ビットiはi番目のバイトになる。
+ */
+struct SpreadTable {
+	quint64 values[256];
+
+	SpreadTable() {
+		for (int v = 0; v < 256; ++v) {
+			uchar bytes[8];
+			for (int i = 0; i < 8; ++i) {
+				bytes[i] = (v >> i) & 1;
+			}
+			memcpy(&values[v], bytes, 8);
+		}
+	}
+};
+
+const SpreadTable spread_table;
+
+/**
+ * 全加算器。a + b + cの、和のビットと桁上げのビットを64セル分まとめて計算する。
+ */
+inline void fullAdd(quint64 a, quint64 b, quint64 c, quint64& sum, quint64& carry) {
+	quint64 t = a ^ b;
+	sum = t ^ c;
+	carry = (a & b) | (t & c);
+}
+
+}
+
+PackedZoneMap::PackedZoneMap() {
+	num_rows = 0;
+	num_cols = 0;
+	words_per_row = 0;
+}
+
+PackedZoneMap::PackedZoneMap(const Mat_<uchar>& zones) {
+	pack(zones);
+}
+
+/**
+ * ゾーンマップを詰めて格納する。
+ */
+void PackedZoneMap::pack(const Mat_<uchar>& zones) {
+	if (zones.isContinuous()) {
+		pack(zones.data, zones.rows, zones.cols);
+	} else {
+		Mat_<uchar> z = zones.clone();
+		pack(z.data, z.rows, z.cols);
+	}
+}
+
+/**
+ * ゾーンマップを詰めて格納する。
+ *
+ * @param zones		ゾーンマップ (rows * cols個の要素、行優先)
+ * @param rows		行数
+ * @param cols		列数
+ */
+void PackedZoneMap::pack(const uchar* zones, int rows, int cols) {
+	num_rows = rows;
+	num_cols = cols;
+	words_per_row = (cols + 63) / 64;
+
+	low_bits.assign((size_t)rows * words_per_row, 0);
+	high_bits.assign((size_t)rows * words_per_row, 0);
+	unused.clear();
+
+	for (int r = 0; r < rows; ++r) {
+		const uchar* in = zones + (size_t)r * cols;
+		quint64* low = &low_bits[(size_t)r * words_per_row];
+		quint64* high = &high_bits[(size_t)r * words_per_row];
+		for (int c = 0; c < cols; ++c) {
+			quint64 bit = (quint64)1 << (c & 63);
+			if (in[c] < NUM_TYPES) {
+				if (in[c] & 1) low[c >> 6] |= bit;
+				if (in[c] & 2) high[c >> 6] |= bit;
+			} else {
+				if (unused.empty()) unused.assign((size_t)rows * words_per_row, 0);
+				unused[(size_t)r * words_per_row + (c >> 6)] |= bit;
+			}
+		}
+	}
+}
+
+/**
+ * 1バイト/セルのゾーンマップに戻す。
+ */
+void PackedZoneMap::unpack(Mat_<uchar>& zones) const {
+	zones.create(num_rows, num_cols);
+	for (int r = 0; r < num_rows; ++r) {
+		uchar* out = zones[r];
+		for (int c = 0; c < num_cols; ++c) {
+			out[c] = (*this)(r, c);
+		}
+	}
+}
+
+Mat_<uchar> PackedZoneMap::zoneMap() const {
+	Mat_<uchar> zones;
+	unpack(zones);
+	return zones;
+}
+
+size_t PackedZoneMap::memorySize() const {
+	return (low_bits.size() + high_bits.size() + unused.size()) * sizeof(quint64);
+}
+
+uchar PackedZoneMap::operator()(int r, int c) const {
+	size_t w = (size_t)r * words_per_row + (c >> 6);
+	int shift = c & 63;
+	if (!unused.empty() && ((unused[w] >> shift) & 1)) return TYPE_UNUSED;
+	return (uchar)(((low_bits[w] >> shift) & 1) | (((high_bits[w] >> shift) & 1) << 1));
+}
+
+/**
+ * 指定した行の、指定したゾーンタイプのビットプレーンを返却する。
+ *
+ * @param type			ゾーンタイプ
+ * @param r				行番号
+ * @param bits [OUT]	words_per_row個のワード (タイプが一致するセルのビットが1)
+ */
+void PackedZoneMap::typeRow(int type, int r, quint64* bits) const {
+	const quint64* low = &low_bits[(size_t)r * words_per_row];
+	const quint64* high = &high_bits[(size_t)r * words_per_row];
+	const quint64* mask = unused.empty() ? NULL : &unused[(size_t)r * words_per_row];
+
+	quint64 low_xor = (type & 1) ? 0 : ~(quint64)0;
+	quint64 high_xor = (type & 2) ? 0 : ~(quint64)0;
+	int tail = num_cols & 63;
+	for (int w = 0; w < words_per_row; ++w) {
+		quint64 b = (low[w] ^ low_xor) & (high[w] ^ high_xor);
+		if (mask != NULL) b &= ~mask[w];
+		bits[w] = b;
+	}
+
+	// 行末の端数のビットは0にする
+	if (tail != 0) bits[words_per_row - 1] &= ((quint64)1 << tail) - 1;
+}
+
+/**
+ * typeRow()と同じだが、範囲外の行は全て0とする。
+ */
+void PackedZoneMap::typeRowOrZero(int type, int r, quint64* bits) const {
+	if (r < 0 || r >= num_rows) {
+		memset(bits, 0, words_per_row * sizeof(quint64));
+	} else {
+		typeRow(type, r, bits);
+	}
+}
+
+/**
+ * 指定した行の各セルについて、隣接8セルの各タイプの数を数える。
+ * グリッドの外側のセルと使用不可のセルは、数えない。
+ * 各ワードについて、上下の行と左右にずらしたワードの計8個のビット列を、
+ * 全加算器で4ビット (0～8) の数のビットスライスにまとめ、8セルずつ表引きでバイトに展開する。
+ *
+ * 行ごとに呼び出すので、3行分のビットプレーンの作業領域は呼び出し側で確保して使い回す。
+ *
+ * @param r					行番号
+ * @param counts [OUT]		counts[t][c]に、セルcの隣接セルのうちタイプtのものの数を格納する (cols個の要素)
+ * @param work				作業領域 (3 * wordsPerRow()個のワード)
+ */
+void PackedZoneMap::countNeighbors(int r, uchar* counts[NUM_TYPES], quint64* work) const {
+	quint64* rows[3] = { work, work + words_per_row, work + 2 * words_per_row };
+
+	for (int t = 0; t < NUM_TYPES; ++t) {
+		typeRowOrZero(t, r - 1, rows[0]);
+		typeRowOrZero(t, r, rows[1]);
+		typeRowOrZero(t, r + 1, rows[2]);
+
+		for (int w = 0; w < words_per_row; ++w) {
+			// 各行の、左隣 (c-1) と右隣 (c+1) のセルのビットを、セルcの位置にずらす
+			quint64 left[3], right[3];
+			for (int k = 0; k < 3; ++k) {
+				quint64 prev = w > 0 ? rows[k][w - 1] : 0;
+				quint64 next = w + 1 < words_per_row ? rows[k][w + 1] : 0;
+				left[k] = (rows[k][w] << 1) | (prev >> 63);
+				right[k] = (rows[k][w] >> 1) | (next << 63);
+			}
+
+			// 8個のビット列の和 (0～8) を、4つのビットスライスs0～s3に求める
+			quint64 a0, a1, b0, b1, c0, c1;
+			fullAdd(left[0], rows[0][w], right[0], a0, a1);
+			fullAdd(left[2], rows[2][w], right[2], b0, b1);
+			fullAdd(left[1], right[1], a0, c0, c1);
+			quint64 s0 = c0 ^ b0;
+			quint64 d1 = c0 & b0;
+
+			// 2の位: a1 + b1 + c1 + d1
+			quint64 e0, e1;
+			fullAdd(a1, b1, c1, e0, e1);
+			quint64 s1 = e0 ^ d1;
+			quint64 f1 = e0 & d1;
+
+			// 4の位: e1 + f1、8の位: その桁上げ
+			quint64 s2 = e1 ^ f1;
+			quint64 s3 = e1 & f1;
+
+			// 8セルずつ、ビットスライスをバイトに展開する
+			int c_begin = w * 64;
+			int c_end = min(num_cols, c_begin + 64);
+			uchar* out = counts[t];
+			for (int c = c_begin; c < c_end; c += 8) {
+				int shift = c - c_begin;
+				quint64 bytes = spread_table.values[(s0 >> shift) & 0xff]
+					| (spread_table.values[(s1 >> shift) & 0xff] << 1)
+					| (spread_table.values[(s2 >> shift) & 0xff] << 2)
+					| (spread_table.values[(s3 >> shift) & 0xff] << 3);
+				if (c + 8 <= c_end) {
+					memcpy(out + c, &bytes, 8);
+				} else {
+					uchar tmp[8];
+					memcpy(tmp, &bytes, 8);
+					memcpy(out + c, tmp, c_end - c);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <vector>
+#include <opencv/cv.h>
+#include <QtGlobal>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * ゾーンマップを、1セルあたり2ビット (+使用不可のマスク) に詰めて保持する。
+ *
+ * ゾーンタイプ (0～3) の下位ビットと上位ビットを、それぞれ別のビットプレーン (1行 = 64セル単位のワードの列) に格納する。
+ * TYPE_UNUSEDのセルは、3つ目のビットプレーンで表す (使用不可のセルがなければ、このプレーンは確保しない)。
+ * 1バイト/セルのMat_<uchar>の1/4 (使用不可のセルがある場合は3/8) のメモリで済む。
+ *
+ * 各ゾーンタイプのビットプレーンは、2つのビットプレーンのビット演算で1ワード (64セル) ずつ作れるので、
+ * 隣接8セルの各タイプの数も、ワード単位のシフトと桁上げ保存加算 (bit-sliced adder) で64セル分まとめて数える。
+ */
+class PackedZoneMap {
+public:
+	static const int NUM_TYPES = 4;
+	static const uchar TYPE_UNUSED = 9;
+
+private:
+	int num_rows;
+	int num_cols;
+	int words_per_row;
+	vector<quint64> low_bits;		// ゾーンタイプの下位ビット
+	vector<quint64> high_bits;		// ゾーンタイプの上位ビット
+	vector<quint64> unused;			// 使用不可のセル (使用不可のセルがなければ空)
+
+public:
+	PackedZoneMap();
+	PackedZoneMap(const Mat_<uchar>& zones);
+
+	void pack(const Mat_<uchar>& zones);
+	void pack(const uchar* zones, int rows, int cols);
+	void unpack(Mat_<uchar>& zones) const;
+	Mat_<uchar> zoneMap() const;
+
+	int rows() const { return num_rows; }
+	int cols() const { return num_cols; }
+	int wordsPerRow() const { return words_per_row; }
+	bool empty() const { return num_rows == 0; }
+	size_t memorySize() const;
+	uchar operator()(int r, int c) const;
+
+	void typeRow(int type, int r, quint64* bits) const;
+	void countNeighbors(int r, uchar* counts[NUM_TYPES], quint64* work) const;
+
+private:
+	void typeRowOrZero(int type, int r, quint64* bits) const;
+};
@@ -0,0 +1,109 @@
+﻿#include "PointGrid.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+PointGrid::PointGrid() {
+	min_x = min_y = 0.0f;
+	cell_size = 1.0f;
+	num_cols = num_rows = 1;
+	cell_start.assign(2, 0);
+}
+
+/**
+ * グリッドを構築する。
+ * セルの大きさは、1セルあたり平均points_per_cell個程度になるように決める。
+ *
+ * @param x					点のx座標
+ * @param y					点のy座標
+ * @param num_points		点の数
+ * @param points_per_cell	1セルあたりの点の数の目安
+ */
+void PointGrid::build(const float* x, const float* y, int num_points, int points_per_cell) {
+	cell_points.clear();
+	cell_x.clear();
+	cell_y.clear();
+	if (num_points == 0) {
+		min_x = min_y = 0.0f;
+		cell_size = 1.0f;
+		num_cols = num_rows = 1;
+		cell_start.assign(2, 0);
+		return;
+	}
+
+	min_x = min_y = numeric_limits<float>::max();
+	float max_x = -numeric_limits<float>::max();
+	float max_y = -numeric_limits<float>::max();
+	for (int i = 0; i < num_points; ++i) {
+		min_x = min(min_x, x[i]);
+		min_y = min(min_y, y[i]);
+		max_x = max(max_x, x[i]);
+		max_y = max(max_y, y[i]);
+	}
+
+	float width = max(max_x - min_x, 1.0f);
+	float height = max(max_y - min_y, 1.0f);
+	cell_size = sqrtf(width * height * points_per_cell / num_points);
+	cell_size = max(cell_size, max(width, height) / 4096.0f);
+	num_cols = (int)(width / cell_size) + 1;
+	num_rows = (int)(height / cell_size) + 1;
+
+	// 各セルの点の数を数えて、セルごとの先頭位置を決める
+	vector<int> cells(num_points);
+	cell_start.assign(num_cols * num_rows + 1, 0);
+	for (int i = 0; i < num_points; ++i) {
+		int c = min(num_cols - 1, (int)((x[i] - min_x) / cell_size));
+		int r = min(num_rows - 1, (int)((y[i] - min_y) / cell_size));
+		cells[i] = r * num_cols + c;
+		cell_start[cells[i] + 1]++;
+	}
+	for (int i = 0; i < num_cols * num_rows; ++i) {
+		cell_start[i + 1] += cell_start[i];
+	}
+
+	cell_points.resize(num_points);
+	cell_x.resize(num_points);
+	cell_y.resize(num_points);
+	vector<int> next(cell_start.begin(), cell_start.end() - 1);
+	for (int i = 0; i < num_points; ++i) {
+		int index = next[cells[i]]++;
+		cell_points[index] = i;
+		cell_x[index] = x[i];
+		cell_y[index] = y[i];
+	}
+}
+
+/**
+ * 指定した点を中心とする、一辺2*radiusの正方形に含まれる点を、番号の順に返却する。
+ *
+ * @param pt			中心
+ * @param radius		半径
+ * @param result [OUT]	点の番号
+ */
+void PointGrid::find(const QVector2D& pt, float radius, vector<int>& result) const {
+	result.clear();
+	if (cell_points.empty()) return;
+
+	float x0 = pt.x() - radius;
+	float x1 = pt.x() + radius;
+	float y0 = pt.y() - radius;
+	float y1 = pt.y() + radius;
+
+	float c0 = max(0.0f, floorf((x0 - min_x) / cell_size));
+	float c1 = min((float)(num_cols - 1), floorf((x1 - min_x) / cell_size));
+	float r0 = max(0.0f, floorf((y0 - min_y) / cell_size));
+	float r1 = min((float)(num_rows - 1), floorf((y1 - min_y) / cell_size));
+	if (c0 > c1 || r0 > r1) return;
+
+	for (int r = (int)r0; r <= (int)r1; ++r) {
+		for (int c = (int)c0; c <= (int)c1; ++c) {
+			int cell = r * num_cols + c;
+			for (int i = cell_start[cell]; i < cell_start[cell + 1]; ++i) {
+				if (cell_x[i] < x0 || cell_x[i] > x1 || cell_y[i] < y0 || cell_y[i] > y1) continue;
+				result.push_back(cell_points[i]);
+			}
+		}
+	}
+
+	sort(result.begin(), result.end());
+}
@@ -0,0 +1,31 @@
+﻿#pragma once
+
+#include <vector>
+#include <QVector2D>
+
+using namespace std;
+
+/**
+ * 点の一様グリッド。
+ * 指定した点を中心とする正方形と重なるセルの点を、番号の順に返却する。
+ * 構築後は読み出しだけなので、複数のスレッドから同時に検索してよい。
+ */
+class PointGrid {
+private:
+	float min_x, min_y;
+	float cell_size;
+	int num_cols;
+	int num_rows;
+	vector<int> cell_start;		// セルごとの先頭位置 (セル数+1)
+	vector<int> cell_points;	// セルの順に並べた点の番号
+	vector<float> cell_x;		// cell_pointsと同じ順のx座標
+	vector<float> cell_y;		// cell_pointsと同じ順のy座標
+
+public:
+	PointGrid();
+
+	void build(const float* x, const float* y, int num_points, int points_per_cell = 4);
+	float cellSize() const { return cell_size; }
+	int size() const { return cell_points.size(); }
+	void find(const QVector2D& pt, float radius, vector<int>& result) const;
+};
@@ -2,6 +2,16 @@
 #include "Polygon2D.h"
 #include "Polyline2D.h"
 #include "Util.h"
+#include <boost/version.hpp>
+
+// Boost 1.55から、transformerのテンプレート引数が、点の型から座標の型と次元に変わった
+#if BOOST_VERSION >= 105500
+typedef boost::geometry::strategy::transform::translate_transformer<float, 2, 2> TranslateTransformer;
+typedef boost::geometry::strategy::transform::rotate_transformer<boost::geometry::degree, float, 2, 2> RotateTransformer;
+#else
+typedef boost::geometry::strategy::transform::translate_transformer<QVector2D, QVector2D> TranslateTransformer;
+typedef boost::geometry::strategy::transform::rotate_transformer<QVector2D, QVector2D, boost::geometry::degree> RotateTransformer;
+#endif
 
 void Polygon2D::correct() {
 	boost::geometry::correct(*this);
@@ -79,7 +89,7 @@ void Polygon2D::translate(float x, float y) {
 	Polygon2D temp = *this;
 	this->clear();
 
-	boost::geometry::strategy::transform::translate_transformer<QVector2D, QVector2D> translate(x, y);
+	TranslateTransformer translate(x, y);
     boost::geometry::transform(temp, *this, translate);
 }
 
@@ -91,7 +101,7 @@ void Polygon2D::translate(float x, float y) {
  * @ret				the translated polygon
  */
 void Polygon2D::translate(float x, float y, Polygon2D &ret) const {
-	boost::geometry::strategy::transform::translate_transformer<QVector2D, QVector2D> translate(x, y);
+	TranslateTransformer translate(x, y);
     boost::geometry::transform(*this, ret, translate);
 }
 
@@ -104,7 +114,7 @@ void Polygon2D::rotate(float angle) {
 	Polygon2D temp = *this;
 	this->clear();
 
-	boost::geometry::strategy::transform::rotate_transformer<QVector2D, QVector2D, boost::geometry::degree> rotate(angle);
+	RotateTransformer rotate(angle);
     boost::geometry::transform(temp, *this, rotate);
 }
 
@@ -115,7 +125,7 @@ void Polygon2D::rotate(float angle) {
  * @ret				the rotated polygon
  */
 void Polygon2D::rotate(float angle, Polygon2D &ret) const {
-	boost::geometry::strategy::transform::rotate_transformer<QVector2D, QVector2D, boost::geometry::degree> rotate(angle);
+	RotateTransformer rotate(angle);
     boost::geometry::transform(*this, ret, rotate);
 }
 
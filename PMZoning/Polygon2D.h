@@ -21,7 +21,7 @@ public:
 	QVector2D centroid() const;
 	bool contains(const QVector2D &pt) const;
 	bool contains(const QVector2D &pt);
-	bool Polygon2D::contains(const Polygon2D &polygon) const;
+	bool contains(const Polygon2D &polygon) const;
 	Polygon2D convexHull() const;
 	BBox envelope() const;
 	bool intersects(const QVector2D& a, const QVector2D& b, QVector2D& intPt) const;
@@ -0,0 +1,190 @@
+﻿#include "Rng.h"
+#include <math.h>
+
+namespace {
+
+const uint32_t PHILOX_M0 = 0xD2511F53;
+const uint32_t PHILOX_M1 = 0xCD9E8D57;
+const uint32_t PHILOX_W0 = 0x9E3779B9;
+const uint32_t PHILOX_W1 = 0xBB67AE85;
+const int PHILOX_ROUNDS = 10;
+
+/** 32bit整数の上位24bitを、[0, 1)の浮動小数点に変換する */
+inline float toUniform(uint32_t x) {
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+}
+
+/**
+ * @param seed		シード
+ * @param stream	ストリーム番号（同じシードでも、ストリーム番号が違えば独立した系列となる）
+ */
+Rng::Rng(uint64_t seed, uint64_t stream) {
+	this->seed(seed, stream);
+}
+
+/**
+ * シードとストリーム番号を設定し、系列の先頭に戻る。
+ */
+void Rng::seed(uint64_t seed, uint64_t stream) {
+	key[0] = (uint32_t)seed;
+	key[1] = (uint32_t)(seed >> 32);
+	counter[0] = 0;
+	counter[1] = 0;
+	counter[2] = (uint32_t)stream;
+	counter[3] = (uint32_t)(stream >> 32);
+	buffer_pos = 4;
+	has_normal = false;
+	next_normal = 0.0f;
+}
+
+/**
+ * 32bitの乱数を返却する。
+ */
+uint32_t Rng::next() {
+	if (buffer_pos >= 4) {
+		generateBlock(buffer);
+		buffer_pos = 0;
+	}
+
+	return buffer[buffer_pos++];
+}
+
+/**
+ * Uniform乱数[0, 1)を生成する
+ */
+float Rng::uniform() {
+	return toUniform(next());
+}
+
+/**
+ * 指定された範囲[a, b)のUniform乱数を生成する
+ */
+float Rng::uniform(float a, float b) {
+	return uniform() * (b - a) + a;
+}
+
+/**
+ * [0, n)の整数乱数を生成する
+ */
+int Rng::uniformInt(int n) {
+	return (int)(((uint64_t)next() * (uint32_t)n) >> 32);
+}
+
+/**
+ * Normal distributionを使用して乱数を生成する。(Marsaglia polar method)
+ */
+float Rng::normal(float mean, float variance) {
+	float s = sqrtf(variance);
+
+	if (has_normal) {
+		has_normal = false;
+		return mean + next_normal * s;
+	}
+
+	float x1, x2, w;
+	do {
+		x1 = 2.0f * uniform() - 1.0f;
+		x2 = 2.0f * uniform() - 1.0f;
+		w = x1 * x1 + x2 * x2;
+	} while (w >= 1.0f || w == 0.0f);
+
+	w = sqrtf((-2.0f * logf(w)) / w);
+	next_normal = x2 * w;
+	has_normal = true;
+
+	return mean + x1 * w * s;
+}
+
+/**
+ * 指定された数のUniform乱数[0, 1)を、まとめて生成する。
+ * uniform()をnum回呼び出した場合と同じ系列となる。
+ *
+ * @param data [OUT]	乱数を格納する配列
+ * @param num			個数
+ */
+void Rng::fillUniform(float* data, int num) {
+	int i = 0;
+
+	// bufferに残っている分を先に使う
+	while (i < num && buffer_pos < 4) {
+		data[i++] = toUniform(buffer[buffer_pos++]);
+	}
+
+	// 4個単位で、直接生成する
+	uint32_t block[4];
+	for (; i + 4 <= num; i += 4) {
+		generateBlock(block);
+		data[i] = toUniform(block[0]);
+		data[i + 1] = toUniform(block[1]);
+		data[i + 2] = toUniform(block[2]);
+		data[i + 3] = toUniform(block[3]);
+	}
+
+	// 端数
+	for (; i < num; ++i) {
+		data[i] = uniform();
+	}
+}
+
+/**
+ * 行列全体を、Uniform乱数[0, 1)で埋める。
+ */
+void Rng::fillUniform(cv::Mat_<float>& data) {
+	if (data.isContinuous()) {
+		fillUniform((float*)data.data, data.rows * data.cols);
+	} else {
+		for (int r = 0; r < data.rows; ++r) {
+			fillUniform(data[r], data.cols);
+		}
+	}
+}
+
+/**
+ * プロセス全体で共有するデフォルトの乱数生成器を返却する。
+ * Util::genRand()など、乱数生成器を指定しない関数が使用する。スレッドセーフではない。
+ */
+Rng& Rng::global() {
+	static Rng rng;
+	return rng;
+}
+
+/**
+ * 現在のカウンタから4個の乱数を生成し、カウンタを進める。
+ */
+void Rng::generateBlock(uint32_t* out) {
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	uint32_t k0 = key[0], k1 = key[1];
+
+	for (int i = 0; i < PHILOX_ROUNDS; ++i) {
+		uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+		uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+		uint32_t hi0 = (uint32_t)(p0 >> 32), lo0 = (uint32_t)p0;
+		uint32_t hi1 = (uint32_t)(p1 >> 32), lo1 = (uint32_t)p1;
+
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+
+	incrementCounter();
+}
+
+/**
+ * カウンタの下位64bitを1つ進める。（上位64bitはストリーム番号）
+ */
+void Rng::incrementCounter() {
+	if (++counter[0] == 0) {
+		++counter[1];
+	}
+}
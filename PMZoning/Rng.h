@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include <stdint.h>
+#include <opencv/cv.h>
+
+/**
+ * Counter-basedの乱数生成器 (Philox4x32-10)。
+ * 状態は、64bitのシード(key)と128bitのカウンタだけなので、
+ * (シード, ストリーム番号)を指定すれば、どのスレッドからでも同じ系列を再現できる。
+ * 1つのインスタンスを複数のスレッドで共有してはいけない。スレッドごと、シミュレーションごとに作成すること。
+ */
+class Rng {
+private:
+	uint32_t key[2];
+	uint32_t counter[4];
+	uint32_t buffer[4];		// 最後に生成した4個の乱数
+	int buffer_pos;			// bufferの中の次に使う位置
+
+	// 正規乱数は2個ずつ生成されるので、2個目をとっておく
+	bool has_normal;
+	float next_normal;
+
+public:
+	Rng(uint64_t seed = 0, uint64_t stream = 0);
+
+	void seed(uint64_t seed, uint64_t stream = 0);
+	uint32_t next();
+	float uniform();
+	float uniform(float a, float b);
+	int uniformInt(int n);
+	float normal(float mean, float variance);
+
+	void fillUniform(float* data, int num);
+	void fillUniform(cv::Mat_<float>& data);
+
+	static Rng& global();
+
+private:
+	void generateBlock(uint32_t* out);
+	void incrementCounter();
+};
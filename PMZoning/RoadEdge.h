@@ -1,7 +1,7 @@
 #pragma once
 
 #include <vector>
-#include <Qvector2D>
+#include <QVector2D>
 #include <QHash>
 #include <QVariant>
 #include <QColor>
@@ -11,8 +11,8 @@
 
 class RoadEdge {
 public:
-	static enum { SHAPE_DEFAULT = 0, SHAPE_GRID, SHAPE_RADIAL, SHAPE_PLAZA };
-	static enum { TYPE_OTHERS = 0, TYPE_STREET = 1, TYPE_AVENUE = 2, TYPE_BOULEVARD = 4, TYPE_HIGHWAY = 8 };
+	enum { SHAPE_DEFAULT = 0, SHAPE_GRID, SHAPE_RADIAL, SHAPE_PLAZA };
+	enum { TYPE_OTHERS = 0, TYPE_STREET = 1, TYPE_AVENUE = 2, TYPE_BOULEVARD = 4, TYPE_HIGHWAY = 8 };
 
 public:
 	int type;
@@ -1,17 +1,211 @@
 ﻿#include "RoadGraph.h"
-#include <QGLWidget>
+#include "RoadGraphIndex.h"
 #include "GraphUtil.h"
 #include "Util.h"
 
 RoadGraph::RoadGraph() {
 	modified = false;
+	version = 0;
+	generation = 0;
+	num_dead_vertices = 0;
+	num_dead_edges = 0;
+	index_version = 0;
+	num_stale_queries = 0;
+}
+
+/**
+ * コピーする。
+ * 空間インデックスはコピー元のグラフのエッジを指しているので、コピーせずに作り直す。
+ */
+RoadGraph::RoadGraph(const RoadGraph& ref) : graph(ref.graph) {
+	modified = ref.modified;
+	version = 0;
+	generation = ref.generation;
+	num_dead_vertices = ref.num_dead_vertices;
+	num_dead_edges = ref.num_dead_edges;
+	index_version = 0;
+	num_stale_queries = 0;
 }
 
 RoadGraph::~RoadGraph() {
 }
 
+RoadGraph& RoadGraph::operator=(const RoadGraph& ref) {
+	if (this == &ref) return *this;
+
+	modified = ref.modified;
+	graph = ref.graph;
+	version++;
+	generation = ref.generation;
+	num_dead_vertices = ref.num_dead_vertices;
+	num_dead_edges = ref.num_dead_edges;
+	index.reset();
+	num_stale_queries = 0;
+
+	return *this;
+}
+
 void RoadGraph::clear() {
 	graph.clear();
-	modified = true;
+	num_dead_vertices = 0;
+	num_dead_edges = 0;
+	setModified();
+}
+
+/**
+ * 頂点を無効にする。無効な頂点の数は、compactIfNeeded()の判定に使う。
+ */
+void RoadGraph::invalidateVertex(RoadVertexDesc v) {
+	if (!graph[v]->valid) return;
+
+	graph[v]->valid = false;
+	num_dead_vertices++;
+}
+
+/**
+ * エッジを無効にする。無効なエッジの数は、compactIfNeeded()の判定に使う。
+ */
+void RoadGraph::invalidateEdge(RoadEdgeDesc e) {
+	if (!graph[e]->valid) return;
+
+	graph[e]->valid = false;
+	num_dead_edges++;
+}
+
+/**
+ * 無効にしたエッジを、有効に戻す。
+ */
+void RoadGraph::restoreEdge(RoadEdgeDesc e) {
+	if (graph[e]->valid) return;
+
+	graph[e]->valid = true;
+	if (num_dead_edges > 0) num_dead_edges--;
+}
+
+/**
+ * 無効な頂点・エッジを取り除いて、グラフを詰める。
+ * 無効な頂点につながるエッジも取り除く。頂点・エッジのオブジェクトはコピーせずに新しいグラフへ移すので、
+ * RoadVertexPtr / RoadEdgePtrはそのまま使えるが、頂点・エッジのdescriptorは全て変わる。
+ * 詰めるたびにgenerationが1つ増えるので、descriptorを保持する側は、getGeneration()で変化を検出できる。
+ *
+ * @param remap [OUT]	NULLでなければ、古い頂点番号から新しい頂点番号への対応を格納する (取り除いた頂点はnull_vertex())
+ * @return				取り除いた頂点・エッジがあればtrue
+ */
+bool RoadGraph::compact(std::vector<RoadVertexDesc>* remap) {
+	int num_vertices = boost::num_vertices(graph);
+
+	std::vector<RoadVertexDesc> conv(num_vertices, boost::graph_traits<BGLGraph>::null_vertex());
+	int num_valid_vertices = 0;
+	for (int i = 0; i < num_vertices; ++i) {
+		if (graph[i]->valid) conv[i] = num_valid_vertices++;
+	}
+
+	int num_valid_edges = 0;
+	RoadEdgeIter ei, eend;
+	for (boost::tie(ei, eend) = boost::edges(graph); ei != eend; ++ei) {
+		if (!graph[*ei]->valid) continue;
+		if (conv[boost::source(*ei, graph)] == boost::graph_traits<BGLGraph>::null_vertex()) continue;
+		if (conv[boost::target(*ei, graph)] == boost::graph_traits<BGLGraph>::null_vertex()) continue;
+		num_valid_edges++;
+	}
+
+	bool removed = num_valid_vertices < num_vertices || num_valid_edges < boost::num_edges(graph);
+	if (removed) {
+		BGLGraph compacted(num_valid_vertices);
+		for (int i = 0; i < num_vertices; ++i) {
+			if (conv[i] != boost::graph_traits<BGLGraph>::null_vertex()) compacted[conv[i]] = graph[i];
+		}
+		for (boost::tie(ei, eend) = boost::edges(graph); ei != eend; ++ei) {
+			if (!graph[*ei]->valid) continue;
+			RoadVertexDesc src = conv[boost::source(*ei, graph)];
+			RoadVertexDesc tgt = conv[boost::target(*ei, graph)];
+			if (src == boost::graph_traits<BGLGraph>::null_vertex() || tgt == boost::graph_traits<BGLGraph>::null_vertex()) continue;
+
+			std::pair<RoadEdgeDesc, bool> edge_pair = boost::add_edge(src, tgt, compacted);
+			compacted[edge_pair.first] = graph[*ei];
+		}
+
+		graph.swap(compacted);
+		generation++;
+		setModified();
+	}
+	num_dead_vertices = 0;
+	num_dead_edges = 0;
+
+	if (remap != NULL) remap->swap(conv);
+
+	return removed;
 }
 
+/**
+ * 無効な頂点・エッジの割合がmax_dead_ratioを超えている場合だけ、グラフを詰める。
+ * 判定は、invalidateVertex() / invalidateEdge()で数えた無効な数を使うので、O(1)である。
+ * 詰める処理はO(V+E)だが、無効な要素が全体のmax_dead_ratioを超えるまでは行わないので、
+ * 長い編集の途中で呼び出しても、無効化1回あたりの償却コストは定数となる。
+ * 詰めた場合は頂点・エッジのdescriptorが全て変わるので、descriptorを保持したまま呼び出さないこと。
+ *
+ * @param max_dead_ratio	無効な頂点・エッジの割合の上限
+ * @param remap [OUT]		compact()を参照 (詰めなかった場合は、恒等写像を格納する)
+ * @return					詰めた場合はtrue
+ */
+bool RoadGraph::compactIfNeeded(float max_dead_ratio, std::vector<RoadVertexDesc>* remap) {
+	int num_dead = num_dead_vertices + num_dead_edges;
+	int num_total = boost::num_vertices(graph) + boost::num_edges(graph);
+	if (num_dead > 0 && num_dead > num_total * max_dead_ratio) {
+		return compact(remap);
+	}
+
+	if (remap != NULL) {
+		remap->resize(boost::num_vertices(graph));
+		for (int i = 0; i < remap->size(); ++i) {
+			(*remap)[i] = i;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * 空間インデックスを返却する。
+ * setModified()の後は、同じ状態のまま2回目の検索が来た時に作り直し、1回目はNULLを返却する。
+ * これにより、変更と検索を交互に繰り返す処理 (スナップなど) では毎回作り直さずに全件走査となり、
+ * 変更せずに検索を繰り返す処理 (アクセシビリティの計算など) だけがインデックスを使う。
+ * NULLが返却された場合は、呼び出し側で全ての頂点・エッジを調べること。
+ *
+ * setModified()を呼ばずに頂点・エッジを追加・削除した場合も、数が変わるので作り直す。
+ * インデックスを作り直す可能性があるので、並列に呼び出す場合は、事前にbuildIndex()でインデックスを作っておくこと。
+ * その後、道路網を変更しなければ、getIndex()はインデックスを返却するだけである。
+ */
+const RoadGraphIndex* RoadGraph::getIndex() {
+	if (isIndexCurrent()) return index.get();
+
+	if (index_version != version) {
+		index.reset();
+		index_version = version;
+		num_stale_queries = 0;
+	}
+
+	if (++num_stale_queries < 2) return NULL;
+
+	return buildIndex();
+}
+
+/**
+ * 空間インデックスが現在の道路網に対して古ければ、すぐに作り直して返却する。
+ */
+const RoadGraphIndex* RoadGraph::buildIndex() {
+	if (isIndexCurrent()) return index.get();
+
+	index = boost::shared_ptr<RoadGraphIndex>(new RoadGraphIndex(*this));
+	index_version = version;
+	num_stale_queries = 0;
+
+	return index.get();
+}
+
+/**
+ * 空間インデックスが、現在の道路網に対して有効かどうか返却する。
+ */
+bool RoadGraph::isIndexCurrent() const {
+	return index && index_version == version && index->numVertices() == boost::num_vertices(graph) && index->numEdges() == boost::num_edges(graph);
+}
@@ -1,4 +1,4 @@
-#pragma once
+﻿#pragma once
 
 #include "common.h"
 #include <stdio.h>
@@ -19,18 +19,44 @@ typedef graph_traits<BGLGraph>::in_edge_iterator RoadInEdgeIter;
 typedef std::vector<RoadEdgeDesc> RoadEdgeDescs;
 typedef std::vector<RoadVertexDesc> RoadVertexDescs;
 
+class RoadGraphIndex;
+
 class RoadGraph {
 public:
 	bool modified;
 	BGLGraph graph;
 
+private:
+	unsigned int version;
+	unsigned int generation;
+	int num_dead_vertices;		// 無効にした頂点の数 (compact()で0に戻る)
+	int num_dead_edges;			// 無効にしたエッジの数 (compact()で0に戻る)
+	boost::shared_ptr<RoadGraphIndex> index;
+	unsigned int index_version;
+	int num_stale_queries;
+
 public:
 	RoadGraph();
+	RoadGraph(const RoadGraph& ref);
 	~RoadGraph();
+	RoadGraph& operator=(const RoadGraph& ref);
 
-	void setModified() { modified = true; }
+	void setModified() { modified = true; version++; }
 
 	void clear();
+	unsigned int getGeneration() const { return generation; }
+	void invalidateVertex(RoadVertexDesc v);
+	void invalidateEdge(RoadEdgeDesc e);
+	void restoreEdge(RoadEdgeDesc e);
+	int getNumDeadVertices() const { return num_dead_vertices; }
+	int getNumDeadEdges() const { return num_dead_edges; }
+	bool compact(std::vector<RoadVertexDesc>* remap = NULL);
+	bool compactIfNeeded(float max_dead_ratio = 0.5f, std::vector<RoadVertexDesc>* remap = NULL);
+	const RoadGraphIndex* getIndex();
+	const RoadGraphIndex* buildIndex();
+
+private:
+	bool isIndexCurrent() const;
 };
 
 typedef boost::shared_ptr<RoadGraph> RoadGraphPtr;
@@ -0,0 +1,308 @@
+﻿#include "RoadGraphIndex.h"
+#include <algorithm>
+#include <math.h>
+
+struct RoadGraphIndex::CompareCenterX {
+	bool operator()(const Node& a, const Node& b) const {
+		return a.min_x + a.max_x < b.min_x + b.max_x;
+	}
+};
+
+struct RoadGraphIndex::CompareCenterY {
+	bool operator()(const Node& a, const Node& b) const {
+		return a.min_y + a.max_y < b.min_y + b.max_y;
+	}
+};
+
+RoadGraphIndex::RoadGraphIndex(RoadGraph& roads) {
+	num_vertices = boost::num_vertices(roads.graph);
+	num_edges = boost::num_edges(roads.graph);
+
+	min_x = min_y = numeric_limits<float>::max();
+	max_x = max_y = -numeric_limits<float>::max();
+
+	buildVertexGrid(roads);
+	buildEdgeTree(roads);
+
+	if (min_x > max_x) {
+		min_x = max_x = min_y = max_y = 0.0f;
+	}
+}
+
+/**
+ * 指定した点を中心とする正方形が、全ての頂点・エッジを含む最小の半径を返却する。
+ */
+float RoadGraphIndex::coverRadius(const QVector2D& pt) const {
+	float dx = max(fabs(pt.x() - min_x), fabs(pt.x() - max_x));
+	float dy = max(fabs(pt.y() - min_y), fabs(pt.y() - max_y));
+	return max(dx, dy);
+}
+
+/**
+ * 指定した点を中心とする、一辺2*radiusの正方形と重なるセルの頂点を返却する。
+ * 頂点は、boost::verticesの列挙順に並べる。
+ *
+ * @param pt		中心
+ * @param radius	半径
+ * @param result [OUT]	頂点
+ */
+void RoadGraphIndex::findVertices(const QVector2D& pt, float radius, vector<RoadVertexDesc>& result) const {
+	result.clear();
+	if (pt.x() + radius < min_x || pt.x() - radius > max_x || pt.y() + radius < min_y || pt.y() - radius > max_y) return;
+
+	vector<int> ids;
+	grid.find(pt, radius, ids);
+	result.assign(ids.begin(), ids.end());
+}
+
+/**
+ * 指定した点を中心とする、一辺2*radiusの正方形とバウンディングボックスが重なるエッジを返却する。
+ * エッジは、boost::edgesの列挙順に並べる。
+ *
+ * @param pt		中心
+ * @param radius	半径
+ * @param result [OUT]	エッジ
+ */
+void RoadGraphIndex::findEdges(const QVector2D& pt, float radius, vector<RoadEdgeDesc>& result) const {
+	result.clear();
+	if (levels.empty()) return;
+
+	float x0 = pt.x() - radius;
+	float x1 = pt.x() + radius;
+	float y0 = pt.y() - radius;
+	float y1 = pt.y() + radius;
+
+	vector<int> ids;
+	vector<pair<int, int> > stack;
+	int top = levels.size() - 1;
+	for (int i = 0; i < levels[top].size(); ++i) {
+		stack.push_back(make_pair(top, i));
+	}
+
+	while (!stack.empty()) {
+		int level = stack.back().first;
+		const Node& node = levels[level][stack.back().second];
+		stack.pop_back();
+
+		if (node.max_x < x0 || node.min_x > x1 || node.max_y < y0 || node.min_y > y1) continue;
+
+		if (level == 0) {
+			ids.push_back(node.first);
+		} else {
+			for (int i = 0; i < node.count; ++i) {
+				stack.push_back(make_pair(level - 1, node.first + i));
+			}
+		}
+	}
+
+	sort(ids.begin(), ids.end());
+	result.resize(ids.size());
+	for (int i = 0; i < ids.size(); ++i) {
+		result[i] = edges[ids[i]];
+	}
+}
+
+/**
+ * 頂点のグリッドを構築する。
+ * セルの大きさは、1セルあたり平均4頂点程度になるように決める。
+ */
+void RoadGraphIndex::buildVertexGrid(RoadGraph& roads) {
+	vector<float> x(num_vertices);
+	vector<float> y(num_vertices);
+	RoadVertexIter vi, vend;
+	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
+		const QVector2D& pt = roads.graph[*vi]->pt;
+		x[*vi] = pt.x();
+		y[*vi] = pt.y();
+		min_x = min(min_x, pt.x());
+		min_y = min(min_y, pt.y());
+		max_x = max(max_x, pt.x());
+		max_y = max(max_y, pt.y());
+	}
+
+	grid.build(num_vertices > 0 ? &x[0] : NULL, num_vertices > 0 ? &y[0] : NULL, num_vertices, 4);
+}
+
+/**
+ * エッジのR-treeを構築する。
+ * エッジのバウンディングボックスは、polylineと両端の頂点を含むようにする。
+ */
+void RoadGraphIndex::buildEdgeTree(RoadGraph& roads) {
+	edges.reserve(num_edges);
+	levels.push_back(vector<Node>());
+	levels[0].reserve(num_edges);
+
+	RoadEdgeIter ei, eend;
+	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
+		const QVector2D& src = roads.graph[boost::source(*ei, roads.graph)]->pt;
+		const QVector2D& tgt = roads.graph[boost::target(*ei, roads.graph)]->pt;
+
+		Node node;
+		node.min_x = min(src.x(), tgt.x());
+		node.min_y = min(src.y(), tgt.y());
+		node.max_x = max(src.x(), tgt.x());
+		node.max_y = max(src.y(), tgt.y());
+		const Polyline2D& polyline = roads.graph[*ei]->polyline;
+		for (int i = 0; i < polyline.size(); ++i) {
+			node.min_x = min(node.min_x, polyline[i].x());
+			node.min_y = min(node.min_y, polyline[i].y());
+			node.max_x = max(node.max_x, polyline[i].x());
+			node.max_y = max(node.max_y, polyline[i].y());
+		}
+		node.first = edges.size();
+		node.count = 0;
+
+		min_x = min(min_x, node.min_x);
+		min_y = min(min_y, node.min_y);
+		max_x = max(max_x, node.max_x);
+		max_y = max(max_y, node.max_y);
+
+		edges.push_back(*ei);
+		levels[0].push_back(node);
+	}
+
+	if (edges.empty()) {
+		levels.clear();
+		return;
+	}
+
+	// 下の階層をタイル状に並べ替え、NODE_SIZE個ずつまとめて上の階層を作る
+	while (true) {
+		vector<Node>& children = levels.back();
+		sortTiles(children);
+		if (children.size() <= NODE_SIZE) break;
+
+		vector<Node> parents;
+		for (int i = 0; i < children.size(); i += NODE_SIZE) {
+			Node node = children[i];
+			node.first = i;
+			node.count = min((int)children.size() - i, (int)NODE_SIZE);
+			for (int j = 1; j < node.count; ++j) {
+				node.min_x = min(node.min_x, children[i + j].min_x);
+				node.min_y = min(node.min_y, children[i + j].min_y);
+				node.max_x = max(node.max_x, children[i + j].max_x);
+				node.max_y = max(node.max_y, children[i + j].max_y);
+			}
+			parents.push_back(node);
+		}
+		levels.push_back(parents);
+	}
+}
+
+/**
+ * STR (Sort-Tile-Recursive) 法の並べ替え。
+ * 中心のx座標で縦長のスラブに分け、各スラブの中を中心のy座標で並べる。
+ */
+void RoadGraphIndex::sortTiles(vector<Node>& nodes) {
+	int num_pages = (nodes.size() + NODE_SIZE - 1) / NODE_SIZE;
+	int num_slabs = (int)ceil(sqrt((double)num_pages));
+	int slab_size = num_slabs * NODE_SIZE;
+
+	sort(nodes.begin(), nodes.end(), CompareCenterX());
+	for (int i = 0; i < nodes.size(); i += slab_size) {
+		int end = min((int)nodes.size(), i + slab_size);
+		sort(nodes.begin() + i, nodes.begin() + end, CompareCenterY());
+	}
+}
+
+RoadGraphSearch::RoadGraphSearch(RoadGraph& roads, const QVector2D& pt, float max_radius) : roads(roads), pt(pt), max_radius(max_radius) {
+	index = roads.getIndex();
+	radius = 0.0f;
+	covered = false;
+}
+
+/**
+ * 探索半径を広げて、候補の頂点を返却する。
+ * これ以上広げる必要がない場合は、falseを返却する。
+ */
+bool RoadGraphSearch::nextVertices(vector<RoadVertexDesc>& candidates) {
+	if (!expand()) return false;
+
+	collectVertices(candidates);
+	return true;
+}
+
+/**
+ * 探索半径を広げて、候補のエッジを返却する。
+ * これ以上広げる必要がない場合は、falseを返却する。
+ */
+bool RoadGraphSearch::nextEdges(vector<RoadEdgeDesc>& candidates) {
+	if (!expand()) return false;
+
+	collectEdges(candidates);
+	return true;
+}
+
+/**
+ * max_radius以内の候補の頂点を、一度に返却する。
+ */
+void RoadGraphSearch::findVertices(vector<RoadVertexDesc>& candidates) {
+	radius = max_radius;
+	covered = true;
+	collectVertices(candidates);
+}
+
+/**
+ * max_radius以内の候補のエッジを、一度に返却する。
+ */
+void RoadGraphSearch::findEdges(vector<RoadEdgeDesc>& candidates) {
+	radius = max_radius;
+	covered = true;
+	collectEdges(candidates);
+}
+
+/**
+ * 距離distの円の内側を、全て探索済みかどうか返却する。
+ */
+bool RoadGraphSearch::covers(float dist) const {
+	return covered || dist <= radius;
+}
+
+/**
+ * 探索半径を、最初はグリッドのセルの大きさに、その後は倍々に広げる。
+ * 既に全体 (またはmax_radiusの円) を探索済みなら、falseを返却する。
+ */
+bool RoadGraphSearch::expand() {
+	if (covered) return false;
+
+	if (index == NULL) {
+		radius = max_radius;
+		covered = true;
+		return true;
+	}
+
+	radius = radius > 0.0f ? radius * 2.0f : index->cellSize();
+	if (radius >= max_radius) {
+		radius = max_radius;
+		covered = true;
+	}
+	if (radius >= index->coverRadius(pt)) covered = true;
+
+	return true;
+}
+
+void RoadGraphSearch::collectVertices(vector<RoadVertexDesc>& candidates) {
+	if (index != NULL) {
+		index->findVertices(pt, radius, candidates);
+		return;
+	}
+
+	candidates.clear();
+	RoadVertexIter vi, vend;
+	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
+		candidates.push_back(*vi);
+	}
+}
+
+void RoadGraphSearch::collectEdges(vector<RoadEdgeDesc>& candidates) {
+	if (index != NULL) {
+		index->findEdges(pt, radius, candidates);
+		return;
+	}
+
+	candidates.clear();
+	RoadEdgeIter ei, eend;
+	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
+		candidates.push_back(*ei);
+	}
+}
@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include <vector>
+#include <limits>
+#include <QVector2D>
+#include "RoadGraph.h"
+#include "PointGrid.h"
+
+using namespace std;
+
+/**
+ * 道路網の空間インデックス。
+ * 頂点は一様グリッドに、エッジはpolylineのバウンディングボックスをR-tree (STR法で一括構築) に登録する。
+ *
+ * 検索結果は、指定した点を中心とする正方形と重なる頂点・エッジ (円の候補のスーパーセット) なので、
+ * 正確な距離の判定は呼び出し側で行うこと。
+ * また、検索結果はboost::vertices / boost::edgesの列挙順に並べて返却するので、
+ * 全件走査と同じ順序で評価でき、距離が同じ場合の選ばれ方も全件走査と一致する。
+ *
+ * 構築時の道路網に対してのみ有効である。RoadGraph::getIndex()が、setModified()のたびに作り直す。
+ */
+class RoadGraphIndex {
+private:
+	struct Node {
+		float min_x, min_y, max_x, max_y;
+		int first;		// 子ノード (葉の場合はエッジ) の先頭
+		int count;		// 子ノードの数 (葉の場合は0)
+	};
+
+	struct CompareCenterX;
+	struct CompareCenterY;
+
+	static const int NODE_SIZE = 16;
+
+	// 頂点・エッジ全体のバウンディングボックス
+	float min_x, min_y, max_x, max_y;
+
+	// 頂点のグリッド
+	PointGrid grid;
+
+	// エッジのR-tree (levels[0]が葉、levels.back()が根)
+	vector<RoadEdgeDesc> edges;
+	vector<vector<Node> > levels;
+
+	int num_vertices;
+	int num_edges;
+
+public:
+	RoadGraphIndex(RoadGraph& roads);
+
+	int numVertices() const { return num_vertices; }
+	int numEdges() const { return num_edges; }
+	float cellSize() const { return grid.cellSize(); }
+	float coverRadius(const QVector2D& pt) const;
+
+	void findVertices(const QVector2D& pt, float radius, vector<RoadVertexDesc>& result) const;
+	void findEdges(const QVector2D& pt, float radius, vector<RoadEdgeDesc>& result) const;
+
+private:
+	void buildVertexGrid(RoadGraph& roads);
+	void buildEdgeTree(RoadGraph& roads);
+	static void sortTiles(vector<Node>& nodes);
+};
+
+/**
+ * 最近傍探索のために、探索半径を倍々に広げながら候補を列挙する。
+ * 使い方:
+ *   RoadGraphSearch search(roads, pt);
+ *   while (search.nextVertices(candidates)) {
+ *       (candidatesの中で最も近い頂点を探す)
+ *       if (search.covers(最短距離)) break;
+ *   }
+ *
+ * 道路網の変更直後でインデックスがない場合は、最初の呼び出しで全頂点・全エッジを返却する。
+ */
+class RoadGraphSearch {
+private:
+	RoadGraph& roads;
+	const RoadGraphIndex* index;
+	QVector2D pt;
+	float max_radius;
+	float radius;
+	bool covered;
+
+public:
+	RoadGraphSearch(RoadGraph& roads, const QVector2D& pt, float max_radius = numeric_limits<float>::max());
+
+	bool nextVertices(vector<RoadVertexDesc>& candidates);
+	bool nextEdges(vector<RoadEdgeDesc>& candidates);
+	void findVertices(vector<RoadVertexDesc>& candidates);
+	void findEdges(vector<RoadEdgeDesc>& candidates);
+	bool covers(float dist) const;
+
+private:
+	bool expand();
+	void collectVertices(vector<RoadVertexDesc>& candidates);
+	void collectEdges(vector<RoadEdgeDesc>& candidates);
+};
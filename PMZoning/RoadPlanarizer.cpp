@@ -0,0 +1,280 @@
+﻿#include "RoadPlanarizer.h"
+#include <algorithm>
+#include <math.h>
+#include "GraphUtil.h"
+#include "Util.h"
+
+/**
+ * エッジの番号、線分の番号、線分上の位置の順に並べる。
+ */
+struct RoadPlanarizer::CompareCrossing {
+	bool operator()(const Crossing& a, const Crossing& b) const {
+		if (a.edge1 != b.edge1) return a.edge1 < b.edge1;
+		if (a.index1 != b.index1) return a.index1 < b.index1;
+		if (a.t1 != b.t1) return a.t1 < b.t1;
+		if (a.edge2 != b.edge2) return a.edge2 < b.edge2;
+		if (a.index2 != b.index2) return a.index2 < b.index2;
+		return a.t2 < b.t2;
+	}
+};
+
+/**
+ * 1本のエッジ上の交点を、polylineに沿った順に並べる。(線分の番号, 線分上の位置, 交点)
+ */
+struct RoadPlanarizer::ComparePosition {
+	bool operator()(const pair<pair<int, float>, int>& a, const pair<pair<int, float>, int>& b) const {
+		return a.first < b.first;
+	}
+};
+
+RoadPlanarizer::RoadPlanarizer(RoadGraph& roads, float margin) : roads(roads), margin(margin) {
+}
+
+/**
+ * 全ての交差を見つけて、交点で道路を分割する。
+ *
+ * @return			追加した交点の数
+ */
+int RoadPlanarizer::planarify() {
+	collectSegments();
+	findCrossings();
+	selectCrossings();
+	splitEdges();
+
+	return crossings.size();
+}
+
+/**
+ * 有効なエッジのpolylineを、線分に分解する。
+ */
+void RoadPlanarizer::collectSegments() {
+	RoadEdgeIter ei, eend;
+	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
+		RoadEdgePtr edge = roads.graph[*ei];
+		if (!edge->valid) continue;
+		if (edge->polyline.size() < 2) continue;
+
+		int edge_id = edges.size();
+		edges.push_back(*ei);
+		edge_src.push_back(boost::source(*ei, roads.graph));
+		edge_tgt.push_back(boost::target(*ei, roads.graph));
+
+		for (int i = 0; i < edge->polyline.size() - 1; ++i) {
+			Segment segment;
+			segment.edge = edge_id;
+			segment.index = i;
+			segment.a = edge->polyline[i];
+			segment.b = edge->polyline[i + 1];
+			segments.push_back(segment);
+		}
+	}
+}
+
+/**
+ * 線分を一様グリッドに登録し、同じセルの線分同士の交差を調べる。
+ * 同じ交差を複数のセルで数えないよう、2つの線分の範囲が重なるセルのうち、左上のセルでのみ調べる。
+ */
+void RoadPlanarizer::findCrossings() {
+	if (segments.empty()) return;
+
+	float min_x = numeric_limits<float>::max();
+	float min_y = numeric_limits<float>::max();
+	float max_x = -numeric_limits<float>::max();
+	float max_y = -numeric_limits<float>::max();
+	float total_length = 0.0f;
+	for (int i = 0; i < segments.size(); ++i) {
+		min_x = min(min_x, min(segments[i].a.x(), segments[i].b.x()));
+		min_y = min(min_y, min(segments[i].a.y(), segments[i].b.y()));
+		max_x = max(max_x, max(segments[i].a.x(), segments[i].b.x()));
+		max_y = max(max_y, max(segments[i].a.y(), segments[i].b.y()));
+		total_length += (segments[i].b - segments[i].a).length();
+	}
+
+	// セルの大きさは平均の線分長の2倍とし、セル数が線分数の4倍を超えないようにする
+	int num_segments = segments.size();
+	float width = max(max_x - min_x, 1.0f);
+	float height = max(max_y - min_y, 1.0f);
+	float cell_size = max(total_length / num_segments * 2.0f, 1.0f);
+	cell_size = max(cell_size, sqrtf(width * height / (4.0f * num_segments)));
+	int num_cols = (int)(width / cell_size) + 1;
+	int num_rows = (int)(height / cell_size) + 1;
+	int num_cells = num_cols * num_rows;
+
+	// 各線分を、バウンディングボックスが重なるセルに登録する (1回目で数を数え、2回目で登録する)
+	vector<Range> ranges(num_segments);
+	for (int i = 0; i < num_segments; ++i) {
+		ranges[i].c0 = (int)((min(segments[i].a.x(), segments[i].b.x()) - min_x) / cell_size);
+		ranges[i].c1 = (int)((max(segments[i].a.x(), segments[i].b.x()) - min_x) / cell_size);
+		ranges[i].r0 = (int)((min(segments[i].a.y(), segments[i].b.y()) - min_y) / cell_size);
+		ranges[i].r1 = (int)((max(segments[i].a.y(), segments[i].b.y()) - min_y) / cell_size);
+	}
+
+	vector<int> cell_start(num_cells + 1, 0);
+	for (int i = 0; i < num_segments; ++i) {
+		for (int r = ranges[i].r0; r <= ranges[i].r1; ++r) {
+			for (int c = ranges[i].c0; c <= ranges[i].c1; ++c) {
+				cell_start[r * num_cols + c + 1]++;
+			}
+		}
+	}
+	for (int i = 0; i < num_cells; ++i) {
+		cell_start[i + 1] += cell_start[i];
+	}
+
+	vector<int> cell_segments(cell_start[num_cells]);
+	vector<int> next(cell_start.begin(), cell_start.end() - 1);
+	for (int i = 0; i < num_segments; ++i) {
+		for (int r = ranges[i].r0; r <= ranges[i].r1; ++r) {
+			for (int c = ranges[i].c0; c <= ranges[i].c1; ++c) {
+				cell_segments[next[r * num_cols + c]++] = i;
+			}
+		}
+	}
+
+	// セルごとに、線分のペアの交差を調べる
+#pragma omp parallel
+	{
+		vector<Crossing> found;
+
+#pragma omp for schedule(dynamic, 64)
+		for (int cell = 0; cell < num_cells; ++cell) {
+			for (int k1 = cell_start[cell]; k1 < cell_start[cell + 1]; ++k1) {
+				const Segment& s1 = segments[cell_segments[k1]];
+				const Range& range1 = ranges[cell_segments[k1]];
+
+				for (int k2 = k1 + 1; k2 < cell_start[cell + 1]; ++k2) {
+					const Segment& s2 = segments[cell_segments[k2]];
+					const Range& range2 = ranges[cell_segments[k2]];
+
+					// 同じエッジ同士や、端点を共有するエッジ同士は、交差させない
+					if (s1.edge == s2.edge) continue;
+					if (edge_src[s1.edge] == edge_src[s2.edge] || edge_src[s1.edge] == edge_tgt[s2.edge] || edge_tgt[s1.edge] == edge_src[s2.edge] || edge_tgt[s1.edge] == edge_tgt[s2.edge]) continue;
+
+					if (range1.c1 < range2.c0 || range2.c1 < range1.c0 || range1.r1 < range2.r0 || range2.r1 < range1.r0) continue;
+
+					// 2つの線分の範囲が重なるセルのうち、左上のセルでのみ調べる
+					// (交点の座標からセルを求めると、グリッドの線上の交点が、丸め誤差で一方の線分しか登録されていないセルになり、失われることがある)
+					if (max(range1.r0, range2.r0) * num_cols + max(range1.c0, range2.c0) != cell) continue;
+
+					float tab, tcd;
+					QVector2D intPt;
+					if (!Util::segmentSegmentIntersectXY(s1.a, s1.b, s2.a, s2.b, &tab, &tcd, true, intPt)) continue;
+
+					Crossing crossing;
+					crossing.edge1 = s1.edge;
+					crossing.index1 = s1.index;
+					crossing.t1 = tab;
+					crossing.edge2 = s2.edge;
+					crossing.index2 = s2.index;
+					crossing.t2 = tcd;
+					crossing.pt = intPt;
+					found.push_back(crossing);
+				}
+			}
+		}
+
+#pragma omp critical(planarizer_crossings)
+		crossings.insert(crossings.end(), found.begin(), found.end());
+	}
+
+	// スレッドの実行順によらず同じ結果になるよう、エッジの順に並べる
+	sort(crossings.begin(), crossings.end(), CompareCrossing());
+}
+
+/**
+ * 採用する交点を選ぶ。
+ * エッジの端点や、同じエッジ上で既に採用した交点からmargin未満の交点は、採用しない。
+ */
+void RoadPlanarizer::selectCrossings() {
+	vector<vector<QVector2D> > accepted(edges.size());
+
+	vector<Crossing> selected;
+	for (int i = 0; i < crossings.size(); ++i) {
+		const Crossing& crossing = crossings[i];
+
+		// エッジの端、ぎりぎりで、交差する場合は、交差させない
+		if (nearEndpoint(crossing.edge1, crossing.pt) || nearEndpoint(crossing.edge2, crossing.pt)) continue;
+
+		bool too_close = false;
+		for (int j = 0; j < accepted[crossing.edge1].size() && !too_close; ++j) {
+			if ((accepted[crossing.edge1][j] - crossing.pt).length() < margin) too_close = true;
+		}
+		for (int j = 0; j < accepted[crossing.edge2].size() && !too_close; ++j) {
+			if ((accepted[crossing.edge2][j] - crossing.pt).length() < margin) too_close = true;
+		}
+		if (too_close) continue;
+
+		accepted[crossing.edge1].push_back(crossing.pt);
+		accepted[crossing.edge2].push_back(crossing.pt);
+		selected.push_back(crossing);
+	}
+
+	crossings.swap(selected);
+}
+
+/**
+ * 交点を頂点として登録し、交点を持つエッジを交点で分割する。
+ * 分割後のエッジは、splitEdgeと同様に元のエッジの属性を引き継ぎ、元のエッジは無効にする。
+ */
+void RoadPlanarizer::splitEdges() {
+	if (crossings.empty()) return;
+
+	// 各エッジ上の交点を、polylineに沿った順に並べる
+	vector<vector<pair<pair<int, float>, int> > > positions(edges.size());
+	for (int i = 0; i < crossings.size(); ++i) {
+		crossings[i].v = GraphUtil::addVertex(roads, RoadVertexPtr(new RoadVertex(crossings[i].pt)));
+		positions[crossings[i].edge1].push_back(make_pair(make_pair(crossings[i].index1, crossings[i].t1), i));
+		positions[crossings[i].edge2].push_back(make_pair(make_pair(crossings[i].index2, crossings[i].t2), i));
+	}
+
+	for (int e = 0; e < edges.size(); ++e) {
+		if (positions[e].empty()) continue;
+		sort(positions[e].begin(), positions[e].end(), ComparePosition());
+
+		RoadEdgePtr edge = roads.graph[edges[e]];
+		const Polyline2D& polyline = edge->polyline;
+
+		// polylineの出発点に近い方の頂点から、順に分割していく
+		RoadVertexDesc start = edge_src[e];
+		RoadVertexDesc end = edge_tgt[e];
+		if ((polyline[0] - roads.graph[edge_src[e]]->pt).lengthSquared() >= (polyline[0] - roads.graph[edge_tgt[e]]->pt).lengthSquared()) {
+			swap(start, end);
+		}
+
+		RoadEdgePtr piece = RoadEdgePtr(new RoadEdge(*edge));
+		piece->polyline.clear();
+		piece->addPoint(polyline[0]);
+
+		int k = 0;
+		for (int i = 0; i < polyline.size() - 1; ++i) {
+			bool split = false;
+			for (; k < positions[e].size() && positions[e][k].first.first == i; ++k) {
+				const Crossing& crossing = crossings[positions[e][k].second];
+				piece->addPoint(crossing.pt);
+				GraphUtil::addEdge(roads, start, crossing.v, piece);
+
+				start = crossing.v;
+				piece = RoadEdgePtr(new RoadEdge(*edge));
+				piece->polyline.clear();
+				piece->addPoint(crossing.pt);
+				split = true;
+			}
+
+			// 交点とほぼ同じ位置の点は、追加しない
+			if (split && i + 1 < polyline.size() - 1 && (polyline[i + 1] - piece->polyline.back()).lengthSquared() <= 1.0f) continue;
+			piece->addPoint(polyline[i + 1]);
+		}
+		GraphUtil::addEdge(roads, start, end, piece);
+
+		roads.invalidateEdge(edges[e]);
+	}
+}
+
+/**
+ * 指定した点が、エッジの端点からmargin未満かどうか返却する。
+ */
+bool RoadPlanarizer::nearEndpoint(int edge, const QVector2D& pt) const {
+	if ((roads.graph[edge_src[edge]]->pt - pt).length() < margin) return true;
+	if ((roads.graph[edge_tgt[edge]]->pt - pt).length() < margin) return true;
+	return false;
+}
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include <vector>
+#include <QVector2D>
+#include "RoadGraph.h"
+
+using namespace std;
+
+/**
+ * 道路網を平面グラフにする。
+ * 全てのエッジのpolylineの線分を一様グリッドに登録し、同じセルに入る線分同士だけを調べて、
+ * 全ての交差を一度に見つける。見つけた交差は、まとめて頂点として登録し、エッジを分割する。
+ *
+ * 交点がエッジの端点からmargin未満の場合は、交差させない (GraphUtil::planarifyOneと同じ規則)。
+ * また、同じエッジ上で、既に採用した交点からmargin未満の交点も採用しない。
+ */
+class RoadPlanarizer {
+private:
+	struct Segment {
+		int edge;			// edgesのインデックス
+		int index;			// polylineの何番目の線分か
+		QVector2D a, b;
+	};
+
+	struct Range {
+		int c0, c1;			// 重なるセルの列の範囲
+		int r0, r1;			// 重なるセルの行の範囲
+	};
+
+	struct Crossing {
+		int edge1, index1;
+		float t1;			// edge1の線分上の位置 (0～1)
+		int edge2, index2;
+		float t2;			// edge2の線分上の位置 (0～1)
+		QVector2D pt;
+		RoadVertexDesc v;
+	};
+
+	struct CompareCrossing;
+	struct ComparePosition;
+
+	RoadGraph& roads;
+	float margin;
+	vector<RoadEdgeDesc> edges;
+	vector<RoadVertexDesc> edge_src;
+	vector<RoadVertexDesc> edge_tgt;
+	vector<Segment> segments;
+	vector<Crossing> crossings;
+
+public:
+	RoadPlanarizer(RoadGraph& roads, float margin = 10.0f);
+
+	int planarify();
+
+private:
+	void collectSegments();
+	void findCrossings();
+	void selectCrossings();
+	void splitEdges();
+	bool nearEndpoint(int edge, const QVector2D& pt) const;
+};
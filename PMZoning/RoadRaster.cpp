@@ -0,0 +1,403 @@
+﻿#include "RoadRaster.h"
+#include "RoadSnapshot.h"
+#include "DistanceTransform.h"
+#include "ModifiedBrushFire.h"
+#include <list>
+#include <map>
+#include <limits>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * キャッシュのキー。
+ * ハッシュの衝突に備えて、エッジ数とpolylineの点の数も比較する。
+ */
+struct RoadRaster::Key {
+	quint64 hash;
+	int num_edges;
+	int num_points;
+	int city_size;
+	int grid_size;
+	int road_types;
+	int distance_backend;
+	int source_grid_size;
+
+	bool operator<(const Key& ref) const {
+		if (hash != ref.hash) return hash < ref.hash;
+		if (num_edges != ref.num_edges) return num_edges < ref.num_edges;
+		if (num_points != ref.num_points) return num_points < ref.num_points;
+		if (city_size != ref.city_size) return city_size < ref.city_size;
+		if (grid_size != ref.grid_size) return grid_size < ref.grid_size;
+		if (road_types != ref.road_types) return road_types < ref.road_types;
+		if (distance_backend != ref.distance_backend) return distance_backend < ref.distance_backend;
+		return source_grid_size < ref.source_grid_size;
+	}
+};
+
+/**
+ * 計算中のマップの目印。
+ * 計算するスレッドがロックを持ち、同じマップを必要とする他のスレッドは、ロックが解放されるのを待つ。
+ */
+class RoadRaster::Pending {
+#ifdef _OPENMP
+private:
+	omp_lock_t lock;
+
+public:
+	/** 計算するスレッドで作成する (作成したスレッドがロックを持つ) */
+	Pending() { omp_init_lock(&lock); omp_set_lock(&lock); }
+	~Pending() { omp_destroy_lock(&lock); }
+
+	void finish() { omp_unset_lock(&lock); }
+	void wait() { omp_set_lock(&lock); omp_unset_lock(&lock); }
+#else
+public:
+	void finish() {}
+	void wait() {}
+#endif
+};
+
+/**
+ * LRUのキャッシュ。listの先頭が最も最近使われたもの。
+ */
+class RoadRaster::Cache {
+public:
+	typedef list<pair<Key, RoadRasterPtr> > List;
+
+	List entries;
+	map<Key, List::iterator> lookup;
+	map<Key, boost::shared_ptr<Pending> > pending;		// 計算中のマップ
+	size_t total_size;
+	size_t budget;
+
+public:
+	Cache() : total_size(0), budget(256 * 1024 * 1024) {}
+
+	/**
+	 * 合計サイズが上限以下になるまで、最も長く使われていないものから破棄する。
+	 * 最も最近使われたものは、上限を超えていても残す。
+	 */
+	void evict() {
+		while (total_size > budget && entries.size() > 1) {
+			total_size -= entries.back().second->memorySize();
+			lookup.erase(entries.back().first);
+			entries.pop_back();
+		}
+	}
+};
+
+RoadRaster::Cache& RoadRaster::cache() {
+	static Cache instance;
+	return instance;
+}
+
+namespace {
+
+/**
+ * Liang-Barskyのクリッピングの1辺分。
+ */
+bool clipEdge(float p, float q, float& t0, float& t1) {
+	if (p == 0.0f) return q >= 0.0f;
+
+	float t = q / p;
+	if (p < 0.0f) {
+		if (t > t1) return false;
+		if (t > t0) t0 = t;
+	} else {
+		if (t < t0) return false;
+		if (t < t1) t1 = t;
+	}
+	return true;
+}
+
+}
+
+/**
+ * 道路をグリッドに描画し、距離マップとaccessibilityのマップを計算する。
+ * 道路は、polylineの各線分が通る全てのセル (supercover) を、DDAで辿って描画する。
+ *
+ * @param roads				道路網
+ * @param city_size			cityの一辺の距離 [m]
+ * @param grid_size			グリッドの一辺のサイズ
+ * @param road_types		描画する道路のタイプ (RoadEdge::TYPE_XXXの論理和)
+ * @param distance_backend	距離マップのバックエンド (distancetransform::BACKEND_XXX)
+ */
+RoadRaster::RoadRaster(const RoadSnapshot& roads, int city_size, int grid_size, int road_types, int distance_backend) {
+	this->city_size = city_size;
+	this->grid_size = grid_size;
+	this->road_types = road_types;
+
+	mask = cv::Mat_<uchar>::zeros(grid_size, grid_size);
+	for (int e = 0; e < roads.numEdges(); ++e) {
+		if (!(roads.edgeType(e) & road_types)) continue;
+
+		int num_points = roads.polylineSize(e);
+		if (num_points == 1) {
+			QVector2D pt = cityToGrid(roads.polylinePt(e, 0));
+			drawSegment(mask, pt, pt);
+		}
+		for (int i = 0; i < num_points - 1; ++i) {
+			drawSegment(mask, cityToGrid(roads.polylinePt(e, i)), cityToGrid(roads.polylinePt(e, i + 1)));
+		}
+	}
+
+	// 距離マップを計算する
+	// 道路は変化しないので、差分更新用のbrushfireは必要ない
+	cv::Mat_<float> dists;
+	if (distance_backend == distancetransform::BACKEND_EXACT_EDT) {
+		distancetransform::computeEDT(mask, dists);
+	} else {
+		modifiedbrushfire::ModifiedBrushFire bf(grid_size, grid_size, mask);
+		dists = bf.distMap();
+	}
+
+	// グリッドサイズを実際の距離に変換し、減衰させる
+	// (距離係数: この距離離れると、accessibilityが半減するというイメージ)
+	distances = cv::Mat_<float>(grid_size, grid_size);
+	accessibility = cv::Mat_<float>(grid_size, grid_size);
+	for (int r = 0; r < grid_size; ++r) {
+		for (int c = 0; c < grid_size; ++c) {
+			distances(r, c) = dists(r, c) / (float)grid_size * city_size;
+			accessibility(r, c) = 1.0 / (1.0 + distances(r, c) / 50.0f);
+		}
+	}
+}
+
+/**
+ * 細かいグリッドのマップを縮小して、粗いグリッドのマップを作る。
+ * 道路を描画し直さないので、多重解像度の各レベルで、同じ道路のマップを使える。
+ * マスクは、対応する細かいセルのどれかが道路なら1とする。
+ * 距離マップは、対応する細かいセルの平均とする (ただし、道路のセルは0)。
+ *
+ * @param finer			細かいグリッドのマップ
+ * @param grid_size		グリッドの一辺のサイズ (finerより小さいこと)
+ */
+RoadRaster::RoadRaster(const RoadRaster& finer, int grid_size) {
+	this->city_size = finer.city_size;
+	this->grid_size = grid_size;
+	this->road_types = finer.road_types;
+
+	mask = cv::Mat_<uchar>::zeros(grid_size, grid_size);
+	for (int r = 0; r < finer.grid_size; ++r) {
+		for (int c = 0; c < finer.grid_size; ++c) {
+			if (finer.mask(r, c)) mask(r * grid_size / finer.grid_size, c * grid_size / finer.grid_size) = 1;
+		}
+	}
+
+	cv::resize(finer.distances, distances, cv::Size(grid_size, grid_size), 0, 0, cv::INTER_AREA);
+	accessibility = cv::Mat_<float>(grid_size, grid_size);
+	for (int r = 0; r < grid_size; ++r) {
+		for (int c = 0; c < grid_size; ++c) {
+			if (mask(r, c)) distances(r, c) = 0.0f;
+			accessibility(r, c) = 1.0 / (1.0 + distances(r, c) / 50.0f);
+		}
+	}
+}
+
+size_t RoadRaster::memorySize() const {
+	return (size_t)grid_size * grid_size * (sizeof(uchar) + sizeof(float) * 2);
+}
+
+/**
+ * キャッシュから、指定した道路網・グリッド・道路のタイプのマップを取得する。
+ * キャッシュにない場合は計算して登録する。
+ * 複数のスレッドから同時に呼び出してよい。計算はキャッシュのロックの外で行うので、
+ * 他のキーを取得するスレッドは待たない。同じキーを計算中の場合は、計算が終わるのを待つ。
+ *
+ * @param roads				道路網
+ * @param city_size			cityの一辺の距離 [m]
+ * @param grid_size			グリッドの一辺のサイズ
+ * @param road_types		道路のタイプ (RoadEdge::TYPE_XXXの論理和)
+ * @param distance_backend	距離マップのバックエンド (distancetransform::BACKEND_XXX)
+ * @param source_grid_size	grid_sizeより大きければ、このグリッドサイズのマップを縮小して作る (0なら道路を直接描画する)
+ * @return					マップ
+ */
+RoadRasterPtr RoadRaster::get(const RoadSnapshot& roads, int city_size, int grid_size, int road_types, int distance_backend, int source_grid_size) {
+	// 縮小元のマップは、critical sectionに入る前に取得しておく
+	RoadRasterPtr finer;
+	if (source_grid_size > grid_size) {
+		finer = get(roads, city_size, source_grid_size, road_types, distance_backend);
+	} else {
+		source_grid_size = 0;
+	}
+
+	Key key;
+	key.hash = roads.contentHash();
+	key.num_edges = roads.numEdges();
+	key.num_points = roads.numPolylinePoints();
+	key.city_size = city_size;
+	key.grid_size = grid_size;
+	key.road_types = road_types;
+	key.distance_backend = distance_backend;
+	key.source_grid_size = source_grid_size;
+
+	RoadRasterPtr ret;
+	while (true) {
+		// キャッシュの検索と登録だけをcritical sectionで行い、計算はその外で行う
+		boost::shared_ptr<Pending> waiting;
+		boost::shared_ptr<Pending> building;
+
+#pragma omp critical(road_raster_cache)
+		{
+			Cache& c = cache();
+			map<Key, Cache::List::iterator>::iterator it = c.lookup.find(key);
+			if (it != c.lookup.end()) {
+				// 最も最近使われたものとして、先頭に移す
+				c.entries.splice(c.entries.begin(), c.entries, it->second);
+				ret = it->second->second;
+			} else {
+				map<Key, boost::shared_ptr<Pending> >::iterator pit = c.pending.find(key);
+				if (pit != c.pending.end()) {
+					waiting = pit->second;
+				} else {
+					building = boost::shared_ptr<Pending>(new Pending());
+					c.pending[key] = building;
+				}
+			}
+		}
+
+		if (ret) break;
+
+		// 他のスレッドが計算中なら、終わるのを待ってから検索し直す
+		if (waiting) {
+			waiting->wait();
+			continue;
+		}
+
+		if (finer) {
+			ret = RoadRasterPtr(new RoadRaster(*finer, grid_size));
+		} else {
+			ret = RoadRasterPtr(new RoadRaster(roads, city_size, grid_size, road_types, distance_backend));
+		}
+
+#pragma omp critical(road_raster_cache)
+		{
+			Cache& c = cache();
+			c.entries.push_front(make_pair(key, ret));
+			c.lookup[key] = c.entries.begin();
+			c.total_size += ret->memorySize();
+			c.evict();
+			c.pending.erase(key);
+		}
+		building->finish();
+		break;
+	}
+
+	return ret;
+}
+
+/**
+ * キャッシュの合計サイズの上限を設定する。
+ * キャッシュから破棄しても、使用中のZoningのマップはそのまま使える。
+ *
+ * @param bytes		上限 [byte]
+ */
+void RoadRaster::setCacheBudget(size_t bytes) {
+#pragma omp critical(road_raster_cache)
+	{
+		cache().budget = bytes;
+		cache().evict();
+	}
+}
+
+/**
+ * キャッシュを空にする。
+ */
+void RoadRaster::clearCache() {
+#pragma omp critical(road_raster_cache)
+	{
+		cache().entries.clear();
+		cache().lookup.clear();
+		cache().total_size = 0;
+	}
+}
+
+/**
+ * グリッド座標の線分が通る全てのセルを、マスクに描画する。
+ * 線分をグリッドの範囲でクリップしてから、セルの境界を越えるたびに隣のセルへ進む。
+ * セルの角をちょうど通る場合は、角を共有する両隣のセルも描画する。
+ * タイルごとに描画する場合は、タイルの左下の角を原点とするグリッド座標を渡す。
+ *
+ * @param mask	マスク (描画したセルを1にする)
+ * @param a		始点 (グリッド座標)
+ * @param b		終点 (グリッド座標)
+ */
+void RoadRaster::drawSegment(cv::Mat_<uchar>& mask, const QVector2D& a, const QVector2D& b) {
+	int width = mask.cols;
+	int height = mask.rows;
+
+	float dx = b.x() - a.x();
+	float dy = b.y() - a.y();
+
+	float t0 = 0.0f;
+	float t1 = 1.0f;
+	if (!clipEdge(-dx, a.x(), t0, t1)) return;
+	if (!clipEdge(dx, width - a.x(), t0, t1)) return;
+	if (!clipEdge(-dy, a.y(), t0, t1)) return;
+	if (!clipEdge(dy, height - a.y(), t0, t1)) return;
+
+	float x0 = a.x() + dx * t0;
+	float y0 = a.y() + dy * t0;
+	float x1 = a.x() + dx * t1;
+	float y1 = a.y() + dy * t1;
+
+	int c = min(width - 1, max(0, (int)floorf(x0)));
+	int r = min(height - 1, max(0, (int)floorf(y0)));
+	int c_end = min(width - 1, max(0, (int)floorf(x1)));
+	int r_end = min(height - 1, max(0, (int)floorf(y1)));
+
+	int step_c = x1 > x0 ? 1 : -1;
+	int step_r = y1 > y0 ? 1 : -1;
+	float length_x = fabs(x1 - x0);
+	float length_y = fabs(y1 - y0);
+
+	// 次のセルの境界までの、線分上の位置 (0～1) と、1セル進むごとの増分
+	float t_max_x = numeric_limits<float>::max();
+	float t_max_y = numeric_limits<float>::max();
+	float t_delta_x = numeric_limits<float>::max();
+	float t_delta_y = numeric_limits<float>::max();
+	if (length_x > 0.0f) {
+		t_max_x = (step_c > 0 ? c + 1 - x0 : x0 - c) / length_x;
+		t_delta_x = 1.0f / length_x;
+	}
+	if (length_y > 0.0f) {
+		t_max_y = (step_r > 0 ? r + 1 - y0 : y0 - r) / length_y;
+		t_delta_y = 1.0f / length_y;
+	}
+
+	mask(r, c) = 1;
+
+	// 誤差で終点を通り過ぎないよう、進むセルの数で打ち切る
+	int remaining = abs(c_end - c) + abs(r_end - r);
+	while (remaining > 0) {
+		if (t_max_x < t_max_y) {
+			c += step_c;
+			t_max_x += t_delta_x;
+			remaining--;
+		} else if (t_max_y < t_max_x) {
+			r += step_r;
+			t_max_y += t_delta_y;
+			remaining--;
+		} else {
+			if (c + step_c >= 0 && c + step_c < width) mask(r, c + step_c) = 1;
+			if (r + step_r >= 0 && r + step_r < height) mask(r + step_r, c) = 1;
+			c += step_c;
+			r += step_r;
+			t_max_x += t_delta_x;
+			t_max_y += t_delta_y;
+			remaining -= 2;
+		}
+
+		if (c < 0 || c >= width || r < 0 || r >= height) break;
+		mask(r, c) = 1;
+	}
+}
+
+/**
+ * city座標を、グリッド座標 (セルの左下の角が整数) に変換する。
+ */
+QVector2D RoadRaster::cityToGrid(const QVector2D& pt) const {
+	return pt / (float)city_size * grid_size + QVector2D(grid_size, grid_size) * 0.5f;
+}
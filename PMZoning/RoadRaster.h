@@ -0,0 +1,51 @@
+﻿#pragma once
+
+#include <opencv/cv.h>
+#include <QVector2D>
+#include <boost/shared_ptr.hpp>
+
+class RoadSnapshot;
+class RoadRaster;
+
+typedef boost::shared_ptr<const RoadRaster> RoadRasterPtr;
+
+/**
+ * 指定したタイプの道路をグリッドに描画したマスクと、そこからの距離マップ・accessibilityのマップ。
+ *
+ * 道路網・グリッド・道路のタイプが同じなら内容も同じなので、get()でプロセス全体のキャッシュから取得し、
+ * 全てのZoningで共有する。共有しているので、マップの内容を書き換えないこと。
+ * キャッシュは道路網の内容のハッシュをキーにするので、同じ道路網を読み込み直しても再利用される。
+ * キャッシュの合計サイズが上限を超えたら、最も長く使われていないものから破棄する。
+ * 多重解像度で使う場合は、細かいグリッドのマップを縮小して、粗いグリッドのマップを作ることもできる。
+ */
+class RoadRaster {
+private:
+	struct Key;
+	class Pending;
+	class Cache;
+
+	int city_size;		// cityの一辺の距離 [m]
+	int grid_size;		// グリッドの一辺のサイズ
+	int road_types;		// 描画した道路のタイプ (RoadEdge::TYPE_XXXの論理和)
+	cv::Mat_<uchar> mask;				// 道路が通るセルは1
+	cv::Mat_<float> distances;			// 道路までの距離マップ [m]
+	cv::Mat_<float> accessibility;		// 距離マップを減衰させたもの (propertyベクトルの道路の成分)
+
+public:
+	RoadRaster(const RoadSnapshot& roads, int city_size, int grid_size, int road_types, int distance_backend);
+
+	const cv::Mat_<uchar>& roadMask() const { return mask; }
+	const cv::Mat_<float>& distanceMap() const { return distances; }
+	const cv::Mat_<float>& accessibilityMap() const { return accessibility; }
+	size_t memorySize() const;
+
+	static RoadRasterPtr get(const RoadSnapshot& roads, int city_size, int grid_size, int road_types, int distance_backend, int source_grid_size = 0);
+	static void setCacheBudget(size_t bytes);
+	static void clearCache();
+	static void drawSegment(cv::Mat_<uchar>& mask, const QVector2D& a, const QVector2D& b);
+
+private:
+	RoadRaster(const RoadRaster& finer, int grid_size);
+	static Cache& cache();
+	QVector2D cityToGrid(const QVector2D& pt) const;
+};
@@ -0,0 +1,158 @@
+﻿#include "RoadSnapshot.h"
+#include <algorithm>
+#include <QFile>
+
+namespace {
+
+/**
+ * FNV-1aハッシュに、配列の内容を加える。
+ */
+template<typename T>
+void hashArray(const RoadSnapshot::Array<T>& values, quint64& hash) {
+	const unsigned char* bytes = (const unsigned char*)values.data();
+	for (size_t i = 0; i < (size_t)values.size() * sizeof(T); ++i) {
+		hash ^= bytes[i];
+		hash *= Q_UINT64_C(1099511628211);
+	}
+}
+
+}
+
+/**
+ * 道路網から、スナップショットを構築する。
+ *
+ * @param roads		道路網
+ */
+RoadSnapshot::RoadSnapshot(RoadGraph& roads) {
+	Buffers b;
+	int num_vertices = boost::num_vertices(roads.graph);
+	int num_edges = boost::num_edges(roads.graph);
+
+	b.vertex_x.resize(num_vertices);
+	b.vertex_y.resize(num_vertices);
+	b.vertex_valid.resize(num_vertices);
+	RoadVertexIter vi, vend;
+	for (boost::tie(vi, vend) = boost::vertices(roads.graph); vi != vend; ++vi) {
+		b.vertex_x[*vi] = roads.graph[*vi]->pt.x();
+		b.vertex_y[*vi] = roads.graph[*vi]->pt.y();
+		b.vertex_valid[*vi] = roads.graph[*vi]->valid ? 1 : 0;
+	}
+
+	b.edge_src.reserve(num_edges);
+	b.edge_tgt.reserve(num_edges);
+	b.edge_valid.reserve(num_edges);
+	b.edge_attributes.reserve(num_edges);
+	b.polyline_start.reserve(num_edges + 1);
+	b.polyline_start.push_back(0);
+	RoadEdgeIter ei, eend;
+	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
+		RoadEdgePtr edge = roads.graph[*ei];
+		b.edge_src.push_back(boost::source(*ei, roads.graph));
+		b.edge_tgt.push_back(boost::target(*ei, roads.graph));
+		b.edge_valid.push_back(edge->valid ? 1 : 0);
+		b.edge_attributes.push_back((unsigned char)((edge->type & 0x0f) | (min(max(edge->lanes, 0), 15) << 4)));
+
+		for (int i = 0; i < edge->polyline.size(); ++i) {
+			b.polyline_x.push_back(edge->polyline[i].x());
+			b.polyline_y.push_back(edge->polyline[i].y());
+		}
+		b.polyline_start.push_back(b.polyline_x.size());
+	}
+
+	// 隣接リスト (1回目で次数を数え、2回目で登録する)
+	b.adjacency_start.assign(num_vertices + 1, 0);
+	for (int e = 0; e < b.edge_src.size(); ++e) {
+		b.adjacency_start[b.edge_src[e] + 1]++;
+		b.adjacency_start[b.edge_tgt[e] + 1]++;
+	}
+	for (int v = 0; v < num_vertices; ++v) {
+		b.adjacency_start[v + 1] += b.adjacency_start[v];
+	}
+	b.adjacency_vertices.resize(b.adjacency_start[num_vertices]);
+	b.adjacency_edges.resize(b.adjacency_start[num_vertices]);
+	vector<int> next(b.adjacency_start.begin(), b.adjacency_start.end() - 1);
+	for (int e = 0; e < b.edge_src.size(); ++e) {
+		int index = next[b.edge_src[e]]++;
+		b.adjacency_vertices[index] = b.edge_tgt[e];
+		b.adjacency_edges[index] = e;
+
+		index = next[b.edge_tgt[e]]++;
+		b.adjacency_vertices[index] = b.edge_src[e];
+		b.adjacency_edges[index] = e;
+	}
+
+	vertex_x.own(b.vertex_x);
+	vertex_y.own(b.vertex_y);
+	vertex_valid.own(b.vertex_valid);
+	adjacency_start.own(b.adjacency_start);
+	adjacency_vertices.own(b.adjacency_vertices);
+	adjacency_edges.own(b.adjacency_edges);
+	edge_src.own(b.edge_src);
+	edge_tgt.own(b.edge_tgt);
+	edge_valid.own(b.edge_valid);
+	edge_attributes.own(b.edge_attributes);
+	polyline_start.own(b.polyline_start);
+	polyline_x.own(b.polyline_x);
+	polyline_y.own(b.polyline_y);
+
+	// 道路の描画結果を左右する内容 (エッジの属性とpolyline) のハッシュ
+	content_hash = Q_UINT64_C(14695981039346656037);
+	hashArray(edge_attributes, content_hash);
+	hashArray(polyline_start, content_hash);
+	hashArray(polyline_x, content_hash);
+	hashArray(polyline_y, content_hash);
+
+	finish();
+}
+
+RoadSnapshot::RoadSnapshot() {
+	content_hash = 0;
+}
+
+/**
+ * 配列が揃った後の初期化。頂点のグリッドを構築する。
+ */
+void RoadSnapshot::finish() {
+	grid.build(vertex_x.data(), vertex_y.data(), vertex_x.size(), 4);
+}
+
+/**
+ * エッジのpolylineを、stepの間隔で細かくした点列を返却する。
+ * GraphUtil::finerEdgeと同じ点列になる。
+ *
+ * @param e		エッジ
+ * @param step	点の間隔
+ * @return		細かくした点列
+ */
+Polyline2D RoadSnapshot::finerPolyline(int e, float step) const {
+	Polyline2D polyline;
+
+	int num_points = polylineSize(e);
+	if (num_points == 0) return polyline;
+
+	for (int i = 0; i < num_points - 1; ++i) {
+		QVector2D p = polylinePt(e, i);
+		QVector2D vec = polylinePt(e, i + 1) - p;
+		float length = vec.length();
+		vec.normalize();
+		for (float j = 0.0f; j < length - 0.1f; j += step) {
+			polyline.push_back(p + vec * j);
+		}
+	}
+	polyline.push_back(polylinePt(e, num_points - 1));
+
+	return polyline;
+}
+
+/**
+ * 指定した点を中心とする、一辺2*radiusの正方形に含まれる頂点を、番号の順に返却する。
+ * 正確な距離の判定は、呼び出し側で行うこと。
+ *
+ * @param pt			中心
+ * @param radius		半径
+ * @param result [OUT]	頂点
+ */
+void RoadSnapshot::findVertices(const QVector2D& pt, float radius, vector<int>& result) const {
+	grid.find(pt, radius, result);
+}
+
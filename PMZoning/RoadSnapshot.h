@@ -0,0 +1,130 @@
+﻿#pragma once
+
+#include <vector>
+#include <QtGlobal>
+#include <QVector2D>
+#include <boost/shared_ptr.hpp>
+#include "RoadGraph.h"
+#include "PointGrid.h"
+#include "Polyline2D.h"
+
+class QFile;
+
+using namespace std;
+
+/**
+ * 道路網の読み出し専用のスナップショット。
+ * 頂点の座標、隣接リスト (CSR形式)、エッジの端点・属性、全エッジのpolylineを連結したバッファを、
+ * それぞれ連続した配列に格納する。頂点・エッジの番号は、構築時のRoadGraphの頂点ディスクリプタ、
+ * boost::edgesの列挙順と一致する。
+ *
+ * 構築後は変更しないので、RoadSnapshotPtrで複数のZoningやスレッドから共有してよい。
+ * 元のRoadGraphを変更した場合は、スナップショットを作り直すこと。
+ * RoadRasterのキャッシュのキーにするため、エッジの属性とpolylineの内容のハッシュを保持する。
+ * RoadSnapshotFileで保存したファイルから、コピーせずに読み込むこともできる。
+ */
+class RoadSnapshot {
+	friend class RoadSnapshotFile;
+
+public:
+	/**
+	 * 読み出し専用の配列。
+	 * 自分で確保したメモリ、またはファイルをマップしたメモリ (RoadSnapshotFile) のどちらかを参照する。
+	 */
+	template<typename T>
+	class Array {
+	private:
+		const T* ptr;
+		int count;
+		vector<T> owned;
+
+	public:
+		Array() : ptr(NULL), count(0) {}
+
+		void own(vector<T>& values) { owned.swap(values); ptr = owned.empty() ? NULL : &owned[0]; count = owned.size(); }
+		void wrap(const T* values, int size) { owned.clear(); ptr = values; count = size; }
+		const T& operator[](int i) const { return ptr[i]; }
+		const T* data() const { return ptr; }
+		int size() const { return count; }
+	};
+
+private:
+	/** スナップショットを構築する時の作業用の配列 */
+	struct Buffers {
+		vector<float> vertex_x;
+		vector<float> vertex_y;
+		vector<unsigned char> vertex_valid;
+		vector<int> adjacency_start;
+		vector<int> adjacency_vertices;
+		vector<int> adjacency_edges;
+		vector<int> edge_src;
+		vector<int> edge_tgt;
+		vector<unsigned char> edge_valid;
+		vector<unsigned char> edge_attributes;
+		vector<int> polyline_start;
+		vector<float> polyline_x;
+		vector<float> polyline_y;
+	};
+
+	// 頂点
+	Array<float> vertex_x;
+	Array<float> vertex_y;
+	Array<unsigned char> vertex_valid;
+
+	// 隣接リスト (頂点vの隣接は、adjacency_start[v]からadjacency_start[v+1]の手前まで)
+	Array<int> adjacency_start;
+	Array<int> adjacency_vertices;
+	Array<int> adjacency_edges;
+
+	// エッジ
+	Array<int> edge_src;
+	Array<int> edge_tgt;
+	Array<unsigned char> edge_valid;
+	Array<unsigned char> edge_attributes;	// 下位4ビットがタイプ、上位4ビットが車線数 (最大15)
+
+	// polyline (エッジeの点は、polyline_start[e]からpolyline_start[e+1]の手前まで)
+	Array<int> polyline_start;
+	Array<float> polyline_x;
+	Array<float> polyline_y;
+
+	// 頂点のグリッド
+	PointGrid grid;
+	quint64 content_hash;
+
+	// 配列がマップしたファイルを参照している場合の、ファイル (マップはファイルと一緒に解放される)
+	boost::shared_ptr<QFile> file;
+
+public:
+	RoadSnapshot(RoadGraph& roads);
+
+	int numVertices() const { return vertex_x.size(); }
+	int numEdges() const { return edge_src.size(); }
+	int numPolylinePoints() const { return polyline_x.size(); }
+	quint64 contentHash() const { return content_hash; }
+
+	QVector2D vertexPt(int v) const { return QVector2D(vertex_x[v], vertex_y[v]); }
+	bool vertexValid(int v) const { return vertex_valid[v] != 0; }
+	int degree(int v) const { return adjacency_start[v + 1] - adjacency_start[v]; }
+	int adjacentVertex(int v, int i) const { return adjacency_vertices[adjacency_start[v] + i]; }
+	int adjacentEdge(int v, int i) const { return adjacency_edges[adjacency_start[v] + i]; }
+
+	int edgeSource(int e) const { return edge_src[e]; }
+	int edgeTarget(int e) const { return edge_tgt[e]; }
+	bool edgeValid(int e) const { return edge_valid[e] != 0; }
+	int edgeType(int e) const { return edge_attributes[e] & 0x0f; }
+	int edgeLanes(int e) const { return edge_attributes[e] >> 4; }
+
+	int polylineSize(int e) const { return polyline_start[e + 1] - polyline_start[e]; }
+	QVector2D polylinePt(int e, int i) const { return QVector2D(polyline_x[polyline_start[e] + i], polyline_y[polyline_start[e] + i]); }
+	Polyline2D finerPolyline(int e, float step) const;
+
+	void findVertices(const QVector2D& pt, float radius, vector<int>& result) const;
+
+private:
+	RoadSnapshot();
+	RoadSnapshot(const RoadSnapshot& ref);
+	RoadSnapshot& operator=(const RoadSnapshot& ref);
+	void finish();
+};
+
+typedef boost::shared_ptr<RoadSnapshot> RoadSnapshotPtr;
@@ -0,0 +1,330 @@
+﻿#include "RoadSnapshotFile.h"
+#include <QFile>
+#include <string.h>
+
+const quint32 RoadSnapshotFile::VERSION;
+
+struct RoadSnapshotFile::Header {
+	char magic[8];
+	quint32 version;
+	quint32 header_size;
+	quint32 num_vertices;
+	quint32 num_edges;
+	quint32 num_adjacency;
+	quint32 num_polyline_points;
+	quint64 content_hash;
+	quint64 checksum;
+	quint32 num_sections;
+	quint32 reserved;
+	quint64 reserved2;
+};
+
+struct RoadSnapshotFile::Section {
+	quint32 id;
+	quint32 element_size;
+	quint64 offset;
+	quint64 size;
+};
+
+namespace {
+
+const char MAGIC[8] = { 'P', 'M', 'Z', 'R', 'O', 'A', 'D', 'S' };
+
+enum {
+	SECTION_VERTEX_X = 0, SECTION_VERTEX_Y, SECTION_VERTEX_VALID,
+	SECTION_ADJACENCY_START, SECTION_ADJACENCY_VERTICES, SECTION_ADJACENCY_EDGES,
+	SECTION_EDGE_SRC, SECTION_EDGE_TGT, SECTION_EDGE_VALID, SECTION_EDGE_ATTRIBUTES,
+	SECTION_POLYLINE_START, SECTION_POLYLINE_X, SECTION_POLYLINE_Y,
+	NUM_SECTIONS
+};
+
+bool fail(QString* error, const QString& message) {
+	if (error != NULL) *error = message;
+	return false;
+}
+
+/**
+ * 書き出すセクション。配列はコピーせずに、スナップショットのメモリを参照する。
+ */
+struct SectionData {
+	quint32 id;
+	quint32 element_size;
+	const char* data;
+	quint64 offset;
+	quint64 size;
+};
+
+/**
+ * 配列を、書き出すセクションとして追加する。offsetは、全て追加してから決める。
+ */
+template<typename T>
+void addSection(vector<SectionData>& sections, const RoadSnapshot::Array<T>& values, quint32 id) {
+	SectionData section;
+	section.id = id;
+	section.element_size = sizeof(T);
+	section.data = (const char*)values.data();
+	section.offset = 0;
+	section.size = (quint64)values.size() * sizeof(T);
+	sections.push_back(section);
+}
+
+/**
+ * ヘッダの要素数と、セクションの大きさが一致するか、ファイルの範囲内かを確認し、配列として参照する。
+ */
+template<typename T>
+bool wrapSection(RoadSnapshot::Array<T>& values, const uchar* data, qint64 file_size, quint32 element_size, quint64 offset, quint64 size, quint32 count) {
+	if (element_size != sizeof(T)) return false;
+	if (size != (quint64)count * sizeof(T)) return false;
+	if (offset % 8 != 0 || offset > (quint64)file_size || size > (quint64)file_size - offset) return false;
+
+	values.wrap(count > 0 ? (const T*)(data + offset) : NULL, count);
+	return true;
+}
+
+/**
+ * CSR形式の先頭位置の配列が、0から始まって単調に増加し、totalで終わるか確認する。
+ */
+bool validOffsets(const RoadSnapshot::Array<int>& start, int total) {
+	if (start[0] != 0 || start[start.size() - 1] != total) return false;
+	for (int i = 0; i < start.size() - 1; ++i) {
+		if (start[i] > start[i + 1]) return false;
+	}
+	return true;
+}
+
+/**
+ * 全ての番号が、0以上size未満か確認する。
+ */
+bool validIndices(const RoadSnapshot::Array<int>& indices, int size) {
+	for (int i = 0; i < indices.size(); ++i) {
+		if (indices[i] < 0 || indices[i] >= size) return false;
+	}
+	return true;
+}
+
+}
+
+/**
+ * スナップショットを、ファイルに保存する。
+ *
+ * @param roads			道路網のスナップショット
+ * @param filename		ファイル名
+ * @param error [OUT]	失敗した場合の理由
+ * @return				保存できたらtrue
+ */
+bool RoadSnapshotFile::save(const RoadSnapshot& roads, const QString& filename, QString* error) {
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	return fail(error, "big-endian hosts are not supported");
+#endif
+
+	qint64 header_size = sizeof(Header) + sizeof(Section) * NUM_SECTIONS;
+
+	vector<SectionData> sections;
+	addSection(sections, roads.vertex_x, SECTION_VERTEX_X);
+	addSection(sections, roads.vertex_y, SECTION_VERTEX_Y);
+	addSection(sections, roads.vertex_valid, SECTION_VERTEX_VALID);
+	addSection(sections, roads.adjacency_start, SECTION_ADJACENCY_START);
+	addSection(sections, roads.adjacency_vertices, SECTION_ADJACENCY_VERTICES);
+	addSection(sections, roads.adjacency_edges, SECTION_ADJACENCY_EDGES);
+	addSection(sections, roads.edge_src, SECTION_EDGE_SRC);
+	addSection(sections, roads.edge_tgt, SECTION_EDGE_TGT);
+	addSection(sections, roads.edge_valid, SECTION_EDGE_VALID);
+	addSection(sections, roads.edge_attributes, SECTION_EDGE_ATTRIBUTES);
+	addSection(sections, roads.polyline_start, SECTION_POLYLINE_START);
+	addSection(sections, roads.polyline_x, SECTION_POLYLINE_X);
+	addSection(sections, roads.polyline_y, SECTION_POLYLINE_Y);
+
+	// 各セクションの位置を、8バイト境界に揃えて決める
+	quint64 end = header_size;
+	for (int i = 0; i < sections.size(); ++i) {
+		sections[i].offset = (end + 7) / 8 * 8;
+		end = sections[i].offset + sections[i].size;
+	}
+
+	Header header;
+	memset(&header, 0, sizeof(Header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.header_size = header_size;
+	header.num_vertices = roads.numVertices();
+	header.num_edges = roads.numEdges();
+	header.num_adjacency = roads.adjacency_vertices.size();
+	header.num_polyline_points = roads.numPolylinePoints();
+	header.content_hash = roads.contentHash();
+	header.num_sections = NUM_SECTIONS;
+
+	QFile file(filename);
+	if (!file.open(QIODevice::WriteOnly)) return fail(error, "cannot open " + filename);
+
+	// ヘッダとセクション表を書いてから、各セクションを配列から直接書き出す (ファイル全体をメモリに組み立てない)
+	// チェックサムは書きながら計算し、最後にヘッダを書き直す
+	bool ok = file.write((const char*)&header, sizeof(Header)) == sizeof(Header);
+	for (int i = 0; i < sections.size() && ok; ++i) {
+		Section section;
+		section.id = sections[i].id;
+		section.element_size = sections[i].element_size;
+		section.offset = sections[i].offset;
+		section.size = sections[i].size;
+		ok = file.write((const char*)&section, sizeof(Section)) == sizeof(Section);
+	}
+
+	const char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	quint64 pos = header_size;
+	quint64 hash = checksum(NULL, 0);
+	for (int i = 0; i < sections.size() && ok; ++i) {
+		qint64 num_padding = sections[i].offset - pos;
+		if (num_padding > 0) {
+			ok = file.write(padding, num_padding) == num_padding;
+			hash = checksum((const uchar*)padding, num_padding, hash);
+		}
+		if (ok && sections[i].size > 0) {
+			ok = file.write(sections[i].data, sections[i].size) == (qint64)sections[i].size;
+			hash = checksum((const uchar*)sections[i].data, sections[i].size, hash);
+		}
+		pos = sections[i].offset + sections[i].size;
+	}
+
+	if (ok) {
+		header.checksum = hash;
+		ok = file.seek(0) && file.write((const char*)&header, sizeof(Header)) == sizeof(Header);
+	}
+	file.close();
+
+	if (!ok) return fail(error, "cannot write " + filename);
+	return true;
+}
+
+/**
+ * ファイルをメモリにマップして、スナップショットとして読み込む。
+ * 配列はコピーせずにマップしたメモリを参照し、スナップショットが解放されるまでマップを保持する。
+ * 構造 (ヘッダ、セクションの範囲、隣接リストとpolylineの番号) は必ず検証し、
+ * verify_checksumがtrueなら、チェックサムも検証する。
+ *
+ * @param filename			ファイル名
+ * @param error [OUT]		失敗した場合の理由
+ * @param verify_checksum	チェックサムを検証するか
+ * @return					スナップショット (失敗した場合はNULL)
+ */
+RoadSnapshotPtr RoadSnapshotFile::load(const QString& filename, QString* error, bool verify_checksum) {
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	fail(error, "big-endian hosts are not supported");
+	return RoadSnapshotPtr();
+#endif
+
+	boost::shared_ptr<QFile> file(new QFile(filename));
+	if (!file->open(QIODevice::ReadOnly)) {
+		fail(error, "cannot open " + filename);
+		return RoadSnapshotPtr();
+	}
+
+	qint64 file_size = file->size();
+	if (file_size < (qint64)sizeof(Header)) {
+		fail(error, "file too short: " + filename);
+		return RoadSnapshotPtr();
+	}
+
+	const uchar* data = file->map(0, file_size);
+	if (data == NULL) {
+		fail(error, "cannot map " + filename);
+		return RoadSnapshotPtr();
+	}
+
+	Header header;
+	memcpy(&header, data, sizeof(Header));
+	if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+		fail(error, "not a road snapshot file: " + filename);
+		return RoadSnapshotPtr();
+	}
+	if (header.version != VERSION) {
+		fail(error, QString("unsupported version %1: ").arg(header.version) + filename);
+		return RoadSnapshotPtr();
+	}
+	if (header.num_sections != NUM_SECTIONS || header.header_size != sizeof(Header) + sizeof(Section) * NUM_SECTIONS || header.header_size > file_size) {
+		fail(error, "corrupt header: " + filename);
+		return RoadSnapshotPtr();
+	}
+	if (header.num_vertices >= 0x7fffffff || header.num_edges >= 0x7fffffff || header.num_adjacency >= 0x7fffffff || header.num_polyline_points >= 0x7fffffff) {
+		fail(error, "too large: " + filename);
+		return RoadSnapshotPtr();
+	}
+	if (verify_checksum && checksum(data + header.header_size, file_size - header.header_size) != header.checksum) {
+		fail(error, "checksum mismatch: " + filename);
+		return RoadSnapshotPtr();
+	}
+
+	quint32 counts[NUM_SECTIONS] = {
+		header.num_vertices, header.num_vertices, header.num_vertices,
+		header.num_vertices + 1, header.num_adjacency, header.num_adjacency,
+		header.num_edges, header.num_edges, header.num_edges, header.num_edges,
+		header.num_edges + 1, header.num_polyline_points, header.num_polyline_points
+	};
+
+	RoadSnapshotPtr roads(new RoadSnapshot());
+	bool ok = true;
+	for (int i = 0; i < NUM_SECTIONS && ok; ++i) {
+		Section section;
+		memcpy(&section, data + sizeof(Header) + sizeof(Section) * i, sizeof(Section));
+		if (section.id != i) {
+			ok = false;
+			break;
+		}
+
+		switch (i) {
+		case SECTION_VERTEX_X: ok = wrapSection(roads->vertex_x, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_VERTEX_Y: ok = wrapSection(roads->vertex_y, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_VERTEX_VALID: ok = wrapSection(roads->vertex_valid, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_ADJACENCY_START: ok = wrapSection(roads->adjacency_start, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_ADJACENCY_VERTICES: ok = wrapSection(roads->adjacency_vertices, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_ADJACENCY_EDGES: ok = wrapSection(roads->adjacency_edges, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_EDGE_SRC: ok = wrapSection(roads->edge_src, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_EDGE_TGT: ok = wrapSection(roads->edge_tgt, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_EDGE_VALID: ok = wrapSection(roads->edge_valid, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_EDGE_ATTRIBUTES: ok = wrapSection(roads->edge_attributes, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_POLYLINE_START: ok = wrapSection(roads->polyline_start, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_POLYLINE_X: ok = wrapSection(roads->polyline_x, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		case SECTION_POLYLINE_Y: ok = wrapSection(roads->polyline_y, data, file_size, section.element_size, section.offset, section.size, counts[i]); break;
+		}
+	}
+	if (!ok) {
+		fail(error, "corrupt section table: " + filename);
+		return RoadSnapshotPtr();
+	}
+
+	// 番号が範囲外だと、参照した時にファイルの外を読んでしまうので、必ず検証する
+	if (!validOffsets(roads->adjacency_start, header.num_adjacency) || !validOffsets(roads->polyline_start, header.num_polyline_points)
+		|| !validIndices(roads->adjacency_vertices, header.num_vertices) || !validIndices(roads->adjacency_edges, header.num_edges)
+		|| !validIndices(roads->edge_src, header.num_vertices) || !validIndices(roads->edge_tgt, header.num_vertices)) {
+		fail(error, "corrupt graph: " + filename);
+		return RoadSnapshotPtr();
+	}
+
+	roads->content_hash = header.content_hash;
+	roads->file = file;
+	roads->finish();
+
+	return roads;
+}
+
+/**
+ * ファイルが、RoadSnapshotのバイナリファイルかどうか、先頭のmagicで判定する。
+ */
+bool RoadSnapshotFile::isSnapshotFile(const QString& filename) {
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly)) return false;
+
+	char magic[8];
+	if (file.read(magic, sizeof(magic)) != sizeof(magic)) return false;
+	return memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+/**
+ * 64bitのFNV-1aハッシュ。
+ * 前の部分のハッシュをhashに渡せば、続きの部分を加えたハッシュを計算できる。
+ */
+quint64 RoadSnapshotFile::checksum(const uchar* data, qint64 size, quint64 hash) {
+	for (qint64 i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= Q_UINT64_C(1099511628211);
+	}
+	return hash;
+}
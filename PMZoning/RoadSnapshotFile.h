@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include <QString>
+#include <QtGlobal>
+#include "RoadSnapshot.h"
+
+/**
+ * RoadSnapshotのバイナリファイル (.rsn) の読み書き。
+ *
+ * ファイルは、RoadSnapshotの配列をそのまま並べたもので、読み込み時はファイルをメモリにマップし、
+ * 配列をコピーせずに参照する。マップは読み出し専用なので、複数のプロセスで同じファイルを共有できる。
+ * 数値は全てリトルエンディアンの固定長 (int32 / float32 / uint8) で、実行環境によらない。
+ *
+ * レイアウト:
+ *   ヘッダ (64バイト)
+ *     char[8]  magic ("PMZROADS")
+ *     uint32   version
+ *     uint32   header_size (ヘッダとセクション表の合計)
+ *     uint32   num_vertices, num_edges, num_adjacency, num_polyline_points
+ *     uint64   content_hash (RoadSnapshot::contentHash())
+ *     uint64   checksum (header_size以降の全バイトのFNV-1a)
+ *     uint32   num_sections
+ *     uint32   reserved
+ *     uint64   reserved
+ *   セクション表 (num_sections個)
+ *     uint32   id, element_size
+ *     uint64   offset, size [byte]
+ *   セクション (8バイト境界に揃える)
+ *     頂点のx, y, valid、隣接リストのstart, vertices, edges、エッジのsrc, tgt, valid, attributes、
+ *     polylineのstart, x, y
+ */
+class RoadSnapshotFile {
+public:
+	static const quint32 VERSION = 1;
+
+private:
+	struct Header;
+	struct Section;
+
+public:
+	static bool save(const RoadSnapshot& roads, const QString& filename, QString* error = NULL);
+	static RoadSnapshotPtr load(const QString& filename, QString* error = NULL, bool verify_checksum = true);
+	static bool isSnapshotFile(const QString& filename);
+
+private:
+	static quint64 checksum(const uchar* data, qint64 size, quint64 hash = Q_UINT64_C(14695981039346656037));
+};
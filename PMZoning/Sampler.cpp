@@ -0,0 +1,272 @@
+﻿#include "Sampler.h"
+#include <math.h>
+
+namespace sampler {
+
+namespace {
+
+/**
+ * log(n!)を返却する。nが小さい場合は直接計算し、大きい場合はStirlingの近似を使う。
+ */
+double logFactorial(int n) {
+	if (n < 16) {
+		double result = 0.0;
+		for (int i = 2; i <= n; ++i) {
+			result += log((double)i);
+		}
+		return result;
+	}
+
+	double x = n;
+	return (x + 0.5) * log(x) - x + 0.91893853320467274 + 1.0 / (12.0 * x) - 1.0 / (360.0 * x * x * x);
+}
+
+}
+
+/**
+ * 二項分布B(n, p)の乱数を生成する。
+ * 平均が小さい場合は、逆関数法 (確率の漸化式で順に引いていく) で厳密にサンプリングする。
+ * 平均が大きい場合は、連続補正付きの正規近似を使う。
+ *
+ * @param rng		乱数生成器
+ * @param n			試行回数
+ * @param p			成功確率
+ * @return			成功回数
+ */
+int binomial(Rng& rng, int n, double p) {
+	if (n <= 0 || p <= 0.0) return 0;
+	if (p >= 1.0) return n;
+	if (p > 0.5) return n - binomial(rng, n, 1.0 - p);
+
+	double q = 1.0 - p;
+	double mean = n * p;
+	if (mean < 16.0) {
+		// P(x+1) = P(x) * (n - x) / (x + 1) * p / q
+		double s = p / q;
+		double prob = pow(q, n);
+		double u = uniform(rng);
+		int x = 0;
+		while (u > prob && x < n) {
+			u -= prob;
+			prob *= s * (n - x) / (x + 1);
+			x++;
+		}
+		return x;
+	}
+
+	int x = (int)floor(mean + sqrt(mean * q) * rng.normal(0.0f, 1.0f) + 0.5);
+	return min(n, max(0, x));
+}
+
+/**
+ * 超幾何分布の乱数を生成する。
+ * total個のうちsuccesses個が当たりの中から、draws個を非復元抽出した時の当たりの数を返却する。
+ * 平均が小さい場合は、逆関数法で厳密にサンプリングする。
+ * 平均が大きい場合は、連続補正付きの正規近似を使う。
+ *
+ * @param rng			乱数生成器
+ * @param total			全体の数
+ * @param successes		当たりの数
+ * @param draws			抽出する数
+ * @return				抽出した中の当たりの数
+ */
+int hypergeometric(Rng& rng, int total, int successes, int draws) {
+	draws = min(draws, total);
+	if (draws <= 0 || successes <= 0) return 0;
+	if (successes >= total) return draws;
+
+	// 抽出する数、当たりの数とも、全体の半分以下にする
+	if (draws * 2 > total) return successes - hypergeometric(rng, total, successes, total - draws);
+	if (successes * 2 > total) return draws - hypergeometric(rng, total, total - successes, draws);
+
+	int failures = total - successes;
+	double mean = (double)draws * successes / total;
+	if (mean < 16.0) {
+		// P(0) = C(failures, draws) / C(total, draws)
+		// P(x+1) = P(x) * (successes - x)(draws - x) / ((x + 1)(failures - draws + x + 1))
+		double prob = exp(logFactorial(failures) + logFactorial(total - draws) - logFactorial(total) - logFactorial(failures - draws));
+		double u = uniform(rng);
+		int x = 0;
+		int x_max = min(successes, draws);
+		while (u > prob && x < x_max) {
+			u -= prob;
+			prob *= (double)(successes - x) * (draws - x) / ((double)(x + 1) * (failures - draws + x + 1));
+			x++;
+		}
+		return x;
+	}
+
+	double p = (double)successes / total;
+	double variance = draws * p * (1.0 - p) * (total - draws) / (total - 1);
+	int x = (int)floor(mean + sqrt(variance) * rng.normal(0.0f, 1.0f) + 0.5);
+	return min(min(successes, draws), max(0, x));
+}
+
+/**
+ * テーブルを構築する。
+ *
+ * @param weights	重み
+ * @param n			重みの数
+ */
+void AliasTable::build(const float* weights, int n) {
+	this->weights.resize(n);
+	for (int i = 0; i < n; ++i) {
+		this->weights[i] = weights[i] > 0 ? weights[i] : 0.0;
+	}
+	buildTable();
+}
+
+void AliasTable::build(const double* weights, int n) {
+	this->weights.resize(n);
+	for (int i = 0; i < n; ++i) {
+		this->weights[i] = weights[i] > 0 ? weights[i] : 0.0;
+	}
+	buildTable();
+}
+
+/**
+ * Voseの方法で、テーブルを構築する。
+ * 平均より小さい重みのインデックスの余りを、平均より大きい重みのインデックスで埋めていく。
+ */
+void AliasTable::buildTable() {
+	int n = weights.size();
+	probability.assign(n, 1.0f);
+	alias.resize(n);
+	for (int i = 0; i < n; ++i) {
+		alias[i] = i;
+	}
+
+	total = 0.0;
+	last_positive = -1;
+	for (int i = 0; i < n; ++i) {
+		total += weights[i];
+		if (weights[i] > 0.0) last_positive = i;
+	}
+	if (total <= 0.0) return;
+
+	// 平均が1になるように正規化する
+	vector<double> scaled(n);
+	vector<int> small;
+	vector<int> large;
+	for (int i = 0; i < n; ++i) {
+		scaled[i] = weights[i] * n / total;
+		if (scaled[i] < 1.0) {
+			small.push_back(i);
+		} else {
+			large.push_back(i);
+		}
+	}
+
+	while (!small.empty() && !large.empty()) {
+		int s = small.back();
+		small.pop_back();
+		int l = large.back();
+
+		probability[s] = (float)scaled[s];
+		alias[s] = l;
+
+		scaled[l] -= 1.0 - scaled[s];
+		if (scaled[l] < 1.0) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+
+	// 丸め誤差で残ったものは、確率1とする
+	for (int i = 0; i < large.size(); ++i) probability[large[i]] = 1.0f;
+	for (int i = 0; i < small.size(); ++i) probability[small[i]] = 1.0f;
+}
+
+/**
+ * num回サンプリングし、各インデックスが選ばれた回数を返却する (多項分布)。
+ * numがインデックスの数以下なら、1回ずつalias法でサンプリングする。
+ * それより多い場合は、インデックスの順に、残りの回数のうち何回がそのインデックスかを二項分布で決めるので、
+ * 計算量はnumではなく、インデックスの数に比例する。
+ *
+ * @param rng			乱数生成器
+ * @param num			サンプリングの回数
+ * @param counts [OUT]	各インデックスが選ばれた回数
+ */
+void AliasTable::sampleCounts(Rng& rng, int num, vector<int>& counts) const {
+	int n = weights.size();
+	counts.assign(n, 0);
+	if (n == 0 || num <= 0) return;
+
+	if (num <= n || last_positive < 0) {
+		for (int k = 0; k < num; ++k) {
+			counts[sample(rng)]++;
+		}
+		return;
+	}
+
+	int remaining = num;
+	double rest = total;
+	for (int i = 0; i <= last_positive && remaining > 0; ++i) {
+		if (weights[i] <= 0.0) continue;
+
+		if (i == last_positive || rest <= weights[i]) {
+			counts[i] = remaining;
+			break;
+		}
+
+		counts[i] = binomial(rng, remaining, weights[i] / rest);
+		remaining -= counts[i];
+		rest -= weights[i];
+	}
+}
+
+/**
+ * 重みから、Fenwick木をO(n)で構築する。
+ */
+void FenwickSampler::buildTree() {
+	int n = weights.size();
+	tree.assign(n + 1, 0.0);
+	total = 0.0;
+	for (int i = 1; i <= n; ++i) {
+		tree[i] += weights[i - 1];
+		total += weights[i - 1];
+		int parent = i + (i & -i);
+		if (parent <= n) tree[parent] += tree[i];
+	}
+}
+
+/**
+ * 重みを変更する。
+ *
+ * @param i			インデックス
+ * @param weight	新しい重み (負なら0とする)
+ */
+void FenwickSampler::set(int i, double weight) {
+	if (weight < 0.0) weight = 0.0;
+	double delta = weight - weights[i];
+	weights[i] = weight;
+	total += delta;
+	for (int k = i + 1; k < tree.size(); k += k & -k) {
+		tree[k] += delta;
+	}
+}
+
+/**
+ * 重みの累積和がtargetを超える、最初のインデックスを返却する。
+ * targetは、[0, totalWeight())の範囲で指定すること。
+ */
+int FenwickSampler::find(double target) const {
+	int n = weights.size();
+	int pos = 0;
+	int step = 1;
+	while (step * 2 <= n) step *= 2;
+
+	for (; step > 0; step /= 2) {
+		if (pos + step <= n && tree[pos + step] <= target) {
+			pos += step;
+			target -= tree[pos];
+		}
+	}
+
+	// 丸め誤差で範囲外や重み0のインデックスになった場合は、重みが正のインデックスまで戻る
+	if (pos >= n) pos = n - 1;
+	while (pos > 0 && weights[pos] <= 0.0) pos--;
+	return pos;
+}
+
+}
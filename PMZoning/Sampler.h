@@ -0,0 +1,133 @@
+﻿#pragma once
+
+#include <vector>
+#include "Rng.h"
+
+using namespace std;
+
+/**
+ * 重み付きの離散分布からのサンプリング。
+ * 負の重みは0とみなす。重みが全て0の場合は、一様分布とする (sampleOnceは0を返却する)。
+ *
+ *   sampleOnce		1回だけサンプリングする場合。配列を確保せず、重みを2回走査する。
+ *   AliasTable		同じ分布から何度もサンプリングする場合。構築O(n)、1回のサンプリングO(1)。(Walker/Voseのalias法)
+ *   FenwickSampler	サンプリングの合間に重みが変わる場合。重みの更新、サンプリングともO(log n)。
+ */
+namespace sampler {
+
+/**
+ * [0, 1)のdoubleの一様乱数。
+ */
+inline double uniform(Rng& rng) {
+	return (double)rng.next() / 4294967296.0;
+}
+
+/**
+ * 重みに比例する確率で、インデックスを1つ選ぶ。
+ *
+ * @param rng		乱数生成器
+ * @param weights	重み
+ * @param n			重みの数
+ * @return			選んだインデックス
+ */
+template<typename T>
+int sampleOnce(Rng& rng, const T* weights, int n) {
+	if (n <= 0) return 0;
+
+	double total = 0.0;
+	for (int i = 0; i < n; ++i) {
+		if (weights[i] > 0) total += weights[i];
+	}
+
+	double rnd = uniform(rng) * total;
+	if (total <= 0.0) return 0;
+
+	double sum = 0.0;
+	int last = 0;
+	for (int i = 0; i < n; ++i) {
+		if (!(weights[i] > 0)) continue;
+		sum += weights[i];
+		last = i;
+		if (rnd < sum) return i;
+	}
+
+	// 丸め誤差で最後まで到達した場合は、重みが正の最後のインデックス
+	return last;
+}
+
+int binomial(Rng& rng, int n, double p);
+int hypergeometric(Rng& rng, int total, int successes, int draws);
+
+/**
+ * Walker/Voseのalias法のテーブル。
+ * 各インデックスiに、確率probability[i]でi、それ以外でalias[i]を返すという表を作っておき、
+ * 一様に選んだiと1つの一様乱数で、O(1)でサンプリングする。
+ */
+class AliasTable {
+private:
+	vector<double> weights;
+	vector<float> probability;
+	vector<int> alias;
+	double total;
+	int last_positive;		// 重みが正の最後のインデックス (無ければ-1)
+
+public:
+	AliasTable() : total(0.0), last_positive(-1) {}
+	AliasTable(const float* weights, int n) { build(weights, n); }
+	AliasTable(const double* weights, int n) { build(weights, n); }
+
+	void build(const float* weights, int n);
+	void build(const double* weights, int n);
+	int size() const { return weights.size(); }
+	double totalWeight() const { return total; }
+
+	/**
+	 * インデックスを1つサンプリングする。
+	 */
+	int sample(Rng& rng) const {
+		int i = rng.uniformInt(probability.size());
+		return uniform(rng) < probability[i] ? i : alias[i];
+	}
+
+	void sampleCounts(Rng& rng, int num, vector<int>& counts) const;
+
+private:
+	void buildTable();
+};
+
+/**
+ * 重みを変更できるサンプラー。
+ * 重みの累積和を、Fenwick木 (Binary Indexed Tree) で管理する。
+ */
+class FenwickSampler {
+private:
+	vector<double> tree;		// tree[i]は、(i - (i & -i), i] の重みの和 (1始まり)
+	vector<double> weights;
+	double total;
+
+public:
+	FenwickSampler() : total(0.0) {}
+
+	template<typename T>
+	void build(const T* values, int n) {
+		weights.resize(n);
+		for (int i = 0; i < n; ++i) {
+			weights[i] = values[i] > 0 ? (double)values[i] : 0.0;
+		}
+		buildTree();
+	}
+
+	int size() const { return weights.size(); }
+	double weight(int i) const { return weights[i]; }
+	double totalWeight() const { return total; }
+
+	void set(int i, double weight);
+	void add(int i, double delta) { set(i, weights[i] + delta); }
+	int find(double target) const;
+	int sample(Rng& rng) const { return find(uniform(rng) * total); }
+
+private:
+	void buildTree();
+};
+
+}
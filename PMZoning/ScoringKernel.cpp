@@ -0,0 +1,227 @@
+﻿#include "ScoringKernel.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define SK_HAS_SIMD
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define SK_HAS_SIMD
+#endif
+
+namespace scoringkernel {
+
+namespace {
+
+/**
+ * セルbeginからnumの手前までを、スカラーで計算する。(SIMD版の端数の処理にも使う)
+ */
+void dot6GroupsScalar(const float* const props[6], const float* weights, int num_groups, int begin, int num, float* out, int out_stride) {
+	for (int u = 0; u < num_groups; ++u) {
+		const float* w = weights + u * 6;
+		float* o = out + (size_t)u * out_stride;
+		for (int i = begin; i < num; ++i) {
+			o[i] = props[0][i] * w[0] + props[1][i] * w[1] + props[2][i] * w[2] + props[3][i] * w[3] + props[4][i] * w[4] + props[5][i] * w[5];
+		}
+	}
+}
+
+#ifdef SK_HAS_SIMD
+
+void cpuid(int info[4], int leaf) {
+#if defined(_MSC_VER)
+	__cpuid(info, leaf);
+#else
+	unsigned int a, b, c, d;
+	__cpuid(leaf, a, b, c, d);
+	info[0] = a; info[1] = b; info[2] = c; info[3] = d;
+#endif
+}
+
+unsigned long long xgetbv0() {
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+/**
+ * CPUとOSがサポートする命令セットを判定する。
+ * AVXは、CPUがサポートしていても、OSがYMMレジスタを保存しない場合は使えない。
+ */
+int detect() {
+	int info[4];
+	cpuid(info, 0);
+	if (info[0] < 1) return ISA_SCALAR;
+
+	cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	if (avx && osxsave && (xgetbv0() & 0x6) == 0x6) return ISA_AVX;
+	if (sse2) return ISA_SSE2;
+	return ISA_SCALAR;
+}
+
+#if defined(__GNUC__)
+__attribute__((target("avx")))
+#endif
+void dot6GroupsAVX(const float* const props[6], const float* weights, int num_groups, int num, float* out, int out_stride) {
+	int i = 0;
+	for (; i + 8 <= num; i += 8) {
+		// propertyは1回だけ読み込み、全グループで使い回す
+		__m256 p0 = _mm256_loadu_ps(props[0] + i);
+		__m256 p1 = _mm256_loadu_ps(props[1] + i);
+		__m256 p2 = _mm256_loadu_ps(props[2] + i);
+		__m256 p3 = _mm256_loadu_ps(props[3] + i);
+		__m256 p4 = _mm256_loadu_ps(props[4] + i);
+		__m256 p5 = _mm256_loadu_ps(props[5] + i);
+
+		for (int u = 0; u < num_groups; ++u) {
+			const float* w = weights + u * 6;
+			__m256 s = _mm256_mul_ps(p0, _mm256_broadcast_ss(w));
+			s = _mm256_add_ps(s, _mm256_mul_ps(p1, _mm256_broadcast_ss(w + 1)));
+			s = _mm256_add_ps(s, _mm256_mul_ps(p2, _mm256_broadcast_ss(w + 2)));
+			s = _mm256_add_ps(s, _mm256_mul_ps(p3, _mm256_broadcast_ss(w + 3)));
+			s = _mm256_add_ps(s, _mm256_mul_ps(p4, _mm256_broadcast_ss(w + 4)));
+			s = _mm256_add_ps(s, _mm256_mul_ps(p5, _mm256_broadcast_ss(w + 5)));
+			_mm256_storeu_ps(out + (size_t)u * out_stride + i, s);
+		}
+	}
+	_mm256_zeroupper();
+
+	dot6GroupsScalar(props, weights, num_groups, i, num, out, out_stride);
+}
+
+void dot6GroupsSSE2(const float* const props[6], const float* weights, int num_groups, int num, float* out, int out_stride) {
+	int i = 0;
+	for (; i + 4 <= num; i += 4) {
+		__m128 p0 = _mm_loadu_ps(props[0] + i);
+		__m128 p1 = _mm_loadu_ps(props[1] + i);
+		__m128 p2 = _mm_loadu_ps(props[2] + i);
+		__m128 p3 = _mm_loadu_ps(props[3] + i);
+		__m128 p4 = _mm_loadu_ps(props[4] + i);
+		__m128 p5 = _mm_loadu_ps(props[5] + i);
+
+		for (int u = 0; u < num_groups; ++u) {
+			const float* w = weights + u * 6;
+			__m128 s = _mm_mul_ps(p0, _mm_load1_ps(w));
+			s = _mm_add_ps(s, _mm_mul_ps(p1, _mm_load1_ps(w + 1)));
+			s = _mm_add_ps(s, _mm_mul_ps(p2, _mm_load1_ps(w + 2)));
+			s = _mm_add_ps(s, _mm_mul_ps(p3, _mm_load1_ps(w + 3)));
+			s = _mm_add_ps(s, _mm_mul_ps(p4, _mm_load1_ps(w + 4)));
+			s = _mm_add_ps(s, _mm_mul_ps(p5, _mm_load1_ps(w + 5)));
+			_mm_storeu_ps(out + (size_t)u * out_stride + i, s);
+		}
+	}
+
+	dot6GroupsScalar(props, weights, num_groups, i, num, out, out_stride);
+}
+
+#else
+
+int detect() {
+	return ISA_SCALAR;
+}
+
+#endif
+
+// 使用する命令セット。静的初期化の時点 (スレッドを開始する前) に判定しておき、実行中は読み出すだけにする
+int detected_isa = detect();
+
+}
+
+/**
+ * 使用する命令セットを返却する。
+ */
+int instructionSet() {
+	return detected_isa;
+}
+
+/**
+ * 使用する命令セットを指定する。(ベンチマークや、結果の比較用)
+ * CPUがサポートしていない命令セットを指定した場合は、サポートされている中で最も近いものを使う。
+ * スコア計算を並列に実行している間は、呼び出さないこと。
+ */
+void setInstructionSet(int isa) {
+	int supported = detect();
+	detected_isa = isa < supported ? isa : supported;
+}
+
+const char* instructionSetName(int isa) {
+	switch (isa) {
+	case ISA_AVX: return "AVX";
+	case ISA_SSE2: return "SSE2";
+	default: return "scalar";
+	}
+}
+
+/**
+ * 6次元の内積を、num個まとめて計算する。
+ * 各スレッドから同時に呼び出してよい。
+ *
+ * @param props			各コンポーネントの配列 (6個、それぞれnum個の要素)
+ * @param weights		重み (6個)
+ * @param num			要素数
+ * @param out [OUT]		内積の結果 (num個)
+ */
+void dot6(const float* const props[6], const float* weights, int num, float* out) {
+	dot6Groups(props, weights, 1, num, out, num);
+}
+
+/**
+ * 複数の重みベクトルについて、6次元の内積をnum個ずつまとめて計算する。
+ * propertyは、一度読み込んだら全ての重みベクトルで使い回す。
+ * 各スレッドから同時に呼び出してよい。
+ *
+ * @param props			各コンポーネントの配列 (6個、それぞれnum個の要素)
+ * @param weights		重み (num_groups x 6)
+ * @param num_groups	重みベクトルの数
+ * @param num			要素数
+ * @param out [OUT]		内積の結果 (重みベクトルuの結果は、out + u * out_strideからnum個)
+ * @param out_stride	重みベクトル1つあたりの、outの間隔
+ */
+void dot6Groups(const float* const props[6], const float* weights, int num_groups, int num, float* out, int out_stride) {
+	switch (detected_isa) {
+#ifdef SK_HAS_SIMD
+	case ISA_AVX:
+		dot6GroupsAVX(props, weights, num_groups, num, out, out_stride);
+		break;
+	case ISA_SSE2:
+		dot6GroupsSSE2(props, weights, num_groups, num, out, out_stride);
+		break;
+#endif
+	default:
+		dot6GroupsScalar(props, weights, num_groups, 0, num, out, out_stride);
+		break;
+	}
+}
+
+/**
+ * まとめられたnum_zonings個のゾーニングについて、全重みベクトル×全セルの内積を一括して計算する。
+ * propertyは、ゾーニング × コンポーネント × セル の順に並んでいること。(ZoningBatchの形式)
+ *
+ * @param properties	propertyの先頭
+ * @param stride		1コンポーネントあたりの要素数 (パディング込み)
+ * @param num_zonings	ゾーニングの数
+ * @param weights		重み (num_groups x 6)
+ * @param num_groups	重みベクトルの数
+ * @param num			1ゾーニングあたりのセルの数
+ * @param out [OUT]		内積の結果 (ゾーニング × 重みベクトル × セル、num_zonings * num_groups * num個)
+ */
+void dot6Batch(const float* properties, int stride, int num_zonings, const float* weights, int num_groups, int num, float* out) {
+	for (int n = 0; n < num_zonings; ++n) {
+		const float* props[6];
+		for (int k = 0; k < 6; ++k) {
+			props[k] = properties + ((size_t)n * 6 + k) * stride;
+		}
+		dot6Groups(props, weights, num_groups, num, out + (size_t)n * num_groups * num, num);
+	}
+}
+
+}
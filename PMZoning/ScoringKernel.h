@@ -0,0 +1,24 @@
+﻿#pragma once
+
+/**
+ * スコア計算用の、6次元の内積カーネル。
+ * out[i] = Σ_k props[k][i] * weights[k]
+ * 複数の重みベクトルや、まとめた複数のゾーニングについても、一括して計算できる。
+ * CPUがサポートする命令セットを実行時に判定し、AVX / SSE2 / スカラーのいずれかで計算する。
+ */
+namespace scoringkernel {
+
+enum {
+	ISA_SCALAR = 0,
+	ISA_SSE2,
+	ISA_AVX
+};
+
+int instructionSet();
+void setInstructionSet(int isa);
+const char* instructionSetName(int isa);
+void dot6(const float* const props[6], const float* weights, int num, float* out);
+void dot6Groups(const float* const props[6], const float* weights, int num_groups, int num, float* out, int out_stride);
+void dot6Batch(const float* properties, int stride, int num_zonings, const float* weights, int num_groups, int num, float* out);
+
+}
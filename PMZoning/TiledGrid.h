@@ -0,0 +1,173 @@
+﻿#pragma once
+
+#include <vector>
+#include <string.h>
+#include <opencv/cv.h>
+#include <QString>
+#include <QTemporaryFile>
+#include <boost/shared_ptr.hpp>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * 固定サイズの正方形のタイルに分割して保持する、2次元のグリッド。
+ * 各タイルのセルは連続した領域に格納するので、タイル単位で読み書きする時は、そのタイルの領域だけにアクセスする。
+ *
+ * spill_dirを指定した場合は、そのディレクトリに作った一時ファイルをメモリにマップして格納する。
+ * グリッド全体がメモリに収まらなくても、OSが必要なタイルだけを読み込み、使っていないタイルはファイルに書き出す。
+ * 一時ファイルは、TiledGridの破棄とともに削除される。
+ *
+ * readTile()は、周囲haloセル分の隣のタイルのセル (halo) を含めて読み込むので、
+ * 隣接セルを参照する処理 (セルオートマトンなど) も、タイルごとに行える。
+ * グリッドの外側のセルは、fillの値として読み出される。
+ */
+template<typename T>
+class TiledGrid {
+private:
+	int num_rows;
+	int num_cols;
+	int tile_size;
+	int tile_rows;			// 縦方向のタイルの数
+	int tile_cols;			// 横方向のタイルの数
+	T fill;
+	vector<T> memory;
+	boost::shared_ptr<QTemporaryFile> file;
+	T* cells;
+
+public:
+	TiledGrid() : num_rows(0), num_cols(0), tile_size(0), tile_rows(0), tile_cols(0), fill(T()), cells(NULL) {}
+
+	/**
+	 * グリッドを確保する。
+	 *
+	 * @param rows			行数
+	 * @param cols			列数
+	 * @param tile_size		タイルの一辺のセル数
+	 * @param fill			初期値 (グリッドの外側のセルの値)
+	 * @param spill_dir		一時ファイルを作るディレクトリ (空ならメモリに確保する)
+	 * @return				確保できたらtrue
+	 */
+	bool create(int rows, int cols, int tile_size, T fill, const QString& spill_dir = QString()) {
+		num_rows = rows;
+		num_cols = cols;
+		this->tile_size = tile_size;
+		tile_rows = (rows + tile_size - 1) / tile_size;
+		tile_cols = (cols + tile_size - 1) / tile_size;
+		this->fill = fill;
+		size_t count = (size_t)tile_rows * tile_cols * tile_size * tile_size;
+
+		memory.clear();
+		file.reset();
+		cells = NULL;
+
+		if (spill_dir.isEmpty()) {
+			memory.assign(count, fill);
+			cells = memory.empty() ? NULL : &memory[0];
+			return true;
+		}
+
+		file = boost::shared_ptr<QTemporaryFile>(new QTemporaryFile(spill_dir + "/tiledgrid_XXXXXX"));
+		if (!file->open() || !file->resize(count * sizeof(T))) {
+			file.reset();
+			return false;
+		}
+		cells = (T*)file->map(0, count * sizeof(T));
+		if (cells == NULL) {
+			file.reset();
+			return false;
+		}
+
+		// 一時ファイルは0で埋められているので、それ以外の初期値の場合だけ書き込む
+		T zero = T();
+		if (memcmp(&fill, &zero, sizeof(T)) != 0) {
+			for (size_t i = 0; i < count; ++i) cells[i] = fill;
+		}
+		return true;
+	}
+
+	int rows() const { return num_rows; }
+	int cols() const { return num_cols; }
+	int tileSize() const { return tile_size; }
+	int tileRows() const { return tile_rows; }
+	int tileCols() const { return tile_cols; }
+	bool isSpilled() const { return file.get() != NULL; }
+
+	T operator()(int r, int c) const {
+		if (r < 0 || r >= num_rows || c < 0 || c >= num_cols) return fill;
+		return *cell(r, c);
+	}
+
+	void set(int r, int c, T value) {
+		if (r < 0 || r >= num_rows || c < 0 || c >= num_cols) return;
+		*cell(r, c) = value;
+	}
+
+	/**
+	 * (r0, c0)を左上とする、blockと同じ大きさの範囲を読み込む。
+	 * 範囲はタイルの境界やグリッドの外側にまたがってもよい。
+	 */
+	void read(int r0, int c0, Mat_<T>& block) const {
+		for (int br = 0; br < block.rows; ++br) {
+			int r = r0 + br;
+			T* out = block[br];
+			if (r < 0 || r >= num_rows) {
+				for (int bc = 0; bc < block.cols; ++bc) out[bc] = fill;
+				continue;
+			}
+
+			for (int bc = 0; bc < block.cols; ) {
+				int c = c0 + bc;
+				if (c < 0 || c >= num_cols) {
+					out[bc++] = fill;
+					continue;
+				}
+
+				// 同じタイルの中の連続したセルを、まとめてコピーする
+				int length = min(block.cols - bc, min((c / tile_size + 1) * tile_size, num_cols) - c);
+				memcpy(out + bc, cell(r, c), length * sizeof(T));
+				bc += length;
+			}
+		}
+	}
+
+	/**
+	 * (r0, c0)を左上とする、blockと同じ大きさの範囲に書き込む。グリッドの外側は無視する。
+	 */
+	void write(int r0, int c0, const Mat_<T>& block) {
+		for (int br = max(0, -r0); br < block.rows && r0 + br < num_rows; ++br) {
+			int r = r0 + br;
+			const T* in = block[br];
+			for (int bc = max(0, -c0); bc < block.cols && c0 + bc < num_cols; ) {
+				int c = c0 + bc;
+				int length = min(block.cols - bc, min((c / tile_size + 1) * tile_size, num_cols) - c);
+				memcpy(cell(r, c), in + bc, length * sizeof(T));
+				bc += length;
+			}
+		}
+	}
+
+	/**
+	 * タイルを、周囲haloセル分を含めて読み込む。blockは、(tile_size + 2 * halo)の正方形になる。
+	 */
+	void readTile(int tr, int tc, int halo, Mat_<T>& block) const {
+		block.create(tile_size + halo * 2, tile_size + halo * 2);
+		read(tr * tile_size - halo, tc * tile_size - halo, block);
+	}
+
+	/**
+	 * タイルに書き込む。blockは、tile_sizeの正方形であること。
+	 */
+	void writeTile(int tr, int tc, const Mat_<T>& block) {
+		write(tr * tile_size, tc * tile_size, block);
+	}
+
+private:
+	TiledGrid(const TiledGrid& ref);
+	TiledGrid& operator=(const TiledGrid& ref);
+
+	T* cell(int r, int c) const {
+		size_t tile = (size_t)(r / tile_size) * tile_cols + c / tile_size;
+		return cells + tile * tile_size * tile_size + (r % tile_size) * tile_size + c % tile_size;
+	}
+};
@@ -0,0 +1,269 @@
+﻿#include "TiledZoning.h"
+#include "Zoning.h"
+#include "RoadRaster.h"
+#include "DistanceTransform.h"
+#include "Util.h"
+#include <assert.h>
+#include <math.h>
+
+const int TiledZoning::NUM_TYPES;
+const uchar TiledZoning::TYPE_UNUSED;
+
+/**
+ * グリッドを確保し、major道路までの距離マップを計算する。
+ * 一時ファイルを作れなかった場合は、isValid()がfalseになる。
+ * ゾーンの配分率は、initialZoning()で指定する。
+ *
+ * @param city_size				cityの一辺の距離 [m]
+ * @param grid_size				グリッドの一辺のサイズ
+ * @param roads					道路網
+ * @param tile_size				タイルの一辺のセル数
+ * @param spill_dir				グリッドを一時ファイルに置く場合の、ディレクトリ (空ならメモリに置く)
+ */
+TiledZoning::TiledZoning(int city_size, int grid_size, const RoadSnapshotPtr& roads, int tile_size, const QString& spill_dir) : automaton(tile_size) {
+	this->city_size = city_size;
+	this->grid_size = grid_size;
+	this->tile_size = tile_size;
+	this->spill_dir = spill_dir;
+	this->roads = roads;
+	front = 0;
+	needs.resize(NUM_TYPES, 0);
+
+	valid = zones[0].create(grid_size, grid_size, tile_size, TYPE_UNUSED, spill_dir)
+		&& zones[1].create(grid_size, grid_size, tile_size, TYPE_UNUSED, spill_dir);
+
+	// major道路 (avenue、highway) までの距離マップ
+	TiledGrid<uchar> mask;
+	valid = valid && rasterizeRoads(RoadEdge::TYPE_AVENUE | RoadEdge::TYPE_HIGHWAY, mask) && distanceTransform(mask, road_distances);
+}
+
+/**
+ * 指定された配分率に基づき、ランダムに初期ゾーンを決定する。
+ * PMZoning::initialZoning()と同じ方法で、タイルごとに決める。
+ *
+ * @param zone_distribution		ゾーンタイプの配分率
+ * @param rng					乱数生成器
+ */
+void TiledZoning::initialZoning(vector<float>& zone_distribution, Rng& rng) {
+	assert(zone_distribution.size() == NUM_TYPES);
+
+	vector<float> expectedNums(NUM_TYPES);
+	for (int i = 0; i < NUM_TYPES; ++i) {
+		expectedNums[i] = (float)grid_size * grid_size * zone_distribution[i];
+	}
+
+	Mat_<uchar> tile(tile_size, tile_size, TYPE_UNUSED);
+	for (int tr = 0; tr < zones[front].tileRows(); ++tr) {
+		for (int tc = 0; tc < zones[front].tileCols(); ++tc) {
+			int rows = min(tile_size, grid_size - tr * tile_size);
+			int cols = min(tile_size, grid_size - tc * tile_size);
+			for (int r = 0; r < rows; ++r) {
+				for (int c = 0; c < cols; ++c) {
+					unsigned char type = Util::sampleFromPdf(rng, expectedNums);
+					tile(r, c) = type;
+					expectedNums[type]--;
+				}
+			}
+			zones[front].writeTile(tr, tc, tile);
+		}
+	}
+
+	needs.assign(NUM_TYPES, 0);
+}
+
+/**
+ * セルオートマトンで、ゾーンマップを1ステップ進める。
+ * 各タイルは、周囲1セル分 (halo) を含めて更新前のゾーンマップから読み込み、結果はもう1つのゾーンマップに書き込むので、
+ * タイルの境界のセルも、グリッド全体を一度に更新した場合と同じ隣接セルを参照する。
+ *
+ * @param rng		乱数生成器
+ */
+void TiledZoning::update(Rng& rng) {
+	TiledGrid<uchar>& src = zones[front];
+	TiledGrid<uchar>& dst = zones[1 - front];
+
+	Mat_<uchar> padded;
+	Mat_<float> distances;
+	for (int tr = 0; tr < src.tileRows(); ++tr) {
+		for (int tc = 0; tc < src.tileCols(); ++tc) {
+			src.readTile(tr, tc, 1, padded);
+			road_distances.readTile(tr, tc, 0, distances);
+
+			automaton.setPaddedZones(padded);
+			automaton.setRoadAccessibility(distances, 50);
+			automaton.step(needs, rng);
+
+			dst.writeTile(tr, tc, automaton.zones());
+		}
+	}
+
+	front = 1 - front;
+}
+
+/**
+ * 指定されたゾーンタイプに関する距離マップ [m] を計算する。
+ *
+ * @param type				ゾーンタイプ
+ * @param distMap [OUT]		距離マップ
+ * @return					グリッドを確保できたらtrue
+ */
+bool TiledZoning::computeDistanceMap(int type, TiledGrid<float>& distMap) {
+	TiledGrid<uchar> data;
+	if (!data.create(grid_size, grid_size, tile_size, 0, spill_dir)) return false;
+
+	Mat_<uchar> tile;
+	for (int tr = 0; tr < data.tileRows(); ++tr) {
+		for (int tc = 0; tc < data.tileCols(); ++tc) {
+			zones[front].readTile(tr, tc, 0, tile);
+			for (int r = 0; r < tile_size; ++r) {
+				for (int c = 0; c < tile_size; ++c) {
+					tile(r, c) = tile(r, c) == type ? 1 : 0;
+				}
+			}
+			data.writeTile(tr, tc, tile);
+		}
+	}
+
+	return distanceTransform(data, distMap);
+}
+
+/**
+ * ゾーンを画像として保存する。
+ * 画像の各画素に対応するセルの色を、タイルごとに埋めてから、Zoning::save()と同様に道路を描画する。
+ *
+ * @param filename		ファイル名
+ * @param img_size		画像の一辺のサイズ
+ */
+void TiledZoning::save(const char* filename, int img_size) {
+	Mat m(img_size, img_size, CV_8UC3);
+
+	Mat_<uchar> tile;
+	for (int tr = 0; tr < zones[front].tileRows(); ++tr) {
+		for (int tc = 0; tc < zones[front].tileCols(); ++tc) {
+			zones[front].readTile(tr, tc, 0, tile);
+
+			// このタイルのセルに対応する画素の範囲 (画素yのセルは、y * grid_size / img_size)
+			int r0 = tr * tile_size;
+			int c0 = tc * tile_size;
+			int r1 = min(grid_size, r0 + tile_size);
+			int c1 = min(grid_size, c0 + tile_size);
+			int y0 = (int)(((qint64)r0 * img_size + grid_size - 1) / grid_size);
+			int y1 = (int)(((qint64)r1 * img_size + grid_size - 1) / grid_size);
+			int x0 = (int)(((qint64)c0 * img_size + grid_size - 1) / grid_size);
+			int x1 = (int)(((qint64)c1 * img_size + grid_size - 1) / grid_size);
+
+			for (int y = y0; y < y1; ++y) {
+				int r = (int)((qint64)y * grid_size / img_size);
+				for (int x = x0; x < x1; ++x) {
+					int c = (int)((qint64)x * grid_size / img_size);
+					m.at<cv::Vec3b>(y, x) = Zoning::zoneColor(tile(r - r0, c - c0));
+				}
+			}
+		}
+	}
+
+	// 道路を表示
+	Zoning::drawRoads(*roads, city_size, m);
+
+	cv::flip(m, m, 0);
+	cv::imwrite(filename, m);
+}
+
+/**
+ * 指定したタイプの道路を、タイルごとに描画する。
+ * 先に各線分を、バウンディングボックスが重なるタイルに振り分けておき、タイルごとにそのタイルの線分だけを描画する。
+ *
+ * @param road_types	描画する道路のタイプ (RoadEdge::TYPE_XXXの論理和)
+ * @param mask [OUT]	道路が通るセルは1
+ * @return				グリッドを確保できたらtrue
+ */
+bool TiledZoning::rasterizeRoads(int road_types, TiledGrid<uchar>& mask) {
+	if (!mask.create(grid_size, grid_size, tile_size, 0, spill_dir)) return false;
+
+	// タイルごとの線分 (エッジ, polylineの線分の番号)
+	int tile_rows = mask.tileRows();
+	int tile_cols = mask.tileCols();
+	vector<vector<pair<int, int> > > segments(tile_rows * tile_cols);
+	float scale = (float)grid_size / city_size;
+	float offset = grid_size * 0.5f;
+	for (int e = 0; e < roads->numEdges(); ++e) {
+		if (!(roads->edgeType(e) & road_types)) continue;
+
+		int num_points = roads->polylineSize(e);
+		for (int i = 0; i < max(1, num_points - 1); ++i) {
+			QVector2D a = roads->polylinePt(e, i) * scale + QVector2D(offset, offset);
+			QVector2D b = i + 1 < num_points ? roads->polylinePt(e, i + 1) * scale + QVector2D(offset, offset) : a;
+
+			int tc0 = max(0, (int)floorf(min(a.x(), b.x()) / tile_size));
+			int tc1 = min(tile_cols - 1, (int)floorf(max(a.x(), b.x()) / tile_size));
+			int tr0 = max(0, (int)floorf(min(a.y(), b.y()) / tile_size));
+			int tr1 = min(tile_rows - 1, (int)floorf(max(a.y(), b.y()) / tile_size));
+			for (int tr = tr0; tr <= tr1; ++tr) {
+				for (int tc = tc0; tc <= tc1; ++tc) {
+					segments[tr * tile_cols + tc].push_back(make_pair(e, i));
+				}
+			}
+		}
+	}
+
+	Mat_<uchar> tile;
+	for (int tr = 0; tr < tile_rows; ++tr) {
+		for (int tc = 0; tc < tile_cols; ++tc) {
+			const vector<pair<int, int> >& list = segments[tr * tile_cols + tc];
+			if (list.empty()) continue;
+
+			// タイルの左下の角を原点とするグリッド座標で描画する
+			tile = Mat_<uchar>::zeros(tile_size, tile_size);
+			QVector2D origin(tc * tile_size - offset, tr * tile_size - offset);
+			for (int k = 0; k < list.size(); ++k) {
+				int e = list[k].first;
+				int i = list[k].second;
+				QVector2D a = roads->polylinePt(e, i) * scale - origin;
+				QVector2D b = i + 1 < roads->polylineSize(e) ? roads->polylinePt(e, i + 1) * scale - origin : a;
+				RoadRaster::drawSegment(tile, a, b);
+			}
+			mask.writeTile(tr, tc, tile);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * 厳密なユークリッド距離変換を、帯ごとに計算する。
+ * 1段目 (列方向) はタイル1列分の縦長の帯ごと、2段目 (行方向) はタイル1行分の横長の帯ごとに行い、
+ * 帯の間の中間結果は、TiledGridに置く。
+ *
+ * @param data			1 - 対象 / 0 - 無し
+ * @param dist [OUT]	直近の対象までの距離 [m]
+ * @return				グリッドを確保できたらtrue
+ */
+bool TiledZoning::distanceTransform(const TiledGrid<uchar>& data, TiledGrid<float>& dist) {
+	TiledGrid<int> g;
+	if (!g.create(grid_size, grid_size, tile_size, distancetransform::NO_FEATURE, spill_dir)) return false;
+	if (!dist.create(grid_size, grid_size, tile_size, 0.0f, spill_dir)) return false;
+
+	for (int tc = 0; tc < data.tileCols(); ++tc) {
+		int c0 = tc * tile_size;
+		Mat_<uchar> strip(grid_size, min(tile_size, grid_size - c0));
+		data.read(0, c0, strip);
+
+		Mat_<int> g_strip;
+		distancetransform::computeColumnDistances(strip, g_strip);
+		g.write(0, c0, g_strip);
+	}
+
+	for (int tr = 0; tr < data.tileRows(); ++tr) {
+		int r0 = tr * tile_size;
+		Mat_<int> g_strip(min(tile_size, grid_size - r0), grid_size);
+		g.read(r0, 0, g_strip);
+
+		// グリッドサイズを、実際の距離に変換する
+		Mat_<float> strip;
+		distancetransform::computeRowDistances(g_strip, strip);
+		strip *= (float)city_size / grid_size;
+		dist.write(r0, 0, strip);
+	}
+
+	return true;
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+
+#include <vector>
+#include <opencv/cv.h>
+#include <QString>
+#include "RoadSnapshot.h"
+#include "Rng.h"
+#include "TiledGrid.h"
+#include "CellularAutomaton.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * 都市圏全体のような、メモリに収まらない大きさのグリッドで、PMZoningと同じゾーニングを生成する。
+ *
+ * ゾーンマップと道路までの距離マップをTiledGridで保持し、全ての処理をタイルまたは帯ごとに行うので、
+ * グリッド全体を一度に読み込むことはない。作業用のメモリは、更新と保存ではタイルの大きさ分だが、
+ * 距離マップの計算では帯 (グリッドの一辺×タイルの一辺) の大きさ分になる。
+ * (spill_dirを指定すれば、グリッド自体も一時ファイルにマップする)
+ *   - update(): ゾーンマップのタイルを、周囲1セル分の隣のタイルのセルと一緒に読み込み、
+ *     CellularAutomatonで1ステップ進める。タイルの順 (行優先) に処理し、ニーズと乱数系列はタイル間で引き継ぐ。
+ *   - 距離マップ: 分離可能な厳密EDTの1段目を縦長の帯 (タイル1列分) ごと、2段目を横長の帯 (タイル1行分) ごとに行う。
+ *     帯の大きさはグリッドの一辺×タイルの一辺なので、グリッド全体を一度に読み込むことはない。
+ *   - save(): タイルごとに、出力画像の対応する画素を埋める。
+ *
+ * 道路は、タイルごとに、そのタイルにかかる線分だけを描画する。
+ */
+class TiledZoning {
+private:
+	static const int NUM_TYPES = 4;
+	static const uchar TYPE_UNUSED = 9;
+
+	int city_size;		// cityの一辺の距離 [m]
+	int grid_size;		// グリッドの一辺のサイズ
+	int tile_size;		// タイルの一辺のセル数
+	QString spill_dir;
+	RoadSnapshotPtr roads;
+	bool valid;
+	TiledGrid<uchar> zones[2];			// ゾーンマップ (1ステップごとに読み込み用と書き込み用を入れ替える)
+	int front;							// 現在のゾーンマップ
+	TiledGrid<float> road_distances;	// major道路までの距離マップ [m]
+	vector<float> needs;
+	CellularAutomaton automaton;
+
+public:
+	TiledZoning(int city_size, int grid_size, const RoadSnapshotPtr& roads, int tile_size = 256, const QString& spill_dir = QString());
+
+	bool isValid() const { return valid; }
+	int gridSize() const { return grid_size; }
+	int tileSize() const { return tile_size; }
+	const TiledGrid<uchar>& zoneMap() const { return zones[front]; }
+	void setNeedsMode(int mode) { automaton.setNeedsMode(mode); }
+
+	void initialZoning(vector<float>& zone_distribution, Rng& rng);
+	void update(Rng& rng);
+	bool computeDistanceMap(int type, TiledGrid<float>& distMap);
+	void save(const char* filename, int img_size);
+
+private:
+	TiledZoning(const TiledZoning& ref);
+	TiledZoning& operator=(const TiledZoning& ref);
+	bool rasterizeRoads(int road_types, TiledGrid<uchar>& mask);
+	bool distanceTransform(const TiledGrid<uchar>& data, TiledGrid<float>& dist);
+};
@@ -1,4 +1,5 @@
 ﻿#include "Util.h"
+#include "Sampler.h"
 #include <random>
 
 
@@ -364,60 +365,57 @@ float Util::curvature(const Polyline2D &polyline) {
 
 /**
  * Uniform乱数[0, 1)を生成する
+ * プロセス共有の乱数生成器を使用するので、スレッドセーフではない。
  */
 float Util::genRand() {
-	return rand() / (float(RAND_MAX) + 1);
+	return genRand(Rng::global());
 }
 
 /**
  * 指定された範囲[a, b)のUniform乱数を生成する
  */
 float Util::genRand(float a, float b) {
-	return genRand() * (b - a) + a;
+	return genRand(Rng::global(), a, b);
 }
 
 /**
  * Normal distributionを使用して乱数を生成する。
  */
 float Util::genRandNormal(float mean, float variance) {
-	/*
-	static std::default_random_engine generator;
+	return genRandNormal(Rng::global(), mean, variance);
+}
 
-	std::normal_distribution<float> distribution(mean, sqrtf(variance));
-	return distribution(generator);
-	*/
+int Util::sampleFromCdf(std::vector<float> &cdf) {
+	return sampleFromCdf(Rng::global(), cdf);
+}
 
-#if 1
-	float m = mean;
-	float s = sqrt(variance);
+int Util::sampleFromPdf(std::vector<float> &pdf) {
+	return sampleFromPdf(Rng::global(), pdf);
+}
 
-	/* mean m, standard deviation s */
-	float x1, x2, w, y1;
-	static float y2;
-	static int use_last = 0;
+/**
+ * 指定された乱数生成器を使って、Uniform乱数[0, 1)を生成する
+ */
+float Util::genRand(Rng& rng) {
+	return rng.uniform();
+}
 
-	if (use_last) {	/* use value from previous call */
-		y1 = y2;
-		use_last = 0;
-	} else {
-		do {
-			x1 = 2.0 * genRand(0.0f, 1.0f) - 1.0;
-			x2 = 2.0 * genRand(0.0f, 1.0f) - 1.0;
-			w = x1 * x1 + x2 * x2;
-		} while ( w >= 1.0 );
-
-		w = sqrt( (-2.0 * log( w ) ) / w );
-		y1 = x1 * w;
-		y2 = x2 * w;
-		use_last = 1;
-	}
+/**
+ * 指定された乱数生成器を使って、指定された範囲[a, b)のUniform乱数を生成する
+ */
+float Util::genRand(Rng& rng, float a, float b) {
+	return rng.uniform(a, b);
+}
 
-	return m + y1 * s;
-#endif
+/**
+ * 指定された乱数生成器を使って、Normal distributionの乱数を生成する。
+ */
+float Util::genRandNormal(Rng& rng, float mean, float variance) {
+	return rng.normal(mean, variance);
 }
 
-int Util::sampleFromCdf(std::vector<float> &cdf) {
-	float rnd = genRand(0, cdf.back());
+int Util::sampleFromCdf(Rng& rng, std::vector<float> &cdf) {
+	float rnd = genRand(rng, 0, cdf.back());
 
 	for (int i = 0; i < cdf.size(); ++i) {
 		if (rnd <= cdf[i]) return i;
@@ -426,20 +424,10 @@ int Util::sampleFromCdf(std::vector<float> &cdf) {
 	return cdf.size() - 1;
 }
 
-int Util::sampleFromPdf(std::vector<float> &pdf) {
+int Util::sampleFromPdf(Rng& rng, std::vector<float> &pdf) {
 	if (pdf.size() == 0) return 0;
 
-	std::vector<float> cdf(pdf.size(), 0.0f);
-	cdf[0] = pdf[0];
-	for (int i = 1; i < pdf.size(); ++i) {
-		if (pdf[i] >= 0) {
-			cdf[i] = cdf[i - 1] + pdf[i];
-		} else {
-			cdf[i] = cdf[i - 1];
-		}
-	}
-
-	return sampleFromCdf(cdf);
+	return sampler::sampleOnce(rng, &pdf[0], pdf.size());
 }
 
 /**
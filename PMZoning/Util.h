@@ -3,6 +3,7 @@
 #include <QGenericMatrix>
 #include "common.h"
 #include "Polyline2D.h"
+#include "Rng.h"
 
 class Util {
 	static const float MTC_FLOAT_TOL;
@@ -51,6 +52,11 @@ public:
 	static float genRandNormal(float mean, float variance);
 	static int sampleFromCdf(std::vector<float> &cdf);
 	static int sampleFromPdf(std::vector<float> &pdf);
+	static float genRand(Rng& rng);
+	static float genRand(Rng& rng, float a, float b);
+	static float genRandNormal(Rng& rng, float mean, float variance);
+	static int sampleFromCdf(Rng& rng, std::vector<float> &cdf);
+	static int sampleFromPdf(Rng& rng, std::vector<float> &pdf);
 
 	// Barycentric interpolation
 	static float barycentricInterpolation(const QVector3D& p0, const QVector3D& p1, const QVector3D& p2, const QVector2D& p);
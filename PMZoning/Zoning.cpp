@@ -1,34 +1,68 @@
 ﻿#include "Zoning.h"
 #include "ModifiedBrushFire.h"
+#include "DistanceTransform.h"
+#include "ZoningScorer.h"
+#include "ZoningBatch.h"
+#include "RoadRaster.h"
 #include "GraphUtil.h"
 #include <QFile>
 #include <QTextStream>
 #include "Util.h"
+#include "KMeans.h"
 
 const int Zoning::NUM_TYPES = 4;
 const int Zoning::NUM_COMPONENTS = 6;
 
-Zoning::Zoning(int city_size, int grid_size, vector<float>& zone_distribution, RoadGraph& roads) {
+Zoning::Zoning(int city_size, int grid_size, vector<float>& zone_distribution, const RoadSnapshotPtr& roads, int road_grid_size) {
 	this->city_size = city_size;
 	this->grid_size = grid_size;
 	this->zone_distribution = zone_distribution;
 	this->roads = roads;
 
 	zones = Mat_<uchar>::zeros(grid_size, grid_size);
+	distance_backend = distancetransform::BACKEND_EXACT_EDT;
+
+	// 道路は変化しないので、道路までの距離マップはキャッシュから取得し、他のZoningと共有する
+	// majorなら、avenue、highwayのみを考慮、minorなら、local streetのみを考慮する
+	// road_grid_sizeがgrid_sizeより大きければ、そのグリッドサイズのマップを縮小して使う (多重解像度用)
+	int road_types[2] = { RoadEdge::TYPE_AVENUE | RoadEdge::TYPE_HIGHWAY, RoadEdge::TYPE_STREET };
+	for (int k = 0; k < 2; ++k) {
+		RoadRasterPtr raster = RoadRaster::get(*roads, city_size, grid_size, road_types[k], distance_backend, road_grid_size);
+		road_distances[k] = raster->distanceMap();
+		properties[NUM_TYPES + k] = raster->accessibilityMap();
+	}
+
+	brushfires_valid = false;
+	changed_mask = Mat_<uchar>::zeros(grid_size, grid_size);
+}
 
-	computeAccessibility(0, properties[COM_MAJOR_ROADS]);
-	computeAccessibility(1, properties[COM_MINOR_ROADS]);
+Zoning::Zoning(const Zoning &ref) {
+	*this = ref;
 }
 
+/**
+ * ゾーンマップと、ゾーンタイプのpropertyだけをコピーする。
+ * 道路網と道路のマップは変化しないので、コピーせずに共有する。
+ */
 Zoning& Zoning::operator=(const Zoning &ref) {
 	city_size = ref.city_size;
 	grid_size = ref.grid_size;
+	distance_backend = ref.distance_backend;
 	ref.zones.copyTo(zones);
-	GraphUtil::copyRoads(ref.roads, roads);
-	copy(ref.zone_distribution.begin(), ref.zone_distribution.end(), zone_distribution.begin());
-	for (int i = 0; i < NUM_COMPONENTS; ++i) {
+	roads = ref.roads;
+	zone_distribution = ref.zone_distribution;
+	for (int i = 0; i < NUM_TYPES; ++i) {
 		ref.properties[i].copyTo(properties[i]);
 	}
+	for (int i = 0; i < 2; ++i) {
+		properties[NUM_TYPES + i] = ref.properties[NUM_TYPES + i];
+		road_distances[i] = ref.road_distances[i];
+	}
+
+	// brushfireは共有できないので、次のcomputePropertyVectors()で作り直す
+	brushfires_valid = false;
+	changed_mask = Mat_<uchar>::zeros(grid_size, grid_size);
+	changed_cells.clear();
 
 	return *this;
 }
@@ -42,98 +76,153 @@ Zoning& Zoning::operator=(const Zoning &ref) {
  *   - 公園への近さ
  *   - major道路への近さ
  *   - minor道路への近さ
+ * 道路への近さは、コンストラクタで計算済み。
+ * 前回の計算以降に変化したセルが分かっている場合は、brushfireで差分だけ更新する。
  */
 void Zoning::computePropertyVectors() {
-	// 各propertyベクトル用の行列を初期化
-	for (int k = 0; k < NUM_COMPONENTS; ++k) {
-		properties[k] = Mat_<float>(grid_size, grid_size);
+	// 変化したセルが多すぎる場合は、最初から計算し直した方が速い
+	if (brushfires_valid && changed_cells.size() <= grid_size * grid_size / 8) {
+		updatePropertyVectors();
+		return;
 	}
 
-	// 各要素ごとに、距離マップを計算
-	Mat_<float> distMap[NUM_COMPONENTS];
+	// 各ゾーンタイプごとに、距離マップを計算
 	for (int k = 0; k < NUM_TYPES; ++k) {
-		computeDistanceMap(k, distMap[k]);
-	}
-	computeAccessibility(0, distMap[NUM_TYPES]);
-	computeAccessibility(1, distMap[NUM_TYPES + 1]);
+		Mat_<float> distMap;
+		computeDistanceMap(k, distMap);
 
-	// 距離マップに基づいて、propertyベクトルを生成する
-	for (int r = 0; r < grid_size; ++r) {
-		for (int c = 0; c < grid_size; ++c) {
-			for (int k = 0; k < NUM_COMPONENTS; ++k) {
-				properties[k](r, c) = attenuation(distMap[k](r, c), 50);
+		// 距離マップに基づいて、propertyベクトルを生成する
+		properties[k] = Mat_<float>(grid_size, grid_size);
+		for (int r = 0; r < grid_size; ++r) {
+			for (int c = 0; c < grid_size; ++c) {
+				properties[k](r, c) = attenuation(distMap(r, c), 50);
 			}
 		}
 	}
+
+	zones.copyTo(brushfire_zones);
+	brushfires_valid = true;
+
+	for (int i = 0; i < changed_cells.size(); ++i) {
+		changed_mask(changed_cells[i] / grid_size, changed_cells[i] % grid_size) = 0;
+	}
+	changed_cells.clear();
 }
 
 /**
- * スコアを計算する。
- *
- * @param preferences		ユーザのpreferenceベクトル (vector<重み、好みベクトル>)
+ * 前回のcomputePropertyVectors()以降に変化したセルだけを、各brushfireに反映し、
+ * 距離が変化したセルのpropertyだけを更新する。
  */
-float Zoning::computeScore(vector<pair<float, vector<float> > >& preferences) {
-	std::vector<std::vector<std::pair<float, Vec2i> > > all_scores(preferences.size());
-
-	int num_cells = 0;
-
-	// 各セルの、各ユーザによるスコアを計算
-	for (int r = 0; r < grid_size; ++r) {
-		for (int c = 0; c < grid_size; ++c) {
-			if (zones(r, c) != TYPE_RESIDENTIAL) continue;
+void Zoning::updatePropertyVectors() {
+	for (int i = 0; i < changed_cells.size(); ++i) {
+		int r = changed_cells[i] / grid_size;
+		int c = changed_cells[i] % grid_size;
+		changed_mask(r, c) = 0;
+
+		// 途中で元に戻ったセルは、何もしない
+		uchar old_type = brushfire_zones(r, c);
+		uchar new_type = zones(r, c);
+		if (old_type == new_type) continue;
+
+		if (old_type < NUM_TYPES) brushfires[old_type]->removeStore(r, c);
+		if (new_type < NUM_TYPES) brushfires[new_type]->setStore(r, c);
+		brushfire_zones(r, c) = new_type;
+	}
+	changed_cells.clear();
 
-			num_cells++;
+	for (int k = 0; k < NUM_TYPES; ++k) {
+		brushfires[k]->updateDistanceMap();
 
-			for (int u = 0; u < preferences.size(); ++u) {
-				float score = 0.0f;
-				for (int k = 0; k < 6; ++k) {
-					score += properties[k](r, c) * preferences[u].second[k];
-				}
+		const vector<Vec2i>& updated = brushfires[k]->updatedCells();
+		const Mat_<float>& dist = brushfires[k]->distMap();
+		for (int i = 0; i < updated.size(); ++i) {
+			int r = updated[i][0];
+			int c = updated[i][1];
 
-				all_scores[u].push_back(make_pair(score, Vec2i(c, r)));
-			}
+			// グリッドサイズを、実際の距離に変換する
+			properties[k](r, c) = attenuation(dist(r, c) / (float)grid_size * city_size, 50);
 		}
+		brushfires[k]->clearUpdatedCells();
 	}
+}
 
-	// スコアでソートする
-	for (int u = 0; u < preferences.size(); ++u) {
-		std::sort(all_scores[u].begin(), all_scores[u].end(), GreaterScore);
-	}
+/**
+ * 指定されたセルのゾーンタイプが変化したことを記録する。
+ * 次のcomputePropertyVectors()で、このセルの変化だけが距離マップに反映される。
+ *
+ * @param cell_id		セルのインデックス (r * grid_size + c)
+ */
+void Zoning::markChanged(int cell_id) {
+	if (!brushfires_valid) return;
 
-	// 占有率チェック用
-	Mat_<float> occupied = Mat_<float>::zeros(grid_size, grid_size);
-
-	// ポインタ
-	vector<int> pointer(preferences.size(), 0);
-
-	float score = 0.0f;
-	int count = num_cells;
-	int xxx = 0;
-	while (count > 0) {
-		for (int u = 0; u < preferences.size() && count > 0; ++u) {
-			Vec2i cell = all_scores[u][pointer[u]].second;
-			while (occupied(cell[1], cell[0]) >= 1) {
-				pointer[u]++;
-				cell = all_scores[u][pointer[u]].second;
-			}
-			
-			occupied(cell[1], cell[0]) += preferences[u].first;
-			score += all_scores[u][pointer[u]].first;
+	uchar& mark = changed_mask(cell_id / grid_size, cell_id % grid_size);
+	if (mark) return;
 
-			if (occupied(cell[1], cell[0]) >= 1.0) count--;
-		}
+	mark = 1;
+	changed_cells.push_back(cell_id);
+}
+
+/**
+ * ゾーンマップ全体が変更されたので、次のcomputePropertyVectors()で最初から計算し直すようにする。
+ */
+void Zoning::invalidatePropertyVectors() {
+	brushfires_valid = false;
+	for (int i = 0; i < changed_cells.size(); ++i) {
+		changed_mask(changed_cells[i] / grid_size, changed_cells[i] % grid_size) = 0;
 	}
+	changed_cells.clear();
+}
+
+/**
+ * スコアを計算する。
+ *
+ * @param preferences		ユーザのpreferenceベクトル (vector<重み、好みベクトル>)
+ */
+float Zoning::computeScore(vector<pair<float, vector<float> > >& preferences) {
+	ZoningScorer scorer(preferences);
+	return computeScore(scorer);
+}
+
+/**
+ * 指定されたスコア計算エンジンを使って、スコアを計算する。
+ * 繰り返しスコアを計算する場合は、エンジンを使い回すと作業領域の確保を省略できる。
+ *
+ * @param scorer			スコア計算エンジン
+ */
+float Zoning::computeScore(ZoningScorer& scorer) {
+	return scorer.computeScore(zones, properties, TYPE_RESIDENTIAL);
+}
+
+/**
+ * 現在のゾーンマップとpropertyベクトルを、まとめてスコアを計算するためのバッチに追加する。
+ * 事前に、computePropertyVectors()を呼び出しておくこと。
+ *
+ * @param batch		バッチ
+ * @return			追加したゾーニングのインデックス (一杯なら-1)
+ */
+int Zoning::addToBatch(ZoningBatch& batch) {
+	return batch.add(zones, properties);
+}
 
-	return score / num_cells;
+/**
+ * バッチにまとめた全てのゾーニングのスコアを計算する。
+ *
+ * @param scorer			スコア計算エンジン
+ * @param batch				バッチ
+ * @param scores [OUT]		各ゾーニングのスコア
+ */
+void Zoning::computeScores(ZoningScorer& scorer, const ZoningBatch& batch, vector<float>& scores) {
+	scorer.computeScores(batch, TYPE_RESIDENTIAL, scores);
 }
 
 /**
  * ランダムにpreferenceベクトルをnum個作成する。
  *
  * @param num		個数
+ * @param rng		乱数生成器
  * @return			生成されたpreferenceベクトルのリスト
  */
-Mat_<double> Zoning::generateRandomPreferences(int num) {
+Mat_<double> Zoning::generateRandomPreferences(int num, Rng& rng) {
 	// 3つの典型的なpreferenceベクトルを用意する
 	Mat_<double> templates = (Mat_<double>(3, NUM_COMPONENTS) <<
 		0.2, 0.5, -1, 0.2, -0.5, 0.5,
@@ -154,7 +243,7 @@ Mat_<double> Zoning::generateRandomPreferences(int num) {
 		Mat_<double> temp = preferences.rowRange(u, u + 1);
 
 		for (int t = 0; t < templates.rows; ++t) {
-			float w = Util::genRand();
+			float w = Util::genRand(rng);
 
 			temp += templates.row(t) * w;
 		}
@@ -165,28 +254,116 @@ Mat_<double> Zoning::generateRandomPreferences(int num) {
 	return preferences;
 }
 
+/**
+ * preferenceベクトルをK-meansでクラスタリングし、各クラスタの割合と中心を返却する。
+ * 誰も属さないクラスタは含めない。
+ *
+ * @param preferences		preferenceベクトル (1行が1人分)
+ * @param num_groups		クラスタの数
+ * @param rng				乱数生成器
+ * @return					クラスタのリスト (vector<割合、中心>)
+ */
+vector<pair<float, vector<float> > > Zoning::clusterPreferences(const Mat_<double>& preferences, int num_groups, Rng& rng) {
+	// K-meansクラスタリング
+	KMeans kmeans(preferences.cols, num_groups);
+	Mat_<double> mu;
+	vector<int> groups;
+	kmeans.cluster(preferences, 40, mu, groups, rng);
+
+	// 各クラスタの割合を計算する
+	vector<float> ratio(mu.rows, 0.0f);
+	for (int u = 0; u < groups.size(); ++u) {
+		ratio[groups[u]]++;
+	}
+	for (int j = 0; j < ratio.size(); ++j) {
+		ratio[j] /= (float)groups.size();
+	}
+
+	vector<pair<float, vector<float> > > clusters;
+	for (int j = 0; j < mu.rows; ++j) {
+		if (ratio[j] == 0.0f) continue;
+
+		vector<float> center(mu.cols);
+		for (int k = 0; k < mu.cols; ++k) {
+			center[k] = mu(j, k);
+		}
+		clusters.push_back(make_pair(ratio[j], center));
+	}
+
+	return clusters;
+}
+
+/**
+ * preferenceファイルを読み込む。
+ * 各行は、「重み<TAB>好みベクトル(カンマ区切り)」の形式。好みベクトルはnormalizeする。
+ *
+ * @param filename		ファイル名
+ * @return				preferenceベクトルのリスト (ファイルが開けない場合は空)
+ */
+vector<pair<float, vector<float> > > Zoning::readPreferences(const char* filename) {
+	vector<pair<float, vector<float> > > preferences;
+
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly)) return preferences;
+ 
+	// preference vectorを読み込む
+	QTextStream in(&file);
+	while (true) {
+		QString str = in.readLine(0);
+		if (str == NULL) break;
+
+		float weight = str.split("\t")[0].toFloat();
+		QStringList preference_list = str.split("\t")[1].split(",");
+		std::vector<float> preference;
+		for (int i = 0; i < preference_list.size(); ++i) {
+			preference.push_back(preference_list[i].toFloat());
+		}
+
+		// normalize
+		Util::normalize(preference);
+
+		preferences.push_back(make_pair(weight, preference));
+	}
+
+	return preferences;
+}
+
+/**
+ * preferenceファイルを保存する。readPreferences()で読み込める形式で書き出す。
+ *
+ * @param filename		ファイル名
+ * @param preferences	preferenceベクトルのリスト (vector<重み、好みベクトル>)
+ * @return				保存できたらtrue
+ */
+bool Zoning::writePreferences(const char* filename, const vector<pair<float, vector<float> > >& preferences) {
+	QFile file(filename);
+	if (!file.open(QIODevice::WriteOnly)) return false;
+
+	QTextStream out(&file);
+	for (int j = 0; j < preferences.size(); ++j) {
+		out << preferences[j].first << "\t";
+
+		for (int k = 0; k < preferences[j].second.size(); ++k) {
+			if (k > 0) out << ",";
+			out << preferences[j].second[k];
+		}
+		out << endl;
+	}
+	file.close();
+
+	return true;
+}
+
 /**
  * ゾーンを画像として保存する。
  */
-void Zoning::save(char* filename, int img_size) {
+void Zoning::save(const char* filename, int img_size) {
 	Mat m(grid_size, grid_size, CV_8UC3);
 
 	// ゾーンを表示
 	for (int r = 0; r < grid_size; ++r) {
 		for (int c = 0; c < grid_size; ++c) {
-			cv::Vec3b p;
-			if (zones(r, c) == TYPE_RESIDENTIAL) {			// 住宅街（黄色）
-				p = cv::Vec3b(115, 255, 255);
-			} else if (zones(r, c) == TYPE_COMMERCIAL) {	// 商業地（赤色）
-				p = cv::Vec3b(0, 0, 255);
-			} else if (zones(r, c) == TYPE_INDUSTRIAL) {	// 工業地（青色）
-				p = cv::Vec3b(255, 0, 0);
-			} else if (zones(r, c) == TYPE_PARK) {			// 公園（緑色）
-				p = cv::Vec3b(85, 255, 0);
-			} else if (zones(r, c) == TYPE_UNUSED) {		// 使用不可（白色）
-				p = cv::Vec3b(255, 255, 255);
-			}
-			m.at<cv::Vec3b>(r, c) = p;
+			m.at<cv::Vec3b>(r, c) = zoneColor(zones(r, c));
 		}
 	}
 
@@ -194,93 +371,56 @@ void Zoning::save(char* filename, int img_size) {
 	cv::resize(m, m, Size(img_size, img_size), INTER_NEAREST);
 
 	// 道路を表示
-	RoadEdgeIter ei, eend;
-	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
-		for (int i = 0; i < roads.graph[*ei]->polyline.size() - 1; ++i) {
-			QVector2D p1(roads.graph[*ei]->polyline[i].x(), roads.graph[*ei]->polyline[i].y());
-			QVector2D p2(roads.graph[*ei]->polyline[i+1].x(), roads.graph[*ei]->polyline[i+1].y());
-
-			p1 = p1 / (float)city_size * img_size + QVector2D(img_size, img_size) * 0.5f;
-			p2 = p2 / (float)city_size * img_size + QVector2D(img_size, img_size) * 0.5f;
-
-			int lineWidth = 1;
-			if (roads.graph[*ei]->type != RoadEdge::TYPE_STREET) {
-				lineWidth = 2;
-			}
-
-			cv::line(m, Point(p1.x(), p1.y()), Point(p2.x(), p2.y()), Scalar(0, 160, 0), lineWidth);
-		}
-	}
+	drawRoads(*roads, city_size, m);
 
 	cv::flip(m, m, 0);
 	cv::imwrite(filename, m);
 }
 
-bool Zoning::GreaterScore(const std::pair<float, Vec2i>& rLeft, const std::pair<float, Vec2i>& rRight) { return rLeft.first > rRight.first; }
+/**
+ * 画像に表示する時の、ゾーンタイプの色を返却する。
+ */
+cv::Vec3b Zoning::zoneColor(int type) {
+	if (type == TYPE_RESIDENTIAL) {			// 住宅街（黄色）
+		return cv::Vec3b(115, 255, 255);
+	} else if (type == TYPE_COMMERCIAL) {	// 商業地（赤色）
+		return cv::Vec3b(0, 0, 255);
+	} else if (type == TYPE_INDUSTRIAL) {	// 工業地（青色）
+		return cv::Vec3b(255, 0, 0);
+	} else if (type == TYPE_PARK) {			// 公園（緑色）
+		return cv::Vec3b(85, 255, 0);
+	} else if (type == TYPE_UNUSED) {		// 使用不可（白色）
+		return cv::Vec3b(255, 255, 255);
+	}
+	return cv::Vec3b();
+}
 
 /**
- * 道路までのaccessibilityを計算する。
- * dist = 直近のAvenue道路までの距離とした時、accessibility = 1 / (1 + dist)
- * 「Real and virtual uban design」のスライドにあった計算式を使っている。
- * ただし、majorなら、avenue、highwayのみを考慮、minorなら、local streetのみを考慮する。
+ * 画像に道路を描画する。画像は、cityの全体を表示しているものとする (上下反転前)。
  *
- * @param type					0 - major / 1 - minor
- * @param accessibility [OUT]	距離マップを格納して返却する
+ * @param roads			道路網
+ * @param city_size		cityの一辺の距離 [m]
+ * @param image			画像
  */
-void Zoning::computeAccessibility(int type, Mat_<float>& accessibility) {
-	accessibility = Mat_<float>::zeros(grid_size, grid_size);
+void Zoning::drawRoads(const RoadSnapshot& roads, int city_size, Mat& image) {
+	int img_size = image.cols;
 
-	// 距離係数（この距離離れると、accessibilityが半減するというイメージ）
-	const float distanceFactor = 50.0f;
+	for (int e = 0; e < roads.numEdges(); ++e) {
+		for (int i = 0; i < roads.polylineSize(e) - 1; ++i) {
+			QVector2D p1 = roads.polylinePt(e, i);
+			QVector2D p2 = roads.polylinePt(e, i + 1);
 
-	int roadType;
-	if (type == 0) {
-		roadType = RoadEdge::TYPE_AVENUE | RoadEdge::TYPE_HIGHWAY;
-	} else {
-		roadType = RoadEdge::TYPE_STREET;
-	}
+			p1 = p1 / (float)city_size * img_size + QVector2D(img_size, img_size) * 0.5f;
+			p2 = p2 / (float)city_size * img_size + QVector2D(img_size, img_size) * 0.5f;
 
-	Mat_<uchar> data = Mat_<uchar>::zeros(grid_size, grid_size);
-	RoadEdgeIter ei, eend;
-	for (boost::tie(ei, eend) = boost::edges(roads.graph); ei != eend; ++ei) {
-		if (roads.graph[*ei]->type & roadType) {
-			Polyline2D polyline = GraphUtil::finerEdge(roads, *ei, 1.0f);
-			for (int i = 0; i < polyline.size(); ++i) {
-				QVector2D pt = cityToGrid(polyline[i]);
-				if (pt.x() >= 0 && pt.x() < grid_size && pt.y() >= 0 && pt.y() < grid_size) {
-					data(pt.y(), pt.x()) = 1;
-				}
+			int lineWidth = 1;
+			if (roads.edgeType(e) != RoadEdge::TYPE_STREET) {
+				lineWidth = 2;
 			}
-		}
-	}
-
-	// Brushfireアルゴリズムで、距離マップを計算する
-	modifiedbrushfire::ModifiedBrushFire bf(grid_size, grid_size, data);
-	//int error = bf.check();
-	//printf("Error: %d\n", error);
-
-	// accessibilityを計算する
-	for (int r = 0; r < grid_size; ++r) {
-		for (int c = 0; c < grid_size; ++c) {
-			float dist = bf.distMap()(r, c);
 
-			// グリッドサイズを、実際の距離に変換する
-			accessibility(r, c) = dist / (float)grid_size * city_size;
+			cv::line(image, Point(p1.x(), p1.y()), Point(p2.x(), p2.y()), Scalar(0, 160, 0), lineWidth);
 		}
 	}
-
-#if 0
-	// 画像として保存しておく
-	cv::Mat m;
-	accessibility.convertTo(m, CV_8U, 255.0f);
-	cv::flip(m, m, 0);
-
-	if (type == 0) {
-		cv::imwrite("majorAccessibility.jpg", m);
-	} else {
-		cv::imwrite("minorAccessibility.jpg", m);
-	}
-#endif
 }
 
 /**
@@ -301,13 +441,22 @@ void Zoning::computeDistanceMap(int type, Mat_<float>& distMap) {
 		}
 	}
 
-	// Brushfireアルゴリズムで、距離マップを計算する
-	modifiedbrushfire::ModifiedBrushFire bf(grid_size, grid_size, data);
+	// 距離マップを計算する
+	// 後で差分更新できるように、brushfireは保持しておく
+	if (distance_backend == distancetransform::BACKEND_EXACT_EDT) {
+		// 厳密なEDTの結果で、brushfireを初期化する
+		Mat_<float> dist;
+		Mat_<Vec2i> nearest;
+		distancetransform::computeEDT(data, dist, &nearest);
+		brushfires[type] = boost::shared_ptr<modifiedbrushfire::ModifiedBrushFire>(new modifiedbrushfire::ModifiedBrushFire(grid_size, grid_size, data, dist, nearest));
+	} else {
+		brushfires[type] = boost::shared_ptr<modifiedbrushfire::ModifiedBrushFire>(new modifiedbrushfire::ModifiedBrushFire(grid_size, grid_size, data));
+	}
 
 	// グリッドサイズを、実際の距離に変換する
 	for (int r = 0; r < grid_size; ++r) {
 		for (int c = 0; c < grid_size; ++c) {
-			float dist = bf.distMap()(r, c);
+			float dist = brushfires[type]->distMap()(r, c);
 
 			// グリッドサイズを、実際の距離に変換する
 			distMap(r, c) = dist / (float)grid_size * city_size;
@@ -2,15 +2,24 @@
 
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
-#include "RoadGraph.h"
+#include "RoadSnapshot.h"
+#include "Rng.h"
+#include <boost/shared_ptr.hpp>
+
+namespace modifiedbrushfire {
+	class ModifiedBrushFire;
+}
+
+class ZoningScorer;
+class ZoningBatch;
 
 using namespace std;
 using namespace cv;
 
 class Zoning {
 protected:
-	static enum { TYPE_RESIDENTIAL = 0, TYPE_COMMERCIAL = 1, TYPE_INDUSTRIAL = 2, TYPE_PARK = 3, TYPE_UNUSED = 9 };
-	static enum { COM_RESIDENTIAL = 0, COM_COMMERCIAL = 1, COM_INDUSTRIAL = 2, COM_PARK = 3, COM_MAJOR_ROADS = 4, COM_MINOR_ROADS = 5 };
+	enum { TYPE_RESIDENTIAL = 0, TYPE_COMMERCIAL = 1, TYPE_INDUSTRIAL = 2, TYPE_PARK = 3, TYPE_UNUSED = 9 };
+	enum { COM_RESIDENTIAL = 0, COM_COMMERCIAL = 1, COM_INDUSTRIAL = 2, COM_PARK = 3, COM_MAJOR_ROADS = 4, COM_MINOR_ROADS = 5 };
 
 	/** ゾーンタイプの種類の数　*/
 	static const int NUM_TYPES;
@@ -21,23 +30,44 @@ protected:
 	int city_size;		// cityの一辺の距離 [m]
 	int grid_size;		// グリッドの一辺のサイズ
 	Mat_<uchar> zones;
-	RoadGraph roads;
+	RoadSnapshotPtr roads;				// 道路網 (読み出し専用なので、コピー間で共有する)
 	vector<float> zone_distribution;
 	Mat_<float> properties[6];
+	Mat_<float> road_distances[2];		// 道路までの距離マップ [m] (0 - major / 1 - minor、RoadRasterと共有)
+
+	// 各ゾーンタイプの距離マップを、差分更新するためのbrushfire
+	boost::shared_ptr<modifiedbrushfire::ModifiedBrushFire> brushfires[4];
+	bool brushfires_valid;				// brushfireが、brushfire_zonesと一致しているか
+	Mat_<uchar> brushfire_zones;		// brushfireに反映済みのゾーンマップ
+	Mat_<uchar> changed_mask;			// 前回のcomputePropertyVectors()以降に変化したセル
+	vector<int> changed_cells;			// 変化したセルのインデックス (r * grid_size + c)
+	int distance_backend;				// 距離マップを最初から計算する時のバックエンド (distancetransform::BACKEND_XXX)
 
 public:
-	Zoning(int city_size, int grid_size, vector<float>& zone_distribution, RoadGraph& roads);
+	Zoning(int city_size, int grid_size, vector<float>& zone_distribution, const RoadSnapshotPtr& roads, int road_grid_size = 0);
+	Zoning(const Zoning &ref);
 	Zoning& operator=(const Zoning &ref);
 
 	Mat_<uchar> zoneMap() { return zones.clone(); }
+	void setZoneMap(const Mat_<uchar>& zoneMap) { zoneMap.copyTo(zones); invalidatePropertyVectors(); }
+	void setDistanceBackend(int backend) { distance_backend = backend; }
 	void computePropertyVectors();
 	float computeScore(vector<pair<float, vector<float> > >& preferences);
-	static Mat_<double> generateRandomPreferences(int num);
-	void save(char* filename, int img_size);
+	float computeScore(ZoningScorer& scorer);
+	int addToBatch(ZoningBatch& batch);
+	static void computeScores(ZoningScorer& scorer, const ZoningBatch& batch, vector<float>& scores);
+	static Mat_<double> generateRandomPreferences(int num, Rng& rng);
+	static vector<pair<float, vector<float> > > clusterPreferences(const Mat_<double>& preferences, int num_groups, Rng& rng);
+	static vector<pair<float, vector<float> > > readPreferences(const char* filename);
+	static bool writePreferences(const char* filename, const vector<pair<float, vector<float> > >& preferences);
+	void save(const char* filename, int img_size);
+	static cv::Vec3b zoneColor(int type);
+	static void drawRoads(const RoadSnapshot& roads, int city_size, Mat& image);
 
 protected:
-	static bool GreaterScore(const std::pair<float, Vec2i>& rLeft, const std::pair<float, Vec2i>& rRight);
-	void computeAccessibility(int type, Mat_<float>& distMap);
+	void markChanged(int cell_id);
+	void invalidatePropertyVectors();
+	void updatePropertyVectors();
 	void computeDistanceMap(int type, Mat_<float>& distMap);
 	float attenuation(float x, float factor);
 	QVector2D gridToCity(const QVector2D& pt);
@@ -0,0 +1,59 @@
+﻿#include "ZoningBatch.h"
+
+const int ZoningBatch::NUM_COMPONENTS;
+const int ZoningBatch::ALIGNMENT;
+
+/**
+ * @param capacity		まとめるゾーニングの最大数
+ * @param num_cells		1ゾーニングあたりのセルの数
+ */
+ZoningBatch::ZoningBatch(int capacity, int num_cells) {
+	this->capacity = capacity;
+	this->num_cells = num_cells;
+	num_zonings = 0;
+
+	const int floats_per_line = ALIGNMENT / sizeof(float);
+	stride = (num_cells + floats_per_line - 1) / floats_per_line * floats_per_line;
+
+	storage.assign((size_t)capacity * NUM_COMPONENTS * stride + floats_per_line, 0.0f);
+	size_t addr = (size_t)&storage[0];
+	properties = (float*)((addr + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+
+	zones.resize((size_t)capacity * num_cells);
+}
+
+/**
+ * ゾーニングを追加する。
+ *
+ * @param zones			ゾーンマップ
+ * @param properties	各セルのpropertyベクトル (NUM_COMPONENTS個の行列)
+ * @return				追加したゾーニングのインデックス (一杯なら-1)
+ */
+int ZoningBatch::add(const Mat_<uchar>& zones, const Mat_<float>* properties) {
+	if (full()) return -1;
+
+	int index = num_zonings++;
+
+	uchar* zone_dst = &this->zones[(size_t)index * num_cells];
+	for (int r = 0; r < zones.rows; ++r) {
+		memcpy(zone_dst + r * zones.cols, zones[r], zones.cols);
+	}
+
+	float* dst = this->properties + (size_t)index * NUM_COMPONENTS * stride;
+	for (int k = 0; k < NUM_COMPONENTS; ++k) {
+		const Mat_<float>& src = properties[k];
+		for (int r = 0; r < src.rows; ++r) {
+			memcpy(dst + k * stride + r * src.cols, src[r], src.cols * sizeof(float));
+		}
+	}
+
+	return index;
+}
+
+/**
+ * 指定されたゾーニングのゾーンマップを、行列として返却する。(コピー)
+ */
+Mat_<uchar> ZoningBatch::zoneMap(int index, int rows) const {
+	Mat_<uchar> m(rows, num_cells / rows, (uchar*)zoneData(index));
+	return m.clone();
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include <vector>
+#include <opencv/cv.h>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * 複数のゾーニングのpropertyベクトルとゾーンマップを、連続したメモリにまとめたもの。
+ * propertyは、ゾーニング × コンポーネント × セル の順に並べる。
+ * 各コンポーネントの先頭は32バイト境界に揃え、セル数の端数はパディングする。
+ */
+class ZoningBatch {
+public:
+	static const int NUM_COMPONENTS = 6;
+	static const int ALIGNMENT = 32;
+
+private:
+	int capacity;
+	int num_cells;			// 1ゾーニングあたりのセルの数
+	int stride;				// 1コンポーネントあたりの要素数 (パディング込み)
+	int num_zonings;
+	vector<float> storage;	// アラインメント調整用に、少し大きめに確保する
+	float* properties;		// storage内の、アラインメント済みの先頭
+	vector<uchar> zones;
+
+public:
+	ZoningBatch(int capacity, int num_cells);
+
+	int add(const Mat_<uchar>& zones, const Mat_<float>* properties);
+	void clear() { num_zonings = 0; }
+	int size() const { return num_zonings; }
+	int maxSize() const { return capacity; }
+	bool full() const { return num_zonings >= capacity; }
+	int numCells() const { return num_cells; }
+	int componentStride() const { return stride; }
+
+	const float* propertyData(int index) const { return properties + (size_t)index * NUM_COMPONENTS * stride; }
+	const uchar* zoneData(int index) const { return &zones[(size_t)index * num_cells]; }
+	Mat_<uchar> zoneMap(int index, int rows) const;
+
+private:
+	// propertiesはstorageの中を指すので、コピーはしない
+	ZoningBatch(const ZoningBatch& ref);
+	ZoningBatch& operator=(const ZoningBatch& ref);
+};
@@ -0,0 +1,66 @@
+﻿#include "ZoningPyramid.h"
+#include "PMZoning.h"
+
+/**
+ * レベルの構成を決める。
+ * grid_sizeから半分ずつにしていき、coarse_size以下になったところを最も粗いレベルとする。
+ *
+ * @param city_size				cityの一辺の距離 [m]
+ * @param grid_size				最も細かいレベルのグリッドの一辺のサイズ
+ * @param zone_distribution		ゾーンタイプの配分率
+ * @param roads					道路網
+ * @param coarse_size			最も粗いレベルのグリッドの一辺のサイズの上限
+ * @param coarse_iterations		最も粗いレベルの更新回数
+ * @param min_iterations		各レベルの更新回数の下限 (1つ細かくなるごとに1/4にするが、これより少なくはしない)
+ */
+ZoningPyramid::ZoningPyramid(int city_size, int grid_size, vector<float>& zone_distribution, const RoadSnapshotPtr& roads, int coarse_size, int coarse_iterations, int min_iterations) {
+	this->city_size = city_size;
+	this->zone_distribution = zone_distribution;
+	this->roads = roads;
+	needs_mode = CellularAutomaton::NEEDS_PER_CELL;
+
+	for (int size = grid_size; ; size /= 2) {
+		level_sizes.insert(level_sizes.begin(), size);
+		if (size <= coarse_size || size < 2) break;
+	}
+
+	// 下限に達した後のレベルは、セル数が4倍になる分だけ計算量が増える (ZoningPyramidの説明を参照)
+	int iterations = coarse_iterations;
+	for (int level = 0; level < level_sizes.size(); ++level) {
+		level_iterations.push_back(iterations);
+		iterations = max(min(min_iterations, iterations), iterations / 4);
+	}
+}
+
+/**
+ * 粗いレベルから順にゾーニングを生成し、最も細かいレベルのゾーニングを返却する。
+ *
+ * @param rng		乱数生成器
+ * @return			最も細かいレベルのゾーニング
+ */
+boost::shared_ptr<PMZoning> ZoningPyramid::generate(Rng& rng) {
+	int grid_size = level_sizes.back();
+	boost::shared_ptr<PMZoning> zoning;
+
+	for (int level = 0; level < level_sizes.size(); ++level) {
+		boost::shared_ptr<PMZoning> next(new PMZoning(city_size, level_sizes[level], zone_distribution, roads, grid_size));
+		next->setNeedsMode(needs_mode);
+
+		if (level == 0) {
+			next->initialZoning(zone_distribution, rng);
+		} else {
+			// 1つ粗いレベルの結果を拡大して、初期状態とする
+			Mat_<uchar> zone_map;
+			cv::resize(zoning->zoneMap(), zone_map, Size(level_sizes[level], level_sizes[level]), 0, 0, INTER_NEAREST);
+			next->setZoneMap(zone_map);
+		}
+
+		for (int iter = 0; iter < level_iterations[level]; ++iter) {
+			next->update(rng);
+		}
+
+		zoning = next;
+	}
+
+	return zoning;
+}
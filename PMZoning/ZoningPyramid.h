@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include <vector>
+#include <opencv/cv.h>
+#include <boost/shared_ptr.hpp>
+#include "RoadSnapshot.h"
+#include "Rng.h"
+
+using namespace std;
+using namespace cv;
+
+class PMZoning;
+
+/**
+ * 多重解像度 (coarse-to-fine) で、PMZoningのゾーニングを生成する。
+ *
+ * 最も粗いレベルで初期ゾーンを決めてセルオートマトンを十分に回し、
+ * 結果を2倍に拡大 (最近傍) して次のレベルの初期状態とし、少ない回数だけ回して境界を整える。
+ * これを、目的のグリッドサイズまで繰り返す。
+ * 各レベルの更新回数は、1つ細かくなるごとに1/4にするが、min_iterations回 (既定では1回) より少なくはしない。
+ * 更新回数が1/4ずつ減る間は、各レベルの計算量 (セル数×更新回数) はほぼ等しいが、下限に達した後は、
+ * 1つ細かくなるごとに計算量が4倍になり、最も細かいレベルが支配的になる。
+ * 例えば、64x64で40回から始めると、512x512以上の各レベルは1回ずつとなり、4096x4096の場合、
+ * 最も細かいレベルの約1680万セルの更新に対して、最も粗いレベルは約16万セル (4096セル×40回) である。
+ * それでも全体では、最も細かいレベルを約4/3回更新する程度の計算量なので、
+ * 最も細かいレベルだけでcoarse_iterations回更新するより大幅に少ない。
+ *
+ * 粗いレベルの道路のマップは、道路を描画し直さずに、最も細かいレベルのマップを縮小して作る。
+ * (RoadRaster::getのsource_grid_sizeを参照)
+ */
+class ZoningPyramid {
+private:
+	int city_size;
+	vector<float> zone_distribution;
+	RoadSnapshotPtr roads;
+	vector<int> level_sizes;		// 各レベルのグリッドの一辺のサイズ (粗い順)
+	vector<int> level_iterations;	// 各レベルの更新回数
+	int needs_mode;
+
+public:
+	ZoningPyramid(int city_size, int grid_size, vector<float>& zone_distribution, const RoadSnapshotPtr& roads, int coarse_size = 64, int coarse_iterations = 40, int min_iterations = 1);
+
+	int numLevels() const { return level_sizes.size(); }
+	int levelSize(int level) const { return level_sizes[level]; }
+	int levelIterations(int level) const { return level_iterations[level]; }
+	void setLevelIterations(int level, int iterations) { level_iterations[level] = iterations; }
+	void setNeedsMode(int mode) { needs_mode = mode; }
+
+	boost::shared_ptr<PMZoning> generate(Rng& rng);
+};
@@ -0,0 +1,247 @@
+﻿#include "ZoningScorer.h"
+#include "ZoningBatch.h"
+#include "ScoringKernel.h"
+#include <algorithm>
+
+namespace {
+
+/**
+ * スコアの降順に並べるための比較関数。同点の場合は、インデックスの昇順とする。
+ */
+struct GreaterScore {
+	const float* scores;
+
+	GreaterScore(const float* scores) : scores(scores) {}
+
+	bool operator()(int i, int j) const {
+		if (scores[i] != scores[j]) return scores[i] > scores[j];
+		return i < j;
+	}
+};
+
+}
+
+const int ZoningScorer::NUM_COMPONENTS;
+const int ZoningScorer::MIN_CHUNK_SIZE;
+
+/**
+ * @param preferences		ユーザのpreferenceベクトル (vector<重み、好みベクトル>)
+ */
+ZoningScorer::ZoningScorer(vector<pair<float, vector<float> > >& preferences) {
+	num_groups = preferences.size();
+	weights.resize(num_groups);
+	this->preferences.resize(num_groups * NUM_COMPONENTS);
+	for (int u = 0; u < num_groups; ++u) {
+		weights[u] = preferences[u].first;
+		for (int k = 0; k < NUM_COMPONENTS; ++k) {
+			this->preferences[u * NUM_COMPONENTS + k] = preferences[u].second[k];
+		}
+	}
+
+	num_cells = 0;
+	score_matrix = NULL;
+	orders.resize(num_groups);
+	sorted_ends.resize(num_groups);
+	chunk_sizes.resize(num_groups);
+	pointers.resize(num_groups);
+}
+
+/**
+ * スコアを計算する。
+ * propertyの行列が連続したメモリでない場合は、一旦バッファにコピーする。
+ *
+ * @param zones					ゾーンマップ
+ * @param properties			各セルのpropertyベクトル (NUM_COMPONENTS個の行列)
+ * @param residential_type		住宅地のゾーンタイプ
+ * @return						スコア
+ */
+float ZoningScorer::computeScore(const Mat_<uchar>& zones, const Mat_<float>* properties, uchar residential_type) {
+	int total = zones.rows * zones.cols;
+
+	const float* props[NUM_COMPONENTS];
+	bool continuous = true;
+	for (int k = 0; k < NUM_COMPONENTS; ++k) {
+		if (!properties[k].isContinuous()) continuous = false;
+	}
+
+	if (continuous) {
+		for (int k = 0; k < NUM_COMPONENTS; ++k) {
+			props[k] = (const float*)properties[k].data;
+		}
+	} else {
+		buffer.resize(total * NUM_COMPONENTS);
+		for (int k = 0; k < NUM_COMPONENTS; ++k) {
+			float* dst = &buffer[k * total];
+			for (int r = 0; r < properties[k].rows; ++r) {
+				memcpy(dst + r * properties[k].cols, properties[k][r], properties[k].cols * sizeof(float));
+			}
+			props[k] = dst;
+		}
+	}
+
+	if (zones.isContinuous()) {
+		return computeScore(props, zones.data, total, residential_type);
+	} else {
+		Mat_<uchar> z = zones.clone();
+		return computeScore(props, z.data, total, residential_type);
+	}
+}
+
+/**
+ * スコアを計算する。
+ *
+ * @param properties			各コンポーネントのpropertyの配列 (NUM_COMPONENTS個、それぞれnum_cells個の要素)
+ * @param zones					ゾーンマップ (num_cells個の要素)
+ * @param num_cells				セルの数
+ * @param residential_type		住宅地のゾーンタイプ
+ * @return						スコア
+ */
+float ZoningScorer::computeScore(const float* const properties[6], const uchar* zones, int num_cells, uchar residential_type) {
+	this->num_cells = num_cells;
+
+	collectCells(zones, residential_type);
+	computeScoreMatrix(properties);
+	score_matrix = scores.empty() ? NULL : &scores[0];
+	resetOrders();
+
+	return assignCells();
+}
+
+/**
+ * まとめられた全てのゾーニングのスコアを計算する。
+ * 全ゾーニングのスコア行列を一括して計算してから、ゾーニングごとにセルを割り当てる。
+ *
+ * @param batch					ゾーニングのまとまり
+ * @param residential_type		住宅地のゾーンタイプ
+ * @param scores [OUT]			各ゾーニングのスコア
+ */
+void ZoningScorer::computeScores(const ZoningBatch& batch, uchar residential_type, vector<float>& scores) {
+	scores.resize(batch.size());
+	if (batch.size() == 0) return;
+
+	num_cells = batch.numCells();
+	int matrix_size = num_groups * num_cells;
+	this->scores.resize((size_t)batch.size() * matrix_size);
+	if (matrix_size > 0) {
+		scoringkernel::dot6Batch(batch.propertyData(0), batch.componentStride(), batch.size(), &preferences[0], num_groups, num_cells, &this->scores[0]);
+	}
+
+	for (int n = 0; n < batch.size(); ++n) {
+		collectCells(batch.zoneData(n), residential_type);
+		score_matrix = matrix_size > 0 ? &this->scores[(size_t)n * matrix_size] : NULL;
+		resetOrders();
+
+		scores[n] = assignCells();
+	}
+}
+
+/**
+ * 住宅地セルを列挙する。
+ */
+void ZoningScorer::collectCells(const uchar* zones, uchar residential_type) {
+	cells.clear();
+	for (int i = 0; i < num_cells; ++i) {
+		if (zones[i] == residential_type) {
+			cells.push_back(i);
+		}
+	}
+}
+
+/**
+ * 全グループ×全セルのスコア行列を計算する。
+ * スコア行列 = 好みベクトルの行列 (num_groups x 6) × propertyの行列 (6 x num_cells)
+ * 住宅地以外のセルも計算するが、分岐なしで一括処理した方が、住宅地セルだけを集めるより速い。
+ */
+void ZoningScorer::computeScoreMatrix(const float* const properties[6]) {
+	scores.resize(num_groups * num_cells);
+	if (num_cells == 0 || num_groups == 0) return;
+
+	scoringkernel::dot6Groups(properties, &preferences[0], num_groups, num_cells, &scores[0], num_cells);
+}
+
+/**
+ * 各グループの住宅地セルの並びを初期化する。この時点では、まだどこもソートされていない。
+ */
+void ZoningScorer::resetOrders() {
+	int num_residential = cells.size();
+
+	// 1グループあたりが消費するセル数の目安から、最初のチャンクサイズを決める
+	int initial_chunk = num_groups > 0 ? num_residential / num_groups : num_residential;
+	if (initial_chunk < MIN_CHUNK_SIZE) initial_chunk = MIN_CHUNK_SIZE;
+
+	for (int u = 0; u < num_groups; ++u) {
+		orders[u] = cells;
+		sorted_ends[u] = 0;
+		chunk_sizes[u] = initial_chunk;
+		pointers[u] = 0;
+	}
+}
+
+/**
+ * 各グループは順番に、まだ埋まっていないセルの中で最もスコアの高いセルを選び、
+ * そのセルに重みの分だけ入居する。全ての住宅地セルが埋まるまでこれを繰り返し、
+ * 選んだセルのスコアの合計を、住宅地セルの数で割ったものをスコアとする。
+ * スコア行列 (score_matrix) と、各グループのセルの並びは、準備済みであること。
+ *
+ * @return						スコア
+ */
+float ZoningScorer::assignCells() {
+	occupied.assign(num_cells, 0.0f);
+
+	float score = 0.0f;
+	int count = cells.size();
+	while (count > 0) {
+		for (int u = 0; u < num_groups && count > 0; ++u) {
+			// 既に埋まっているセルは読み飛ばす
+			int cell = cellAt(u, pointers[u]);
+			while (occupied[cell] >= 1) {
+				pointers[u]++;
+				cell = cellAt(u, pointers[u]);
+			}
+
+			occupied[cell] += weights[u];
+			score += score_matrix[u * num_cells + cell];
+
+			if (occupied[cell] >= 1.0) count--;
+		}
+	}
+
+	return score / cells.size();
+}
+
+/**
+ * 指定されたグループの、スコアの高い順でpos番目のセルを返却する。
+ * まだソートされていない位置なら、ソート済みの範囲を広げる。
+ *
+ * @param u			グループ
+ * @param pos		位置
+ * @return			セルのインデックス (r * grid_size + c)
+ */
+int ZoningScorer::cellAt(int u, int pos) {
+	while (pos >= sorted_ends[u]) {
+		extendOrder(u);
+	}
+	return orders[u][pos];
+}
+
+/**
+ * 指定されたグループのソート済みの範囲を、1チャンク分広げる。
+ * 残りの中から上位chunk個をnth_elementで選び、その部分だけをソートする。
+ * チャンクサイズは、広げるたびに2倍にする。
+ */
+void ZoningScorer::extendOrder(int u) {
+	vector<int>& order = orders[u];
+	GreaterScore greater(score_matrix + u * num_cells);
+
+	vector<int>::iterator begin = order.begin() + sorted_ends[u];
+	int remaining = order.size() - sorted_ends[u];
+	int chunk = std::min(chunk_sizes[u], remaining);
+
+	if (chunk < remaining) {
+		std::nth_element(begin, begin + chunk, order.end(), greater);
+	}
+	std::sort(begin, begin + chunk, greater);
+
+	sorted_ends[u] += chunk;
+	chunk_sizes[u] *= 2;
+}
@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include <vector>
+#include <opencv/cv.h>
+
+using namespace std;
+using namespace cv;
+
+class ZoningBatch;
+
+/**
+ * ゾーニングのスコアを計算するエンジン。
+ * propertyベクトルをコンポーネントごとの連続した配列(SoA)として受け取り、
+ * 全グループ×全セルのスコア行列を、6次元の内積カーネル (scoringkernel::dot6Groups) で一括して計算する。
+ * ZoningBatchでまとめた複数のゾーニングは、全ゾーニング分のスコア行列を1回のカーネル呼び出し (dot6Batch) で計算する。
+ * 割り当てでは各グループのリストの先頭付近しか使わないので、全体はソートせず、
+ * 必要になった分だけ nth_element でチャンク単位に選択して、ソートする。
+ * 作業領域は再利用するので、同じインスタンスで繰り返しスコアを計算するとよい。
+ */
+class ZoningScorer {
+private:
+	static const int NUM_COMPONENTS = 6;
+	static const int MIN_CHUNK_SIZE = 64;
+
+	int num_groups;
+	vector<float> weights;				// 各グループの人数の重み
+	vector<float> preferences;			// 各グループの好みベクトル (num_groups x NUM_COMPONENTS)
+
+	// 作業領域
+	int num_cells;						// 全セルの数
+	vector<int> cells;					// 住宅地セルのインデックス (r * grid_size + c)
+	vector<float> buffer;				// 連続していないpropertyをコピーするためのバッファ
+	vector<float> scores;				// スコア行列 (num_groups x num_cells、ZoningBatchの場合は、ゾーニングの数だけ並べる)
+	const float* score_matrix;			// 現在のゾーニングのスコア行列 (scores内)
+	vector<vector<int> > orders;		// 各グループの住宅地セルの並び (先頭のsorted_ends[u]個だけソート済み)
+	vector<int> sorted_ends;			// 各グループの、ソート済みの範囲の終端
+	vector<int> chunk_sizes;			// 各グループの、次に選択するチャンクのサイズ
+	vector<int> pointers;				// 各グループの、リスト中の現在位置
+	vector<float> occupied;
+
+public:
+	ZoningScorer(vector<pair<float, vector<float> > >& preferences);
+
+	float computeScore(const Mat_<uchar>& zones, const Mat_<float>* properties, uchar residential_type);
+	float computeScore(const float* const properties[6], const uchar* zones, int num_cells, uchar residential_type);
+	void computeScores(const ZoningBatch& batch, uchar residential_type, vector<float>& scores);
+	int numGroups() const { return num_groups; }
+
+private:
+	void collectCells(const uchar* zones, uchar residential_type);
+	void computeScoreMatrix(const float* const properties[6]);
+	void resetOrders();
+	float assignCells();
+	int cellAt(int u, int pos);
+	void extendOrder(int u);
+};
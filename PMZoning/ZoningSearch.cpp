@@ -0,0 +1,258 @@
+﻿#include "ZoningSearch.h"
+#include "PMZoning.h"
+#include "ZoningScorer.h"
+#include "ZoningBatch.h"
+#include "ScoringKernel.h"
+#include <QElapsedTimer>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+TimingHistogram::TimingHistogram() {
+	for (int i = 0; i < NUM_BINS; ++i) {
+		bins[i] = 0;
+	}
+	count = 0;
+	total = 0.0;
+	min_time = std::numeric_limits<double>::max();
+	max_time = 0.0;
+}
+
+/**
+ * 処理時間を1つ追加する。
+ *
+ * @param usec		処理時間 [usec]
+ */
+void TimingHistogram::add(double usec) {
+	int bin = 0;
+	while (bin < NUM_BINS - 1 && usec >= (double)(1 << bin)) {
+		bin++;
+	}
+	bins[bin]++;
+
+	count++;
+	total += usec;
+	if (usec < min_time) min_time = usec;
+	if (usec > max_time) max_time = usec;
+}
+
+/**
+ * 別のヒストグラムを統合する。
+ */
+void TimingHistogram::merge(const TimingHistogram& ref) {
+	for (int i = 0; i < NUM_BINS; ++i) {
+		bins[i] += ref.bins[i];
+	}
+	count += ref.count;
+	total += ref.total;
+	if (ref.min_time < min_time) min_time = ref.min_time;
+	if (ref.max_time > max_time) max_time = ref.max_time;
+}
+
+/**
+ * ヒストグラムを表示する。空のbinは表示しない。
+ */
+void TimingHistogram::print(const char* label) const {
+	if (count == 0) {
+		printf("  %s: no samples\n", label);
+		return;
+	}
+
+	printf("  %s: %d samples, total %lf sec, mean %lf msec, min %lf msec, max %lf msec\n", label, count, total / 1000000.0, total / count / 1000.0, min_time / 1000.0, max_time / 1000.0);
+	for (int i = 0; i < NUM_BINS; ++i) {
+		if (bins[i] == 0) continue;
+
+		double lower = i == 0 ? 0.0 : (double)(1 << (i - 1));
+		double upper = (double)(1 << i);
+		printf("    [%9.0lf, %9.0lf) usec: %d\n", lower, upper, bins[i]);
+	}
+}
+
+/**
+ * @param city_size				cityの一辺の距離 [m]
+ * @param grid_size				グリッドの一辺のサイズ
+ * @param zone_distribution		ゾーンタイプの配分率
+ * @param roads					道路網 (全ワーカーで共有する)
+ * @param num_workers			ワーカー数 (0ならOpenMPの最大スレッド数)
+ * @param seed					乱数のシード
+ */
+ZoningSearch::ZoningSearch(int city_size, int grid_size, vector<float>& zone_distribution, const RoadSnapshotPtr& roads, int num_workers, unsigned int seed) : roads(roads) {
+	this->city_size = city_size;
+	this->grid_size = grid_size;
+	this->zone_distribution = zone_distribution;
+	this->seed = seed;
+
+	if (num_workers <= 0) {
+#ifdef _OPENMP
+		num_workers = omp_get_max_threads();
+#else
+		num_workers = 1;
+#endif
+	}
+	this->num_workers = num_workers;
+}
+
+/**
+ * 指定された数の候補を生成し、ベストスコアのゾーニングを返却する。
+ * 候補は1つずつ空いているワーカーに割り当てられるので、処理時間にばらつきがあっても負荷が偏らない。
+ *
+ * @param preferences			ユーザのpreferenceベクトル
+ * @param num_candidates		候補の数
+ * @param num_iterations		各候補のPMの更新回数
+ * @param best_zones [OUT]		ベストスコアのゾーンマップ
+ * @return						ベストスコア
+ */
+float ZoningSearch::findBest(vector<pair<float, vector<float> > >& preferences, int num_candidates, int num_iterations, Mat_<uchar>& best_zones) {
+	results.clear();
+	results.resize(num_workers);
+	for (int w = 0; w < num_workers; ++w) {
+		results[w].best_score = -std::numeric_limits<float>::max();
+		results[w].best_candidate = -1;
+		results[w].num_candidates = 0;
+	}
+
+#pragma omp parallel num_threads(num_workers)
+	{
+#ifdef _OPENMP
+		int worker = omp_get_thread_num();
+#else
+		int worker = 0;
+#endif
+		WorkerResult& result = results[worker];
+
+		// ワーカー専用のPMZoningインスタンス
+		PMZoning pm(city_size, grid_size, zone_distribution, roads);
+		ZoningScorer scorer(preferences);
+		ZoningBatch batch(BATCH_SIZE, grid_size * grid_size);
+		vector<int> batch_candidates;
+
+		QElapsedTimer timer;
+
+#pragma omp for schedule(dynamic, 1)
+		for (int i = 0; i < num_candidates; ++i) {
+			// 候補ごとに独立した乱数系列
+			Rng rng(seed, i);
+
+			timer.start();
+			pm.initialZoning(zone_distribution, rng);
+			result.timings[STAGE_INIT].add(timer.nsecsElapsed() / 1000.0);
+
+			timer.start();
+			for (int iter = 0; iter < num_iterations; ++iter) {
+				pm.update(rng);
+			}
+			result.timings[STAGE_PM].add(timer.nsecsElapsed() / 1000.0);
+
+			timer.start();
+			pm.computePropertyVectors();
+			result.timings[STAGE_PROPERTY].add(timer.nsecsElapsed() / 1000.0);
+
+			// スコアは、バッチが一杯になってからまとめて計算する
+			pm.addToBatch(batch);
+			batch_candidates.push_back(i);
+			if (batch.full()) {
+				scoreBatch(scorer, batch, batch_candidates, result);
+			}
+		}
+
+		// 残りの候補
+		scoreBatch(scorer, batch, batch_candidates, result);
+	}
+
+	// 各ワーカーのベストを比較して、全体のベストを決める
+	// 同点の場合は、候補番号の小さい方を採用する
+	int best_worker = -1;
+	for (int w = 0; w < num_workers; ++w) {
+		if (results[w].best_candidate < 0) continue;
+
+		if (best_worker < 0 || results[w].best_score > results[best_worker].best_score || (results[w].best_score == results[best_worker].best_score && results[w].best_candidate < results[best_worker].best_candidate)) {
+			best_worker = w;
+		}
+	}
+
+	if (best_worker < 0) return 0.0f;
+
+	results[best_worker].best_zones.unpack(best_zones);
+	return results[best_worker].best_score;
+}
+
+/**
+ * バッチにまとめた候補のスコアを計算し、ワーカー内のベストを更新して、バッチを空にする。
+ * 候補は番号の小さい順に追加されているので、同点の場合は番号の小さい方が残る。
+ *
+ * @param scorer		ワーカー専用のスコア計算エンジン
+ * @param batch			候補のバッチ
+ * @param candidates	バッチ内の各候補の番号
+ * @param result		ワーカーの結果
+ */
+void ZoningSearch::scoreBatch(ZoningScorer& scorer, ZoningBatch& batch, vector<int>& candidates, WorkerResult& result) {
+	if (batch.size() == 0) return;
+
+	QElapsedTimer timer;
+	timer.start();
+	vector<float> scores;
+	Zoning::computeScores(scorer, batch, scores);
+
+	// 1候補あたりの処理時間として記録する
+	double usec = timer.nsecsElapsed() / 1000.0 / batch.size();
+	for (int j = 0; j < batch.size(); ++j) {
+		result.timings[STAGE_SCORE].add(usec);
+	}
+
+	for (int j = 0; j < batch.size(); ++j) {
+		result.num_candidates++;
+
+		// ワーカー内のベストだけを更新する（ゾーンマップのみコピーする）
+		if (scores[j] > result.best_score) {
+			result.best_score = scores[j];
+			result.best_candidate = candidates[j];
+			result.best_zones.pack(batch.zoneData(j), grid_size, grid_size);
+		}
+	}
+
+	batch.clear();
+	candidates.clear();
+}
+
+/**
+ * 指定された候補を、findBest()と同じ乱数系列で再生成する。
+ *
+ * @param candidate			候補の番号
+ * @param num_iterations	PMの更新回数
+ * @param pm [OUT]			生成結果を格納するPMZoning
+ */
+void ZoningSearch::generateCandidate(int candidate, int num_iterations, PMZoning& pm) {
+	Rng rng(seed, candidate);
+
+	pm.initialZoning(zone_distribution, rng);
+	for (int iter = 0; iter < num_iterations; ++iter) {
+		pm.update(rng);
+	}
+}
+
+/**
+ * ワーカーごとの、各処理段階の処理時間のヒストグラムを表示する。
+ */
+void ZoningSearch::printStatistics() const {
+	const char* labels[NUM_STAGES] = { "init zones", "PM", "property vector", "score" };
+
+	TimingHistogram total[NUM_STAGES];
+	for (int w = 0; w < results.size(); ++w) {
+		if (results[w].num_candidates == 0) {
+			printf("worker %d: no candidates\n", w);
+			continue;
+		}
+
+		printf("worker %d: %d candidates, best score %lf (candidate %d)\n", w, results[w].num_candidates, results[w].best_score, results[w].best_candidate);
+		for (int s = 0; s < NUM_STAGES; ++s) {
+			results[w].timings[s].print(labels[s]);
+			total[s].merge(results[w].timings[s]);
+		}
+	}
+
+	printf("all workers (score kernel: %s):\n", scoringkernel::instructionSetName(scoringkernel::instructionSet()));
+	for (int s = 0; s < NUM_STAGES; ++s) {
+		printf("  %s: %lf sec\n", labels[s], total[s].totalSeconds());
+	}
+}
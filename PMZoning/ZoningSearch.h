@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include <vector>
+#include <opencv/cv.h>
+#include "RoadSnapshot.h"
+#include "Rng.h"
+#include "PackedZoneMap.h"
+
+using namespace std;
+using namespace cv;
+
+class PMZoning;
+class ZoningScorer;
+class ZoningBatch;
+
+/**
+ * 処理時間のヒストグラム。
+ * 各binは、[2^(i-1), 2^i) マイクロ秒の範囲を表す。
+ */
+class TimingHistogram {
+public:
+	static const int NUM_BINS = 24;
+
+private:
+	int bins[NUM_BINS];
+	int count;
+	double total;		// 合計時間 [usec]
+	double min_time;	// 最小時間 [usec]
+	double max_time;	// 最大時間 [usec]
+
+public:
+	TimingHistogram();
+
+	void add(double usec);
+	void merge(const TimingHistogram& ref);
+	int numSamples() const { return count; }
+	double totalSeconds() const { return total / 1000000.0; }
+	void print(const char* label) const;
+};
+
+/**
+ * PMZoningの候補を複数のスレッドで並列に生成し、ベストスコアのゾーニングを探す。
+ * 各ワーカーは、自分専用のPMZoningインスタンスを持ち、自分が担当した候補の中のベストだけを保持する。
+ * i番目の候補は、常に(seed, i)の乱数系列で生成されるので、
+ * ワーカー数や割り当て順に関係なく、同じ結果を再現できる。
+ * 全ワーカーの終了後に、ワーカーごとのベストを比較して全体のベストを決める。
+ * スコアの計算は、各ワーカーがBATCH_SIZE個の候補をまとめてから、一括して行う。
+ */
+class ZoningSearch {
+public:
+	/** 処理段階の種類 */
+	enum { STAGE_INIT = 0, STAGE_PM, STAGE_PROPERTY, STAGE_SCORE };
+	static const int NUM_STAGES = 4;
+
+	/** まとめてスコアを計算する候補の数 */
+	static const int BATCH_SIZE = 8;
+
+private:
+	/** 各ワーカーの結果 */
+	struct WorkerResult {
+		float best_score;
+		int best_candidate;
+		PackedZoneMap best_zones;		// 1セル2ビットに詰めて保持する
+		int num_candidates;
+		TimingHistogram timings[NUM_STAGES];
+	};
+
+	int city_size;
+	int grid_size;
+	vector<float> zone_distribution;
+	RoadSnapshotPtr roads;
+	int num_workers;
+	unsigned int seed;
+	vector<WorkerResult> results;
+
+public:
+	ZoningSearch(int city_size, int grid_size, vector<float>& zone_distribution, const RoadSnapshotPtr& roads, int num_workers = 0, unsigned int seed = 0);
+
+	float findBest(vector<pair<float, vector<float> > >& preferences, int num_candidates, int num_iterations, Mat_<uchar>& best_zones);
+	void printStatistics() const;
+	void generateCandidate(int candidate, int num_iterations, PMZoning& pm);
+	int numWorkers() const { return num_workers; }
+
+private:
+	void scoreBatch(ZoningScorer& scorer, ZoningBatch& batch, vector<int>& candidates, WorkerResult& result);
+};